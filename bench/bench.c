@@ -0,0 +1,728 @@
+/**
+ * @file bench.c
+ * @brief Throughput and round-trip comparison of the conversion core.
+ *
+ * Every corpus distribution from corpus.h is generated in memory and pushed
+ * through this project's conversion stages, through the C library's
+ * `printf`/`strtod` family, which is the reference the decimal output is
+ * held to, and through Ryu's shortest round-tripping formatter, vendored
+ * under third_party for comparison. For each stage the median throughput
+ * over several repetitions is reported, together with the output size of
+ * every format, and the run fails if any round trip does not reproduce the
+ * original words.
+ *
+ * With `-b FILE` the key stages are instead compared against a baseline, and
+ * the run fails if any stage is slower than its tolerance band allows. `-B
+ * FILE` records such a baseline on the current machine. Each stage is held
+ * to its speed relative to `strtod` parsing of the same corpus, measured in
+ * the same run, so a busier or throttled machine moves both alike. A
+ * baseline names the host it was recorded on, and is skipped elsewhere.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/utsname.h>
+#include <time.h>
+
+#include "bit_text.h"
+#include "columns.h"
+#include "corpus.h"
+#include "explain.h"
+#include "float_word.h"
+#include "parallel.h"
+#include "ryu/ryu.h"
+#include "stream.h"
+#include "xor_stream.h"
+
+#define DECIMAL_CHARS 32 // Longest "%.17g" value plus newline
+#define EXPLAIN_CHARS 96 // Longest binary64 explain line
+#define DEFAULT_TOLERANCE 30 // Percent a gated stage may lose
+#define REFERENCE_KEY "parse-strtod" // Stage the gated ones are relative to
+#define EXIT_SKIPPED 77 // Baseline from another host, see SKIP_RETURN_CODE
+#define HOST_CHARS 192
+
+/**
+ * @brief A generated corpus and the buffers every stage works on.
+ */
+struct bench_data {
+  const struct float_layout *layout;
+  size_t count;
+  uint64_t *words;         // Corpus
+  uint64_t *check;         // Words recovered by a parsing stage
+  double *values;          // Decoded values
+  char *bits;              // Corpus as bit strings
+  size_t bits_length;
+  char *decimal;           // Corpus as round-trippable decimals
+  size_t decimal_length;
+  char *shortest;          // Corpus as Ryu's shortest decimals
+  size_t shortest_length;
+  unsigned char *xor_data; // Corpus as XOR blocks, back to back
+  size_t xor_length;
+  unsigned char *raw;      // Corpus as a native array
+  char *scratch;           // Output of formatting stages
+  struct bit_picture picture;
+  struct explain_format explain;
+  struct float_columns columns; // Corpus decoded into fields
+  int failed;                   // Set by a stage that could not run
+};
+
+/**
+ * @brief One measured conversion stage.
+ */
+struct bench_stage {
+  const char *name;
+  const char *key;                        // Name in baseline files
+  int gated;                              // Recorded in new baselines
+  size_t (*run)(struct bench_data *data); // Returns bytes produced
+};
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static size_t stage_pack(struct bench_data *data) {
+  size_t stride = (size_t)data->layout->width + 1;
+  for (size_t i = 0; i < data->count; i++) {
+    pack_binary_float(data->bits + i * stride, stride - 1, &data->check[i]);
+  }
+  return data->count * sizeof(uint64_t);
+}
+
+static size_t stage_decode(struct bench_data *data) {
+  for (size_t i = 0; i < data->count; i++) {
+    data->values[i] = decode_float_word(data->words[i], data->layout);
+  }
+  return data->count * sizeof(double);
+}
+
+static size_t stage_columns(struct bench_data *data) {
+  data->columns.count = 0;
+  float_columns_append(&data->columns, data->words, data->count, data->layout);
+  return data->count * (2 * sizeof(uint8_t) + sizeof(int16_t) +
+                        sizeof(uint64_t));
+}
+
+static size_t stage_columns_cached(struct bench_data *data) {
+  size_t bytes;
+
+  data->columns.stores = FLOAT_COLUMNS_CACHED;
+  bytes = stage_columns(data);
+  data->columns.stores = FLOAT_COLUMNS_AUTO;
+  return bytes;
+}
+
+static size_t stage_format_bits(struct bench_data *data) {
+  char *out = data->scratch;
+  for (size_t i = 0; i < data->count; i++) {
+    out = bit_picture_render(&data->picture, data->words[i], out);
+    *out++ = '\n';
+  }
+  return (size_t)(out - data->scratch);
+}
+
+static size_t stage_format_explain(struct bench_data *data) {
+  return explain_emit(&data->explain, data->words, data->count,
+                      data->scratch);
+}
+
+static size_t stage_format_printf(struct bench_data *data) {
+  int precision = data->layout->width == 32 ? 9 : 17;
+  char *out = data->scratch;
+  for (size_t i = 0; i < data->count; i++) {
+    out += snprintf(out, DECIMAL_CHARS, "%.*g\n", precision, data->values[i]);
+  }
+  return (size_t)(out - data->scratch);
+}
+
+static size_t stage_format_ryu(struct bench_data *data) {
+  char *out = data->scratch;
+  for (size_t i = 0; i < data->count; i++) {
+    if (data->layout->width == 32) {
+      out += f2s_buffered_n((float)data->values[i], out);
+    } else {
+      out += d2s_buffered_n(data->values[i], out);
+    }
+    *out++ = '\n';
+  }
+  return (size_t)(out - data->scratch);
+}
+
+/**
+ * @brief Parses one decimal per line of `text` back into `check`.
+ */
+static void parse_decimal(struct bench_data *data, char *text) {
+  for (size_t i = 0; i < data->count; i++) {
+    if (data->layout->width == 32) {
+      float value = strtof(text, &text);
+      uint32_t word;
+      memcpy(&word, &value, sizeof(word));
+      data->check[i] = word;
+    } else {
+      double value = strtod(text, &text);
+      memcpy(&data->check[i], &value, sizeof(value));
+    }
+  }
+}
+
+static size_t stage_parse_strtod(struct bench_data *data) {
+  parse_decimal(data, data->decimal);
+  return data->count * sizeof(uint64_t);
+}
+
+static size_t stage_xor_encode(struct bench_data *data) {
+  unsigned char *out = (unsigned char *)data->scratch;
+  size_t length = 0;
+
+  for (size_t i = 0; i < data->count; i += XOR_BLOCK_VALUES) {
+    size_t count = data->count - i < XOR_BLOCK_VALUES ? data->count - i
+                                                      : XOR_BLOCK_VALUES;
+    length += xor_encode_block(data->words + i, count, data->layout->width,
+                               out + length);
+  }
+  return length;
+}
+
+static size_t stage_xor_decode(struct bench_data *data) {
+  const unsigned char *in = data->xor_data;
+
+  for (size_t i = 0; i < data->count; i += XOR_BLOCK_VALUES) {
+    size_t count = data->count - i < XOR_BLOCK_VALUES ? data->count - i
+                                                      : XOR_BLOCK_VALUES;
+    size_t length;
+    memcpy(&length, in, sizeof(length));
+    in += sizeof(length);
+    xor_decode_block(in, length, count, data->layout->width, data->check + i);
+    in += length;
+  }
+  return data->count * sizeof(uint64_t);
+}
+
+static size_t stage_stream(struct bench_data *data) {
+  struct stream_options options = {.width = data->layout->width,
+                                   .input = STREAM_RAW,
+                                   .output = STREAM_BITS};
+  size_t size = (size_t)data->layout->width / 8;
+  FILE *in = fmemopen(data->raw, data->count * size, "r");
+  FILE *out = fopen("/dev/null", "w");
+
+  if (!in || !out || run_stream(&options, in, out)) {
+    data->failed = 1;
+  }
+  if (in) {
+    fclose(in);
+  }
+  if (out) {
+    fclose(out);
+  }
+  return data->count * ((size_t)data->layout->width + 1);
+}
+
+static const struct bench_stage stages[] = {
+    {"pack bits", "pack", 1, stage_pack},
+    {"decode words", "decode", 1, stage_decode},
+    {"decode columns", "columns", 0, stage_columns},
+    {"decode columns (cached)", "columns-cached", 0, stage_columns_cached},
+    {"format bits", "format-bits", 1, stage_format_bits},
+    {"format explain", "format-explain", 1, stage_format_explain},
+    {"format decimal (printf)", "format-printf", 0, stage_format_printf},
+    {"format decimal (ryu)", "format-ryu", 0, stage_format_ryu},
+    {"parse decimal (strto*)", "parse-strtod", 0, stage_parse_strtod},
+    {"xor encode", "xor-encode", 0, stage_xor_encode},
+    {"xor decode", "xor-decode", 0, stage_xor_decode},
+    {"stream raw -> bits", "stream", 1, stage_stream},
+};
+
+#define STAGE_COUNT (sizeof(stages) / sizeof(*stages))
+
+static const char *const distribution_names[] = {"uniform", "normal",
+                                                 "subnormal", "nan", "repeat"};
+
+#define DISTRIBUTION_COUNT                                                     \
+  (sizeof(distribution_names) / sizeof(*distribution_names))
+
+static int prepare(struct bench_data *data, enum corpus_distribution dist,
+                   const struct float_layout *layout, size_t count) {
+  struct corpus_options options = {dist, 1, count};
+  struct corpus corpus;
+  size_t size = (size_t)layout->width / 8;
+  size_t filled = 0;
+
+  memset(data, 0, sizeof(*data));
+  data->layout = layout;
+  data->count = count;
+  data->words = malloc(count * sizeof(uint64_t));
+  data->check = malloc(count * sizeof(uint64_t));
+  data->values = malloc(count * sizeof(double));
+  data->bits = malloc(count * ((size_t)layout->width + 1) + BIT_PICTURE_SLACK);
+  data->decimal = malloc(count * DECIMAL_CHARS);
+  data->shortest = malloc(count * DECIMAL_CHARS);
+  data->xor_data = malloc(XOR_BLOCK_BYTES(count) +
+                          (count / XOR_BLOCK_VALUES + 1) * sizeof(size_t));
+  data->raw = malloc(count * size);
+  data->scratch = malloc(count * EXPLAIN_CHARS + BIT_PICTURE_SLACK);
+  if (!data->words || !data->check || !data->values || !data->bits ||
+      !data->decimal || !data->shortest || !data->xor_data || !data->raw ||
+      !data->scratch ||
+      float_columns_reserve(&data->columns, count)) {
+    perror("Memory allocation error.\n");
+    return -1;
+  }
+
+  corpus_init(&corpus, &options, layout);
+  while (filled < count) {
+    filled += corpus_fill(&corpus, data->words + filled, count - filled);
+  }
+  bit_picture_init(&data->picture, layout, '\0');
+  explain_init(&data->explain, layout);
+
+  // Inputs of the parsing stages, built with the stages under test
+  stage_decode(data);
+  data->bits_length = stage_format_bits(data);
+  memcpy(data->bits, data->scratch, data->bits_length);
+  data->decimal_length = stage_format_printf(data);
+  memcpy(data->decimal, data->scratch, data->decimal_length);
+  data->shortest_length = stage_format_ryu(data);
+  memcpy(data->shortest, data->scratch, data->shortest_length);
+
+  unsigned char *out = data->xor_data;
+  for (size_t i = 0; i < count; i += XOR_BLOCK_VALUES) {
+    size_t block = count - i < XOR_BLOCK_VALUES ? count - i : XOR_BLOCK_VALUES;
+    size_t length =
+        xor_encode_block(data->words + i, block, layout->width,
+                         out + sizeof(length));
+    memcpy(out, &length, sizeof(length));
+    out += sizeof(length) + length;
+    data->xor_length += length;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    if (size == 4) {
+      uint32_t word = (uint32_t)data->words[i];
+      memcpy(data->raw + 4 * i, &word, 4);
+    } else {
+      memcpy(data->raw + 8 * i, &data->words[i], 8);
+    }
+  }
+  return 0;
+}
+
+static void release(struct bench_data *data) {
+  free(data->words);
+  free(data->check);
+  free(data->values);
+  free(data->bits);
+  free(data->decimal);
+  free(data->shortest);
+  free(data->xor_data);
+  free(data->raw);
+  free(data->scratch);
+  float_columns_free(&data->columns);
+}
+
+static size_t count_mismatches(const struct bench_data *data, int same_nan) {
+  size_t mismatches = 0;
+
+  for (size_t i = 0; i < data->count; i++) {
+    if (data->check[i] == data->words[i]) {
+      continue;
+    }
+    // printf does not carry NaN payloads, so any NaN matches any NaN
+    if (same_nan &&
+        classify_float_word(data->words[i], data->layout) == FLOAT_NAN &&
+        classify_float_word(data->check[i], data->layout) == FLOAT_NAN) {
+      continue;
+    }
+    mismatches++;
+  }
+  return mismatches;
+}
+
+static size_t count_column_mismatches(struct bench_data *data) {
+  const struct float_layout *layout = data->layout;
+  const struct float_columns *columns = &data->columns;
+  size_t mismatches = 0;
+
+  stage_columns(data);
+  for (size_t i = 0; i < data->count; i++) {
+    uint64_t word = data->words[i];
+    mismatches +=
+        columns->sign[i] != (word >> (layout->width - 1) & 1) ||
+        columns->exponent[i] != float_word_exponent(word, layout) ||
+        columns->mantissa[i] != float_word_significand(word, layout) ||
+        columns->float_class[i] != classify_float_word(word, layout);
+  }
+  return mismatches;
+}
+
+static size_t verify(struct bench_data *data) {
+  size_t pack, decimal, shortest, xor, columns;
+
+  stage_pack(data);
+  pack = count_mismatches(data, 0);
+  stage_parse_strtod(data);
+  decimal = count_mismatches(data, 1);
+  parse_decimal(data, data->shortest);
+  shortest = count_mismatches(data, 1);
+  stage_xor_decode(data);
+  xor = count_mismatches(data, 0);
+  columns = count_column_mismatches(data);
+
+  printf("  round trip: bits %s, decimal %s, ryu %s, xor %s, columns %s\n",
+         pack ? "MISMATCH" : "ok", decimal ? "MISMATCH" : "ok",
+         shortest ? "MISMATCH" : "ok", xor ? "MISMATCH" : "ok",
+         columns ? "MISMATCH" : "ok");
+  return pack + decimal + shortest + xor + columns;
+}
+
+/**
+ * @brief Times repetitions of a stage.
+ *
+ * @return double Median seconds per run, or -1 if the stage failed.
+ */
+static double measure(struct bench_data *data, const struct bench_stage *stage,
+                      int repetitions, size_t *bytes) {
+  double *samples = malloc((size_t)repetitions * sizeof(double));
+  double median;
+
+  data->failed = 0;
+  *bytes = stage->run(data); // Warm-up
+  for (int r = 0; r < repetitions; r++) {
+    double start = now_seconds();
+    *bytes = stage->run(data);
+    samples[r] = now_seconds() - start;
+  }
+  qsort(samples, (size_t)repetitions, sizeof(double), compare_doubles);
+
+  median = samples[repetitions / 2];
+  free(samples);
+  if (data->failed) {
+    fprintf(stderr, "Stage \"%s\" failed\n", stage->name);
+    return -1;
+  }
+  return median;
+}
+
+static int run_report(const struct float_layout *layout, size_t count,
+                      int repetitions) {
+  size_t failures = 0;
+
+  for (size_t d = 0; d < DISTRIBUTION_COUNT; d++) {
+    struct bench_data data;
+
+    printf("%s, binary%d, %zu values, median of %d\n", distribution_names[d],
+           layout->width, count, repetitions);
+    if (prepare(&data, (enum corpus_distribution)d, layout, count)) {
+      release(&data);
+      return 1;
+    }
+
+    printf("  %-26s %12s %12s\n", "stage", "Mvalues/s", "MB/s out");
+    for (size_t s = 0; s < STAGE_COUNT; s++) {
+      size_t bytes;
+      double median = measure(&data, &stages[s], repetitions, &bytes);
+      if (median < 0) {
+        printf("  %-26s %12s %12s\n", stages[s].name, "FAILED", "FAILED");
+        failures++;
+        continue;
+      }
+      printf("  %-26s %12.1f %12.1f\n", stages[s].name,
+             (double)count / median / 1e6, (double)bytes / median / 1e6);
+    }
+
+    printf("  bytes/value: bits %.1f, decimal %.1f, ryu %.1f, xor %.2f, "
+           "raw %d\n",
+           (double)data.bits_length / (double)count,
+           (double)data.decimal_length / (double)count,
+           (double)data.shortest_length / (double)count,
+           (double)data.xor_length / (double)count, layout->width / 8);
+    failures += verify(&data);
+    printf("\n");
+    release(&data);
+  }
+
+  return failures ? 1 : 0;
+}
+
+static const struct bench_stage *stage_by_key(const char *key) {
+  for (size_t s = 0; s < STAGE_COUNT; s++) {
+    if (strcmp(stages[s].key, key) == 0) {
+      return &stages[s];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Describes this machine: architecture, processors and CPU model.
+ */
+static void host_fingerprint(char *out, size_t size) {
+  struct utsname name;
+  char line[256], model[128] = "unknown";
+  FILE *cpuinfo = fopen("/proc/cpuinfo", "r");
+
+  while (cpuinfo && fgets(line, sizeof(line), cpuinfo)) {
+    char *value = strchr(line, ':');
+    if (value && strncmp(line, "model name", 10) == 0) {
+      value += 1 + strspn(value + 1, " \t");
+      value[strcspn(value, "\n")] = '\0';
+      snprintf(model, sizeof(model), "%s", value);
+      break;
+    }
+  }
+  if (cpuinfo) {
+    fclose(cpuinfo);
+  }
+  snprintf(out, size, "%s %zu %s", uname(&name) ? "unknown" : name.machine,
+           parallel_cpu_count(), model);
+}
+
+/**
+ * @brief Measures a stage's speed relative to the reference stage.
+ *
+ * Every repetition times the reference right before the stage, so both see
+ * the same machine state, and the median of the per-repetition ratios is
+ * kept.
+ *
+ * @return double Reference time over stage time, or -1 if either failed.
+ */
+static double relative_speed(struct bench_data *data,
+                             const struct bench_stage *stage,
+                             int repetitions) {
+  const struct bench_stage *reference = stage_by_key(REFERENCE_KEY);
+  double *ratios = malloc((size_t)repetitions * sizeof(double));
+  double median;
+
+  data->failed = 0;
+  reference->run(data); // Warm-up
+  stage->run(data);
+  for (int r = 0; r < repetitions; r++) {
+    double start = now_seconds();
+    reference->run(data);
+    double middle = now_seconds();
+    stage->run(data);
+    ratios[r] = (middle - start) / (now_seconds() - middle);
+  }
+  qsort(ratios, (size_t)repetitions, sizeof(double), compare_doubles);
+
+  median = ratios[repetitions / 2];
+  free(ratios);
+  if (data->failed) {
+    fprintf(stderr, "Stage \"%s\" failed\n", stage->name);
+    return -1;
+  }
+  return median;
+}
+
+static int write_baseline(const char *path, size_t count, int repetitions) {
+  static const enum corpus_distribution gated[] = {CORPUS_NORMAL,
+                                                   CORPUS_REPEAT};
+  FILE *out = fopen(path, "w");
+  char host[HOST_CHARS];
+
+  if (!out) {
+    perror(path);
+    return 1;
+  }
+
+  host_fingerprint(host, sizeof(host));
+  fprintf(out,
+          "# bf2d_bench baseline: median speed of the gated stages relative\n"
+          "# to %s on the same corpus, recorded on the host below\n"
+          "# width distribution stage relative_speed tolerance_%%\n"
+          "host %s\n",
+          REFERENCE_KEY, host);
+  for (int width = 32; width <= 64; width += 32) {
+    for (size_t d = 0; d < sizeof(gated) / sizeof(*gated); d++) {
+      struct bench_data data;
+      double speed = 0;
+
+      if (prepare(&data, gated[d], float_layout_for(width), count)) {
+        release(&data);
+        fclose(out);
+        return 1;
+      }
+      for (size_t s = 0; s < STAGE_COUNT && speed >= 0; s++) {
+        if (!stages[s].gated) {
+          continue;
+        }
+        speed = relative_speed(&data, &stages[s], repetitions);
+        fprintf(out, "%d %s %s %.3f %d\n", width,
+                distribution_names[gated[d]], stages[s].key, speed,
+                DEFAULT_TOLERANCE);
+      }
+      release(&data);
+      if (speed < 0) {
+        fclose(out);
+        return 1;
+      }
+    }
+  }
+
+  printf("Wrote %s for host %s\n", path, host);
+  return fclose(out) ? 1 : 0;
+}
+
+/**
+ * @brief Reads the host line of a baseline and compares it with this one.
+ *
+ * @return int 0 if the baseline was recorded on this host, `EXIT_SKIPPED`
+ *         with the reason printed if not.
+ */
+static int check_host(FILE *in, const char *path, size_t *line_number) {
+  char line[256], host[HOST_CHARS];
+
+  host_fingerprint(host, sizeof(host));
+  while (fgets(line, sizeof(line), in)) {
+    ++*line_number;
+    if (line[0] == '#' || line[0] == '\n') {
+      continue;
+    }
+    line[strcspn(line, "\n")] = '\0';
+    if (strncmp(line, "host ", 5) == 0 && strcmp(line + 5, host) == 0) {
+      return 0;
+    }
+    break;
+  }
+  printf("Skipped: %s was not recorded on this host (%s); record one here "
+         "with bf2d_bench -B %s\n",
+         path, host, path);
+  return EXIT_SKIPPED;
+}
+
+static int check_baseline(const char *path, size_t count, int repetitions) {
+  FILE *in = fopen(path, "r");
+  struct bench_data data = {0};
+  int prepared_width = 0, prepared_dist = -1;
+  size_t checked = 0, slower = 0, line_number = 0;
+  char line[256];
+
+  if (!in) {
+    perror(path);
+    return 1;
+  }
+  if (check_host(in, path, &line_number)) {
+    fclose(in);
+    return EXIT_SKIPPED;
+  }
+
+  printf("Checking against %s (median of %d, %zu values, speed relative to "
+         "%s)\n",
+         path, repetitions, count, REFERENCE_KEY);
+  printf("  %-28s %10s %10s %8s\n", "stage", "baseline", "now", "change");
+
+  while (fgets(line, sizeof(line), in)) {
+    char dist_name[32], key[32];
+    enum corpus_distribution dist;
+    const struct bench_stage *stage;
+    double expected;
+    int width, tolerance;
+
+    line_number++;
+    if (line[0] == '#' || line[0] == '\n') {
+      continue;
+    }
+    if (sscanf(line, "%d %31s %31s %lf %d", &width, dist_name, key, &expected,
+               &tolerance) != 5 ||
+        !float_layout_for(width) ||
+        corpus_distribution_from_name(dist_name, &dist) ||
+        !(stage = stage_by_key(key))) {
+      fprintf(stderr, "%s:%zu: malformed baseline entry\n", path,
+              line_number);
+      slower++;
+      continue;
+    }
+
+    // Entries are grouped, so each corpus is generated once
+    if (width != prepared_width || (int)dist != prepared_dist) {
+      release(&data);
+      if (prepare(&data, dist, float_layout_for(width), count)) {
+        release(&data);
+        fclose(in);
+        return 1;
+      }
+      prepared_width = width;
+      prepared_dist = (int)dist;
+    }
+
+    double now = relative_speed(&data, stage, repetitions);
+    if (now < 0) {
+      printf("  %d %s %s failed\n", width, dist_name, key);
+      slower++;
+      continue;
+    }
+    double change = (now / expected - 1) * 100;
+    int regressed = change < -tolerance;
+    char label[64];
+
+    snprintf(label, sizeof(label), "%d %s %s", width, dist_name, key);
+    printf("  %-28s %10.3f %10.3f %+7.1f%%  %s\n", label, expected, now,
+           change, regressed ? "SLOWER" : "ok");
+    if (regressed) {
+      printf("    limit is -%d%%: %s got slower on binary%d %s input\n",
+             tolerance, stage->name, width, dist_name);
+    }
+    checked++;
+    slower += (size_t)regressed;
+  }
+
+  release(&data);
+  fclose(in);
+  printf("%zu of %zu stages slower than baseline\n", slower, checked);
+  return slower || !checked ? 1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+  const char *check_path = NULL, *write_path = NULL;
+  size_t count = 1000000;
+  int width = 32, repetitions = 5, opt;
+
+  while ((opt = getopt(argc, argv, "n:w:r:b:B:")) != -1) {
+    switch (opt) {
+    case 'n':
+      count = strtoull(optarg, NULL, 0);
+      break;
+    case 'w':
+      width = atoi(optarg);
+      break;
+    case 'r':
+      repetitions = atoi(optarg);
+      break;
+    case 'b':
+      check_path = optarg;
+      break;
+    case 'B':
+      write_path = optarg;
+      break;
+    default:
+      fprintf(stderr,
+              "Usage: %s [-n values] [-w 32|64] [-r repetitions]\n"
+              "          [-b baseline to check | -B baseline to write]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  const struct float_layout *layout = float_layout_for(width);
+  if (!layout || !count || repetitions < 1) {
+    fprintf(stderr, "Invalid width, count or repetitions\n");
+    return 1;
+  }
+
+  if (write_path) {
+    return write_baseline(write_path, count, repetitions);
+  } else if (check_path) {
+    return check_baseline(check_path, count, repetitions);
+  }
+  return run_report(layout, count, repetitions);
+}
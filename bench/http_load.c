@@ -0,0 +1,332 @@
+/**
+ * @file http_load.c
+ * @brief Local load generator for the HTTP conversion server.
+ *
+ * Opens a number of keep-alive connections to `BinaryFloatToDecimal serve`,
+ * each on its own thread, and sends back-to-back `POST /convert` requests
+ * carrying a fixed batch of generated bit strings. Every response is read to
+ * its final chunk, and the time from sending a request to receiving its last
+ * byte is recorded in the latency histograms of latency.h. The report gives
+ * requests and values per second plus latency percentiles.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "bit_text.h"
+#include "corpus.h"
+#include "latency.h"
+
+#define RESPONSE_BYTES 65536 // Receive buffer per connection
+
+/**
+ * @brief Settings shared by all load threads.
+ */
+struct load_options {
+  int port;
+  size_t requests;    // Requests per connection
+  size_t values;      // Values per request
+  int width;
+  const char *output; // Output format requested
+  char *request;      // Complete request, head and body
+  size_t request_length;
+};
+
+/**
+ * @brief A connection's receive buffer.
+ */
+struct response_reader {
+  int fd;
+  char buffer[RESPONSE_BYTES];
+  size_t start;
+  size_t end;
+};
+
+static int fill(struct response_reader *reader) {
+  ssize_t got;
+
+  if (reader->start == reader->end) {
+    reader->start = reader->end = 0;
+  }
+  if (reader->end == sizeof(reader->buffer)) {
+    memmove(reader->buffer, reader->buffer + reader->start,
+            reader->end - reader->start);
+    reader->end -= reader->start;
+    reader->start = 0;
+  }
+  do {
+    got = recv(reader->fd, reader->buffer + reader->end,
+               sizeof(reader->buffer) - reader->end, 0);
+  } while (got < 0 && errno == EINTR);
+  if (got <= 0) {
+    return -1;
+  }
+  reader->end += (size_t)got;
+  return 0;
+}
+
+/**
+ * @brief Returns the next CRLF-terminated line, terminated in place.
+ */
+static char *read_line(struct response_reader *reader) {
+  for (;;) {
+    char *line = reader->buffer + reader->start;
+    char *end = memchr(line, '\n', reader->end - reader->start);
+    if (end) {
+      *end = '\0';
+      if (end > line && end[-1] == '\r') {
+        end[-1] = '\0';
+      }
+      reader->start = (size_t)(end + 1 - reader->buffer);
+      return line;
+    }
+    if (fill(reader)) {
+      return NULL;
+    }
+  }
+}
+
+static int skip(struct response_reader *reader, size_t length) {
+  while (length) {
+    size_t available = reader->end - reader->start;
+    if (!available) {
+      if (fill(reader)) {
+        return -1;
+      }
+      continue;
+    }
+    size_t take = available < length ? available : length;
+    reader->start += take;
+    length -= take;
+  }
+  return 0;
+}
+
+/**
+ * @brief Reads one whole response, discarding its body.
+ *
+ * @return int 0 for a complete 200 response, -1 otherwise.
+ */
+static int read_response(struct response_reader *reader) {
+  char *line = read_line(reader);
+  size_t content_length = 0;
+  int ok, chunked = 0;
+
+  if (!line) {
+    return -1;
+  }
+  ok = strncmp(line, "HTTP/1.1 200", 12) == 0;
+  while ((line = read_line(reader)) && *line) {
+    if (strncmp(line, "Transfer-Encoding: chunked", 26) == 0) {
+      chunked = 1;
+    } else if (strncmp(line, "Content-Length:", 15) == 0) {
+      content_length = strtoull(line + 15, NULL, 10);
+    }
+  }
+  if (!line) {
+    return -1;
+  }
+
+  if (!chunked) {
+    return skip(reader, content_length) || !ok ? -1 : 0;
+  }
+  for (;;) {
+    if (!(line = read_line(reader))) {
+      return -1;
+    }
+    size_t size = strtoull(line, NULL, 16);
+    if (skip(reader, size + 2)) {
+      return -1;
+    }
+    if (!size) {
+      return ok ? 0 : -1;
+    }
+  }
+}
+
+static void *run_connection(void *argument) {
+  const struct load_options *options = (const struct load_options *)argument;
+  struct response_reader *reader =
+      (struct response_reader *)calloc(1, sizeof(*reader));
+  struct sockaddr_in address;
+  int no_delay = 1;
+  size_t failures = 0;
+
+  if (!reader) {
+    perror("Memory allocation error.\n");
+    return argument; // Non-NULL marks a failed connection
+  }
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons((uint16_t)options->port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  reader->fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (reader->fd < 0 ||
+      connect(reader->fd, (struct sockaddr *)&address, sizeof(address))) {
+    perror("connect");
+    free(reader);
+    return argument; // Non-NULL marks a failed connection
+  }
+  setsockopt(reader->fd, IPPROTO_TCP, TCP_NODELAY, &no_delay,
+             sizeof(no_delay));
+
+  for (size_t i = 0; i < options->requests; i++) {
+    uint64_t start = latency_now();
+    size_t sent = 0;
+
+    while (sent < options->request_length) {
+      ssize_t n = send(reader->fd, options->request + sent,
+                       options->request_length - sent, MSG_NOSIGNAL);
+      if (n <= 0) {
+        break;
+      }
+      sent += (size_t)n;
+    }
+    if (sent < options->request_length || read_response(reader)) {
+      failures++;
+      break;
+    }
+    latency_record(LATENCY_REQUEST, latency_now() - start);
+  }
+
+  close(reader->fd);
+  free(reader);
+  return failures ? argument : NULL;
+}
+
+/**
+ * @brief Builds the request every connection sends.
+ */
+static int build_request(struct load_options *options) {
+  const struct float_layout *layout = float_layout_for(options->width);
+  struct corpus_options corpus_options = {CORPUS_NORMAL, 1, options->values};
+  struct bit_picture picture;
+  struct corpus corpus;
+  size_t body_length = options->values * ((size_t)options->width + 1);
+  uint64_t word;
+  char head[256];
+
+  int head_length =
+      snprintf(head, sizeof(head),
+               "POST /convert?width=%d&output=%s HTTP/1.1\r\n"
+               "Host: 127.0.0.1\r\n"
+               "Content-Length: %zu\r\n"
+               "\r\n",
+               options->width, options->output, body_length);
+
+  options->request =
+      (char *)malloc((size_t)head_length + body_length + BIT_PICTURE_SLACK);
+  if (!options->request) {
+    perror("Memory allocation error.\n");
+    return -1;
+  }
+  memcpy(options->request, head, (size_t)head_length);
+
+  char *out = options->request + head_length;
+  bit_picture_init(&picture, layout, '\0');
+  corpus_init(&corpus, &corpus_options, layout);
+  while (corpus_fill(&corpus, &word, 1)) {
+    out = bit_picture_render(&picture, word, out);
+    *out++ = '\n';
+  }
+  options->request_length = (size_t)head_length + body_length;
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  struct load_options options = {8080, 1000, 64, 32, "decimal", NULL, 0};
+  struct latency_histogram *merged;
+  size_t connections = 4, failed = 0;
+  pthread_t *threads;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "p:c:n:v:w:o:")) != -1) {
+    switch (opt) {
+    case 'p':
+      options.port = atoi(optarg);
+      break;
+    case 'c':
+      connections = strtoull(optarg, NULL, 0);
+      break;
+    case 'n':
+      options.requests = strtoull(optarg, NULL, 0);
+      break;
+    case 'v':
+      options.values = strtoull(optarg, NULL, 0);
+      break;
+    case 'w':
+      options.width = atoi(optarg);
+      break;
+    case 'o':
+      options.output = optarg;
+      break;
+    default:
+      fprintf(stderr,
+              "Usage: %s [-p port] [-c connections] [-n requests each]\n"
+              "          [-v values per request] [-w 32|64] [-o output]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  if (!float_layout_for(options.width) || !connections || !options.values) {
+    fprintf(stderr, "Invalid width, connection or value count\n");
+    return 1;
+  }
+
+  threads = (pthread_t *)malloc(connections * sizeof(*threads));
+  merged = (struct latency_histogram *)malloc(sizeof(*merged));
+  if (!threads || !merged) {
+    perror("Memory allocation error.\n");
+    return 1;
+  }
+  if (build_request(&options)) {
+    return 1;
+  }
+
+  uint64_t start = latency_now();
+  for (size_t i = 0; i < connections; i++) {
+    if (pthread_create(&threads[i], NULL, run_connection, &options)) {
+      fprintf(stderr, "Could not start connection %zu\n", i);
+      return 1;
+    }
+  }
+  for (size_t i = 0; i < connections; i++) {
+    void *result;
+    pthread_join(threads[i], &result);
+    failed += result != NULL;
+  }
+  double seconds = (double)(latency_now() - start) / 1e9;
+
+  latency_merge(LATENCY_REQUEST, merged);
+  uint64_t served = atomic_load(&merged->total);
+  printf("%zu connections x %zu requests of %zu values, %s output\n",
+         connections, options.requests, options.values, options.output);
+  printf("  requests/s %12.0f\n  values/s   %12.0f\n",
+         (double)served / seconds,
+         (double)served * (double)options.values / seconds);
+  printf("  latency us  p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+         (double)latency_quantile(merged, 0.5) / 1e3,
+         (double)latency_quantile(merged, 0.9) / 1e3,
+         (double)latency_quantile(merged, 0.99) / 1e3,
+         (double)latency_quantile(merged, 0.999) / 1e3,
+         (double)atomic_load(&merged->max) / 1e3);
+  if (failed) {
+    fprintf(stderr, "%zu connections failed\n", failed);
+  }
+
+  free(options.request);
+  free(threads);
+  free(merged);
+  return failed ? 1 : 0;
+}
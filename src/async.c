@@ -0,0 +1,321 @@
+/**
+ * @file async.c
+ * @brief Asynchronous batch conversions on a fixed pool of worker threads.
+ */
+
+#define _GNU_SOURCE // eventfd()
+
+#include "async.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/**
+ * @brief A submitted conversion.
+ */
+struct async_job {
+  struct stream_options options;
+  FILE *in;
+  FILE *out;
+  async_callback callback;
+  void *user;
+  atomic_int cancel;              // Read by the conversion between blocks
+  _Atomic int status;             // An `enum async_status`
+  char error[STREAM_ERROR_BYTES]; // Why the job failed
+  struct async_job *next;         // Next job in the queue or the reap list
+};
+
+/**
+ * @brief Singly linked FIFO of jobs.
+ */
+struct job_list {
+  struct async_job *head;
+  struct async_job *tail;
+};
+
+/**
+ * @brief One pool thread and the job it is running.
+ */
+struct worker {
+  struct async_pool *pool;
+  pthread_t thread;
+  struct async_job *job; // Running job, guarded by the pool lock
+  struct bf2d_ctx *ctx;  // Buffers reused by every job of this thread
+};
+
+/**
+ * @brief Worker threads, their queue and the list of finished jobs.
+ */
+struct async_pool {
+  pthread_mutex_t lock;
+  pthread_cond_t work; // Signalled when a job is queued or on shutdown
+  struct job_list queued;
+  struct job_list done; // Finished jobs without a callback
+  int event_fd;
+  int stopping;
+  size_t thread_count;
+  struct worker workers[];
+};
+
+static void push(struct job_list *list, struct async_job *job) {
+  job->next = NULL;
+  if (list->tail) {
+    list->tail->next = job;
+  } else {
+    list->head = job;
+  }
+  list->tail = job;
+}
+
+static struct async_job *pop(struct job_list *list) {
+  struct async_job *job = list->head;
+  if (job) {
+    list->head = job->next;
+    if (!list->head) {
+      list->tail = NULL;
+    }
+  }
+  return job;
+}
+
+static void finish(struct async_pool *pool, struct async_job *job,
+                   enum async_status status) {
+  atomic_store(&job->status, status);
+
+  if (job->callback) {
+    job->callback(job, status, job->user);
+    free(job);
+    return;
+  }
+
+  uint64_t one = 1;
+  pthread_mutex_lock(&pool->lock);
+  push(&pool->done, job);
+  pthread_mutex_unlock(&pool->lock);
+  if (write(pool->event_fd, &one, sizeof(one)) != sizeof(one)) {
+    perror("eventfd");
+  }
+}
+
+static void *work(void *argument) {
+  struct worker *worker = (struct worker *)argument;
+  struct async_pool *pool = worker->pool;
+
+  for (;;) {
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->queued.head && !pool->stopping) {
+      pthread_cond_wait(&pool->work, &pool->lock);
+    }
+    struct async_job *job = worker->job = pop(&pool->queued);
+    pthread_mutex_unlock(&pool->lock);
+    if (!job) {
+      return NULL; // Stopping and the queue is drained
+    }
+
+    enum async_status status = ASYNC_CANCELLED;
+    if (!atomic_load(&job->cancel)) {
+      atomic_store(&job->status, ASYNC_RUNNING);
+      if (worker->ctx ? bf2d_ctx_set_options(worker->ctx, &job->options)
+                      : !(worker->ctx = bf2d_ctx_create(&job->options))) {
+        strcpy(job->error, "Memory allocation error.");
+        status = ASYNC_FAILED;
+      } else if (bf2d_ctx_convert(worker->ctx, job->in, job->out) == 0) {
+        status = ASYNC_DONE;
+      } else if (!atomic_load(&job->cancel)) {
+        strcpy(job->error, bf2d_ctx_error(worker->ctx));
+        status = ASYNC_FAILED;
+      }
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    worker->job = NULL; // Callback jobs are freed by finish()
+    pthread_mutex_unlock(&pool->lock);
+    finish(pool, job, status);
+  }
+}
+
+/**
+ * @brief Starts a pool of worker threads.
+ *
+ * @param threads Number of threads, at least 1.
+ * @return struct async_pool* The pool, or NULL if it could not be started.
+ */
+struct async_pool *async_pool_create(size_t threads) {
+  struct async_pool *pool = (struct async_pool *)calloc(
+      1, sizeof(*pool) + threads * sizeof(struct worker));
+
+  if (!pool || !threads) {
+    free(pool);
+    return NULL;
+  }
+  pool->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (pool->event_fd < 0) {
+    perror("eventfd");
+    free(pool);
+    return NULL;
+  }
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work, NULL);
+
+  for (; pool->thread_count < threads; pool->thread_count++) {
+    struct worker *worker = &pool->workers[pool->thread_count];
+    worker->pool = pool;
+    if (pthread_create(&worker->thread, NULL, work, worker)) {
+      fprintf(stderr, "Could not start worker thread\n");
+      async_pool_destroy(pool);
+      return NULL;
+    }
+  }
+  return pool;
+}
+
+/**
+ * @brief Cancels every unfinished job, waits for the threads and releases the
+ *        pool together with any jobs that were never reaped.
+ *
+ * @param pool Pool to destroy.
+ */
+void async_pool_destroy(struct async_pool *pool) {
+  struct async_job *job;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->stopping = 1;
+  for (job = pool->queued.head; job; job = job->next) {
+    atomic_store(&job->cancel, 1);
+  }
+  for (size_t i = 0; i < pool->thread_count; i++) {
+    if (pool->workers[i].job) {
+      atomic_store(&pool->workers[i].job->cancel, 1);
+    }
+  }
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (size_t i = 0; i < pool->thread_count; i++) {
+    pthread_join(pool->workers[i].thread, NULL);
+    bf2d_ctx_destroy(pool->workers[i].ctx);
+  }
+
+  while ((job = pop(&pool->done))) {
+    free(job);
+  }
+  close(pool->event_fd);
+  pthread_cond_destroy(&pool->work);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool);
+}
+
+/**
+ * @brief Returns the eventfd signalled when a job without a callback ends.
+ *
+ * @param pool Pool to watch.
+ * @return int Descriptor that becomes readable when jobs can be reaped.
+ */
+int async_pool_eventfd(const struct async_pool *pool) {
+  return pool->event_fd;
+}
+
+/**
+ * @brief Takes the next finished job without a callback off the pool.
+ *
+ * @param pool Pool to reap from.
+ * @return struct async_job* A finished job, to be released with
+ *         `async_job_free`, or NULL if none is waiting.
+ */
+struct async_job *async_pool_reap(struct async_pool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  struct async_job *job = pop(&pool->done);
+  pthread_mutex_unlock(&pool->lock);
+  return job;
+}
+
+/**
+ * @brief Queues a conversion of `in` into `out`.
+ *
+ * The options are copied, but the template text, `in` and `out` must stay
+ * valid until the job finishes. `options->cancel` is replaced by the job's
+ * own flag.
+ *
+ * @param pool Pool to run on.
+ * @param options Conversion options.
+ * @param in Source stream.
+ * @param out Destination stream.
+ * @param callback Called when the job ends, or NULL to reap it instead.
+ * @param user Passed to the callback and returned by `async_job_user`.
+ * @return struct async_job* Handle of the job, or NULL on allocation failure.
+ */
+struct async_job *async_submit(struct async_pool *pool,
+                               const struct stream_options *options, FILE *in,
+                               FILE *out, async_callback callback, void *user) {
+  struct async_job *job = (struct async_job *)calloc(1, sizeof(*job));
+
+  if (!job) {
+    return NULL;
+  }
+  job->options = *options;
+  job->options.cancel = &job->cancel;
+  job->in = in;
+  job->out = out;
+  job->callback = callback;
+  job->user = user;
+  atomic_init(&job->cancel, 0);
+  atomic_init(&job->status, ASYNC_QUEUED);
+
+  pthread_mutex_lock(&pool->lock);
+  push(&pool->queued, job);
+  pthread_cond_signal(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+  return job;
+}
+
+/**
+ * @brief Asks a job to stop; a no-op once it has finished.
+ *
+ * The handle must still be valid: before its callback returned, or before
+ * it was released after reaping.
+ *
+ * @param job Job to cancel.
+ */
+void async_job_cancel(struct async_job *job) {
+  atomic_store(&job->cancel, 1);
+}
+
+/**
+ * @brief Reads the state of a job.
+ *
+ * @param job Job to query.
+ * @return enum async_status Current state.
+ */
+enum async_status async_job_status(const struct async_job *job) {
+  return (enum async_status)atomic_load(&job->status);
+}
+
+/**
+ * @brief Returns why a job failed.
+ *
+ * @param job Job to query.
+ * @return const char* Message for an `ASYNC_FAILED` job, empty otherwise.
+ */
+const char *async_job_error(const struct async_job *job) {
+  return job->error;
+}
+
+/**
+ * @brief Returns the user pointer given to `async_submit`.
+ *
+ * @param job Job to query.
+ * @return void* The user pointer.
+ */
+void *async_job_user(const struct async_job *job) { return job->user; }
+
+/**
+ * @brief Releases a job taken from `async_pool_reap`.
+ *
+ * @param job Reaped job.
+ */
+void async_job_free(struct async_job *job) { free(job); }
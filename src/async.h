@@ -0,0 +1,146 @@
+/**
+ * @file async.h
+ * @brief Asynchronous batch conversions on a fixed pool of worker threads.
+ *
+ * Conversions are submitted as jobs to a pool whose threads are started once,
+ * so an event loop can hand off any number of conversions without creating a
+ * thread per request and without blocking. Every job is announced on
+ * completion in one of two ways:
+ *
+ * - with a callback, which runs on the pool thread that finished the job;
+ * - without one, by queueing the job on the pool and adding 1 to the pool's
+ *   eventfd. The event loop polls `async_pool_eventfd` for readability,
+ *   reads it, and collects finished jobs with `async_pool_reap`.
+ *
+ * A job can be cancelled at any time. A running conversion then stops before
+ * its next block, and a queued one never starts.
+ */
+
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "stream.h"
+
+/**
+ * @brief Life cycle of a job.
+ */
+enum async_status {
+  ASYNC_QUEUED,    /**< Waiting for a pool thread. */
+  ASYNC_RUNNING,   /**< Being converted. */
+  ASYNC_DONE,      /**< Converted successfully. */
+  ASYNC_FAILED,    /**< Malformed input or an I/O error. */
+  ASYNC_CANCELLED, /**< Stopped by `async_job_cancel`. */
+};
+
+struct async_pool;
+struct async_job;
+
+/**
+ * @brief Called on a pool thread when a job finishes.
+ *
+ * The job is released when the callback returns.
+ *
+ * @param job Finished job.
+ * @param status `ASYNC_DONE`, `ASYNC_FAILED` or `ASYNC_CANCELLED`.
+ * @param user Pointer given to `async_submit`.
+ */
+typedef void (*async_callback)(struct async_job *job, enum async_status status,
+                               void *user);
+
+/**
+ * @brief Starts a pool of worker threads.
+ *
+ * @param threads Number of threads, at least 1.
+ * @return struct async_pool* The pool, or NULL if it could not be started.
+ */
+struct async_pool *async_pool_create(size_t threads);
+
+/**
+ * @brief Cancels every unfinished job, waits for the threads and releases the
+ *        pool together with any jobs that were never reaped.
+ *
+ * @param pool Pool to destroy.
+ */
+void async_pool_destroy(struct async_pool *pool);
+
+/**
+ * @brief Returns the eventfd signalled when a job without a callback ends.
+ *
+ * @param pool Pool to watch.
+ * @return int Descriptor that becomes readable when jobs can be reaped.
+ */
+int async_pool_eventfd(const struct async_pool *pool);
+
+/**
+ * @brief Takes the next finished job without a callback off the pool.
+ *
+ * @param pool Pool to reap from.
+ * @return struct async_job* A finished job, to be released with
+ *         `async_job_free`, or NULL if none is waiting.
+ */
+struct async_job *async_pool_reap(struct async_pool *pool);
+
+/**
+ * @brief Queues a conversion of `in` into `out`.
+ *
+ * The options are copied, but the template text, `in` and `out` must stay
+ * valid until the job finishes. `options->cancel` is replaced by the job's
+ * own flag.
+ *
+ * @param pool Pool to run on.
+ * @param options Conversion options.
+ * @param in Source stream.
+ * @param out Destination stream.
+ * @param callback Called when the job ends, or NULL to reap it instead.
+ * @param user Passed to the callback and returned by `async_job_user`.
+ * @return struct async_job* Handle of the job, or NULL on allocation failure.
+ */
+struct async_job *async_submit(struct async_pool *pool,
+                               const struct stream_options *options, FILE *in,
+                               FILE *out, async_callback callback, void *user);
+
+/**
+ * @brief Asks a job to stop; a no-op once it has finished.
+ *
+ * The handle must still be valid: before its callback returned, or before
+ * it was released after reaping.
+ *
+ * @param job Job to cancel.
+ */
+void async_job_cancel(struct async_job *job);
+
+/**
+ * @brief Reads the state of a job.
+ *
+ * @param job Job to query.
+ * @return enum async_status Current state.
+ */
+enum async_status async_job_status(const struct async_job *job);
+
+/**
+ * @brief Returns why a job failed.
+ *
+ * @param job Job to query.
+ * @return const char* Message for an `ASYNC_FAILED` job, empty otherwise.
+ */
+const char *async_job_error(const struct async_job *job);
+
+/**
+ * @brief Returns the user pointer given to `async_submit`.
+ *
+ * @param job Job to query.
+ * @return void* The user pointer.
+ */
+void *async_job_user(const struct async_job *job);
+
+/**
+ * @brief Releases a job taken from `async_pool_reap`.
+ *
+ * @param job Reaped job.
+ */
+void async_job_free(struct async_job *job);
+
+#endif
@@ -0,0 +1,203 @@
+/**
+ * @file bit_text.c
+ * @brief Expansion of packed words into '0'/'1' text.
+ */
+
+#include "bit_text.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BIT_TEXT_X86 1
+#endif
+
+static const char digit_pairs[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static void set_char(struct bit_picture *picture, size_t pos, int bit,
+                     char base) {
+  uint8_t *row_shuffle = picture->shuffle[pos / 16];
+  uint8_t *row_mask = picture->mask[pos / 16];
+  uint8_t *row_base = picture->base[pos / 16];
+
+  if (bit < 0) {
+    row_mask[pos % 16] = 0; // Separators ignore the word
+  } else {
+    row_shuffle[pos % 16] = (uint8_t)(bit / 8);
+    row_mask[pos % 16] = (uint8_t)(1u << (bit % 8));
+  }
+  row_base[pos % 16] = (uint8_t)base;
+}
+
+/**
+ * @brief Builds the picture of a word, most significant bit first.
+ *
+ * @param picture Picture to initialize.
+ * @param layout Layout of the words to render.
+ * @param separator Character placed between the sign, exponent and fraction
+ *                  fields, or '\0' for an unbroken string of bits.
+ */
+void bit_picture_init(struct bit_picture *picture,
+                      const struct float_layout *layout, char separator) {
+  size_t pos = 0;
+
+  memset(picture, 0, sizeof(*picture));
+  for (int bit = layout->width - 1; bit >= 0; bit--) {
+    if (separator &&
+        (bit == layout->width - 2 || bit == layout->fraction_bits - 1)) {
+      set_char(picture, pos++, -1, separator);
+    }
+    set_char(picture, pos++, bit, '0');
+  }
+
+  picture->length = pos;
+  picture->rows = (pos + 15) / 16;
+  picture->renderer = separator ? BIT_RENDER_TABLE : BIT_RENDER_SWAR;
+
+#ifdef BIT_TEXT_X86
+  // pdep is microcoded and slow before AMD Zen 3
+  if (!separator && __builtin_cpu_supports("bmi2") &&
+      !__builtin_cpu_is("amdfam15h") && !__builtin_cpu_is("amdfam17h")) {
+    picture->renderer = BIT_RENDER_PDEP;
+  } else if (separator && __builtin_cpu_supports("ssse3")) {
+    picture->renderer = BIT_RENDER_SSSE3;
+  }
+#endif
+}
+
+/**
+ * @brief Switches a picture to the portable renderer of its kind.
+ *
+ * Used when calibration found the CPU-specific renderer slower here.
+ *
+ * @param picture Picture built by `bit_picture_init`.
+ */
+void bit_picture_portable(struct bit_picture *picture) {
+  if (picture->renderer == BIT_RENDER_PDEP) {
+    picture->renderer = BIT_RENDER_SWAR;
+  } else if (picture->renderer == BIT_RENDER_SSSE3) {
+    picture->renderer = BIT_RENDER_TABLE;
+  }
+}
+
+static uint64_t spread_byte(uint64_t byte) {
+  // Broadcast the byte, keep bit 7 - k in lane k and turn each lane into 0/1
+  uint64_t lanes = byte * UINT64_C(0x0101010101010101);
+  lanes &= UINT64_C(0x0102040810204080);
+  return ((lanes + UINT64_C(0x7f7f7f7f7f7f7f7f)) >> 7) &
+         UINT64_C(0x0101010101010101);
+}
+
+static void store_lanes(char *out, uint64_t lanes) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  lanes = __builtin_bswap64(lanes);
+#endif
+  lanes |= UINT64_C(0x3030303030303030); // '0' in every lane
+  memcpy(out, &lanes, 8);
+}
+
+static void render_swar(const struct bit_picture *picture, uint64_t word,
+                        char *out) {
+  for (int byte = (int)picture->length / 8 - 1; byte >= 0; byte--) {
+    store_lanes(out, spread_byte((word >> (8 * byte)) & 0xff));
+    out += 8;
+  }
+}
+
+#ifdef BIT_TEXT_X86
+__attribute__((target("ssse3"))) static void
+render_ssse3(const struct bit_picture *picture, uint64_t word, char *out) {
+  __m128i bytes = _mm_loadl_epi64((const __m128i *)&word);
+  __m128i ones = _mm_set1_epi8(1);
+
+  for (size_t row = 0; row < picture->rows; row++) {
+    __m128i shuffle = _mm_loadu_si128((const __m128i *)picture->shuffle[row]);
+    __m128i mask = _mm_loadu_si128((const __m128i *)picture->mask[row]);
+    __m128i base = _mm_loadu_si128((const __m128i *)picture->base[row]);
+
+    // Pick each character's byte, isolate its bit and turn it into 0 or 1
+    __m128i set =
+        _mm_min_epu8(_mm_and_si128(_mm_shuffle_epi8(bytes, shuffle), mask),
+                     ones);
+    _mm_storeu_si128((__m128i *)(out + 16 * row), _mm_add_epi8(base, set));
+  }
+}
+
+__attribute__((target("bmi2"))) static void
+render_pdep(const struct bit_picture *picture, uint64_t word, char *out) {
+  for (int byte = (int)picture->length / 8 - 1; byte >= 0; byte--) {
+    // Deposit bit k into lane k, then reverse the lanes for MSB-first text
+    uint64_t lanes = _pdep_u64((word >> (8 * byte)) & 0xff,
+                               UINT64_C(0x0101010101010101));
+    store_lanes(out, __builtin_bswap64(lanes));
+    out += 8;
+  }
+}
+#endif
+
+/**
+ * @brief Renders a word with a precomputed picture.
+ *
+ * @param picture Picture built by `bit_picture_init`.
+ * @param word Word to render.
+ * @param out Output buffer with room for `picture->length` characters plus
+ *            `BIT_PICTURE_SLACK`.
+ * @return char* Pointer just past the rendered characters.
+ */
+char *bit_picture_render(const struct bit_picture *picture, uint64_t word,
+                         char *out) {
+  switch (picture->renderer) {
+#ifdef BIT_TEXT_X86
+  case BIT_RENDER_PDEP:
+    render_pdep(picture, word, out);
+    return out + picture->length;
+  case BIT_RENDER_SSSE3:
+    render_ssse3(picture, word, out);
+    return out + picture->length;
+#endif
+  case BIT_RENDER_SWAR:
+    render_swar(picture, word, out);
+    return out + picture->length;
+  default:
+    break;
+  }
+
+  for (size_t pos = 0; pos < picture->length; pos++) {
+    size_t row = pos / 16, col = pos % 16;
+    uint8_t byte = (uint8_t)(word >> (8 * picture->shuffle[row][col]));
+    out[pos] = (char)(picture->base[row][col] +
+                      ((byte & picture->mask[row][col]) != 0));
+  }
+  return out + picture->length;
+}
+
+/**
+ * @brief Writes a number as a fixed count of decimal digits.
+ *
+ * Digits are produced two at a time from a lookup table, and the number is
+ * zero-padded (or truncated to its low digits) to exactly `digits` places.
+ *
+ * @param out Output buffer of at least `digits` bytes.
+ * @param value Number to write.
+ * @param digits Number of digits to write.
+ * @return char* Pointer just past the digits.
+ */
+char *write_fixed_digits(char *out, uint64_t value, int digits) {
+  char *end = out + digits;
+  char *pos = end;
+
+  while (pos - out >= 2) {
+    pos -= 2;
+    memcpy(pos, digit_pairs + 2 * (value % 100), 2);
+    value /= 100;
+  }
+  if (pos > out) {
+    *--pos = (char)('0' + value % 10);
+  }
+  return end;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file bit_text.h
+ * @brief Expansion of packed words into '0'/'1' text.
+ *
+ * A bit picture describes, for every output character, which bit of the word
+ * it shows or which separator it holds. The picture is precomputed as 16-byte
+ * shuffle, mask and base rows, so a word is rendered with one byte shuffle,
+ * one AND and one add per 16 characters on CPUs with SSSE3, and with the same
+ * tables one byte at a time elsewhere.
+ *
+ * Pictures without separators take a shorter route that expands eight bits
+ * per step: one `pdep` on CPUs with fast BMI2, or a portable broadcast of the
+ * byte into all eight lanes followed by a per-lane bit test.
+ */
+
+#ifndef BIT_TEXT_H
+#define BIT_TEXT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "float_word.h"
+
+/** @brief Maximum number of 16-character rows in a picture. */
+#define BIT_PICTURE_MAX_ROWS 5
+
+/**
+ * @brief Extra bytes a render may write past the end of the picture.
+ *
+ * Renders store whole rows, so callers must leave this much room after the
+ * last picture in a buffer. Later output simply overwrites the excess.
+ */
+#define BIT_PICTURE_SLACK 16
+
+/** @brief Widest picture: a binary64 word with both separators. */
+#define BIT_PICTURE_MAX_LENGTH 66
+
+/**
+ * @brief Strategies for rendering a picture.
+ */
+enum bit_renderer {
+  BIT_RENDER_TABLE, /**< One character at a time from the tables. */
+  BIT_RENDER_SWAR,  /**< Eight bits per step in a 64-bit register. */
+  BIT_RENDER_SSSE3, /**< Sixteen characters per byte shuffle. */
+  BIT_RENDER_PDEP,  /**< Eight bits per BMI2 parallel deposit. */
+};
+
+/**
+ * @brief Precomputed rendering tables for one word layout.
+ */
+struct bit_picture {
+  size_t length;                             /**< Characters rendered. */
+  size_t rows;                               /**< 16-character rows. */
+  enum bit_renderer renderer;                /**< Fastest renderer here. */
+  uint8_t shuffle[BIT_PICTURE_MAX_ROWS][16]; /**< Word byte per char. */
+  uint8_t mask[BIT_PICTURE_MAX_ROWS][16];    /**< Bit within that byte. */
+  uint8_t base[BIT_PICTURE_MAX_ROWS][16];    /**< '0' or the separator. */
+};
+
+/**
+ * @brief Builds the picture of a word, most significant bit first.
+ *
+ * @param picture Picture to initialize.
+ * @param layout Layout of the words to render.
+ * @param separator Character placed between the sign, exponent and fraction
+ *                  fields, or '\0' for an unbroken string of bits.
+ */
+void bit_picture_init(struct bit_picture *picture,
+                      const struct float_layout *layout, char separator);
+
+/**
+ * @brief Switches a picture to the portable renderer of its kind.
+ *
+ * Used when calibration found the CPU-specific renderer slower here.
+ *
+ * @param picture Picture built by `bit_picture_init`.
+ */
+void bit_picture_portable(struct bit_picture *picture);
+
+/**
+ * @brief Renders a word with a precomputed picture.
+ *
+ * @param picture Picture built by `bit_picture_init`.
+ * @param word Word to render.
+ * @param out Output buffer with room for `picture->length` characters plus
+ *            `BIT_PICTURE_SLACK`.
+ * @return char* Pointer just past the rendered characters.
+ */
+char *bit_picture_render(const struct bit_picture *picture, uint64_t word,
+                         char *out);
+
+/**
+ * @brief Writes a number as a fixed count of decimal digits.
+ *
+ * Digits are produced two at a time from a lookup table, and the number is
+ * zero-padded (or truncated to its low digits) to exactly `digits` places.
+ *
+ * @param out Output buffer of at least `digits` bytes.
+ * @param value Number to write.
+ * @param digits Number of digits to write.
+ * @return char* Pointer just past the digits.
+ */
+char *write_fixed_digits(char *out, uint64_t value, int digits);
+
+#endif
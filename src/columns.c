@@ -0,0 +1,248 @@
+/**
+ * @file columns.c
+ * @brief Decoded IEEE 754 fields of many words, one array per field.
+ */
+
+#define _POSIX_C_SOURCE 200809L // posix_memalign()
+
+#include "columns.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define COLUMNS_STREAM 1
+#endif
+
+#define MIN_ROWS 4096    // Smallest allocation, one batch block
+#define CHUNK_WORDS 1024 // Words decoded per pass, so they stay in L1
+#define ROW_BYTES (2 * sizeof(uint8_t) + sizeof(int16_t) + sizeof(uint64_t))
+
+// The class is computed arithmetically from this order
+_Static_assert(FLOAT_ZERO == 0 && FLOAT_SUBNORMAL == 1 && FLOAT_NORMAL == 2 &&
+                   FLOAT_INFINITE == 3 && FLOAT_NAN == 4,
+               "float_class order");
+
+/**
+ * @brief Allocates an aligned column of `rows` elements and copies `used`
+ *        rows of `old` into it.
+ *
+ * @return void* The column, or NULL if memory ran out.
+ */
+static void *grow_column(void *old, size_t element, size_t used, size_t rows) {
+  void *column;
+
+  if (posix_memalign(&column, FLOAT_COLUMNS_ALIGNMENT, rows * element)) {
+    return NULL;
+  }
+  if (used) {
+    memcpy(column, old, used * element);
+  }
+  return column;
+}
+
+/**
+ * @brief Grows the columns to hold at least `capacity` rows.
+ *
+ * @param columns Columns to grow; filled rows are kept.
+ * @param capacity Rows needed.
+ * @return int 0 on success, -1 if memory ran out.
+ */
+int float_columns_reserve(struct float_columns *columns, size_t capacity) {
+  struct float_columns grown = *columns;
+  size_t rows = columns->capacity ? 2 * columns->capacity : MIN_ROWS;
+  size_t used = columns->count;
+
+  if (capacity <= columns->capacity) {
+    return 0;
+  }
+  if (rows < capacity) {
+    rows = capacity;
+  }
+
+  grown.sign = grow_column(columns->sign, sizeof(uint8_t), used, rows);
+  grown.exponent = grow_column(columns->exponent, sizeof(int16_t), used, rows);
+  grown.mantissa = grow_column(columns->mantissa, sizeof(uint64_t), used, rows);
+  grown.float_class =
+      grow_column(columns->float_class, sizeof(uint8_t), used, rows);
+  if (!grown.sign || !grown.exponent || !grown.mantissa ||
+      !grown.float_class) {
+    free(grown.sign);
+    free(grown.exponent);
+    free(grown.mantissa);
+    free(grown.float_class);
+    return -1;
+  }
+
+  float_columns_free(columns);
+  *columns = grown;
+  columns->count = used;
+  columns->capacity = rows;
+  return 0;
+}
+
+/**
+ * @brief Decodes one chunk, one column at a time.
+ *
+ * Every loop is a straight sequence of shifts, masks and compares, which the
+ * compiler turns into vector code.
+ */
+static void decode_chunk(uint8_t *restrict sign, int16_t *restrict exponent,
+                         uint64_t *restrict mantissa,
+                         uint8_t *restrict float_class, const uint64_t *words,
+                         size_t count, const struct float_layout *layout) {
+  const int sign_shift = layout->width - 1;
+  const int fraction_bits = layout->fraction_bits;
+  const uint64_t exponent_max = (UINT64_C(1) << layout->exponent_bits) - 1;
+  const uint64_t fraction_mask = (UINT64_C(1) << fraction_bits) - 1;
+  const int bias = layout->bias;
+
+  for (size_t i = 0; i < count; i++) {
+    sign[i] = (uint8_t)((words[i] >> sign_shift) & 1);
+  }
+  for (size_t i = 0; i < count; i++) {
+    // Zeros and subnormals share the exponent of the smallest normal
+    int biased = (int)((words[i] >> fraction_bits) & exponent_max);
+    exponent[i] = (int16_t)(biased - bias + (biased == 0));
+  }
+  for (size_t i = 0; i < count; i++) {
+    uint64_t biased = (words[i] >> fraction_bits) & exponent_max;
+    uint64_t implicit = (uint64_t)(biased != 0 && biased != exponent_max);
+    mantissa[i] = (words[i] & fraction_mask) | implicit << fraction_bits;
+  }
+  for (size_t i = 0; i < count; i++) {
+    uint64_t biased = (words[i] >> fraction_bits) & exponent_max;
+    int fraction = (words[i] & fraction_mask) != 0;
+    // Normal, then up to NaN for a full exponent or down to zero for none
+    float_class[i] = (uint8_t)(FLOAT_NORMAL +
+                               (biased == exponent_max) * (1 + fraction) -
+                               (biased == 0) * (2 - fraction));
+  }
+}
+
+#ifdef COLUMNS_STREAM
+/**
+ * @brief Copies `bytes` from cache to `out` with non-temporal stores.
+ *
+ * The unaligned head and tail of `out` go through the cache, which costs at
+ * most two partial lines per column and chunk.
+ */
+static void stream_copy(void *out, const void *in, size_t bytes) {
+  unsigned char *to = (unsigned char *)out;
+  const unsigned char *from = (const unsigned char *)in;
+  size_t head = (size_t)(-(uintptr_t)to & 15);
+
+  if (head > bytes) {
+    head = bytes;
+  }
+  memcpy(to, from, head);
+  to += head;
+  from += head;
+  bytes -= head;
+  for (; bytes >= 16; bytes -= 16, to += 16, from += 16) {
+    _mm_stream_si128((__m128i *)to, _mm_loadu_si128((const __m128i *)from));
+  }
+  memcpy(to, from, bytes);
+}
+
+/**
+ * @brief Decodes into a staging area that stays in L1, then streams each
+ *        column of the chunk out to memory.
+ */
+static void stream_chunk(struct float_columns *columns, size_t first,
+                         const uint64_t *words, size_t count,
+                         const struct float_layout *layout) {
+  _Alignas(FLOAT_COLUMNS_ALIGNMENT) uint8_t sign[CHUNK_WORDS];
+  _Alignas(FLOAT_COLUMNS_ALIGNMENT) int16_t exponent[CHUNK_WORDS];
+  _Alignas(FLOAT_COLUMNS_ALIGNMENT) uint64_t mantissa[CHUNK_WORDS];
+  _Alignas(FLOAT_COLUMNS_ALIGNMENT) uint8_t float_class[CHUNK_WORDS];
+
+  decode_chunk(sign, exponent, mantissa, float_class, words, count, layout);
+  stream_copy(columns->sign + first, sign, count * sizeof(*sign));
+  stream_copy(columns->exponent + first, exponent, count * sizeof(*exponent));
+  stream_copy(columns->mantissa + first, mantissa, count * sizeof(*mantissa));
+  stream_copy(columns->float_class + first, float_class,
+              count * sizeof(*float_class));
+}
+
+/**
+ * @brief Tells whether rows are stored with non-temporal stores.
+ */
+static int streamed(const struct float_columns *columns) {
+  return columns->stores == FLOAT_COLUMNS_STREAMED ||
+         (columns->stores == FLOAT_COLUMNS_AUTO &&
+          columns->capacity * ROW_BYTES >= FLOAT_COLUMNS_STREAM_BYTES);
+}
+#endif
+
+/**
+ * @brief Decodes packed words into rows `first .. first + count - 1`.
+ *
+ * Allocates nothing and leaves `columns->count` alone. Streamed rows are
+ * fenced before returning, so they are visible to other threads like any
+ * other store.
+ *
+ * @param columns Columns with at least `first + count` rows allocated.
+ * @param first First row to write.
+ * @param words Packed words, as produced by `pack_binary_float`.
+ * @param count Number of words.
+ * @param layout Layout of the words.
+ */
+void float_columns_decode(struct float_columns *columns, size_t first,
+                          const uint64_t *words, size_t count,
+                          const struct float_layout *layout) {
+#ifdef COLUMNS_STREAM
+  if (streamed(columns)) {
+    for (size_t done = 0; done < count; done += CHUNK_WORDS) {
+      size_t chunk = count - done < CHUNK_WORDS ? count - done : CHUNK_WORDS;
+      stream_chunk(columns, first + done, words + done, chunk, layout);
+    }
+    _mm_sfence(); // Order the streamed rows before any later store
+    return;
+  }
+#endif
+  for (size_t done = 0; done < count; done += CHUNK_WORDS) {
+    size_t chunk = count - done < CHUNK_WORDS ? count - done : CHUNK_WORDS;
+    size_t row = first + done;
+    decode_chunk(columns->sign + row, columns->exponent + row,
+                 columns->mantissa + row, columns->float_class + row,
+                 words + done, chunk, layout);
+  }
+}
+
+/**
+ * @brief Decodes packed words into new rows after the filled ones.
+ *
+ * @param columns Columns to extend, grown as needed.
+ * @param words Packed words, as produced by `pack_binary_float`.
+ * @param count Number of words.
+ * @param layout Layout of the words.
+ * @return int 0 on success, -1 if memory ran out.
+ */
+int float_columns_append(struct float_columns *columns, const uint64_t *words,
+                         size_t count, const struct float_layout *layout) {
+  if (float_columns_reserve(columns, columns->count + count)) {
+    return -1;
+  }
+  float_columns_decode(columns, columns->count, words, count, layout);
+  columns->count += count;
+  return 0;
+}
+
+/**
+ * @brief Releases the columns and empties them for reuse; `stores` is kept.
+ *
+ * @param columns Columns to release.
+ */
+void float_columns_free(struct float_columns *columns) {
+  enum float_columns_stores stores = columns->stores;
+
+  free(columns->sign);
+  free(columns->exponent);
+  free(columns->mantissa);
+  free(columns->float_class);
+  memset(columns, 0, sizeof(*columns));
+  columns->stores = stores;
+}
@@ -0,0 +1,104 @@
+/**
+ * @file columns.h
+ * @brief Decoded IEEE 754 fields of many words, one array per field.
+ *
+ * Analytics code that filters or aggregates on one field at a time, such as
+ * every exponent or every class, reads a structure of arrays far faster than
+ * it reads packed words or per-value structs: each field is contiguous, so a
+ * scan touches only the bytes it needs and vectorizes. The arrays start on
+ * cache-line boundaries and are filled straight from packed words, one field
+ * at a time, with loops free of data-dependent branches.
+ *
+ * Columns larger than the last-level cache are written with non-temporal
+ * stores on x86: the rows go straight to memory instead of evicting the
+ * tables and buffers the rest of the pipeline keeps in cache, and the
+ * processor skips reading every destination line before it overwrites it.
+ */
+
+#ifndef COLUMNS_H
+#define COLUMNS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "float_word.h"
+
+/** @brief Alignment of every column in bytes, one cache line. */
+#define FLOAT_COLUMNS_ALIGNMENT 64
+
+/** @brief Columns at least this large are streamed by `FLOAT_COLUMNS_AUTO`. */
+#define FLOAT_COLUMNS_STREAM_BYTES (32u << 20)
+
+/**
+ * @brief How rows are stored into the columns.
+ */
+enum float_columns_stores {
+  FLOAT_COLUMNS_AUTO,     /**< Streamed once the allocated columns reach
+                               `FLOAT_COLUMNS_STREAM_BYTES`. */
+  FLOAT_COLUMNS_CACHED,   /**< Always through the cache. */
+  FLOAT_COLUMNS_STREAMED, /**< Always non-temporal where supported. */
+};
+
+/**
+ * @brief Sign, exponent, significand and class of `count` values.
+ *
+ * Zero-initialize before first use. Row `i` of every column describes the
+ * same value, and finite values equal
+ * `(-1)^sign * mantissa * 2^(exponent - fraction_bits)`.
+ */
+struct float_columns {
+  uint8_t *sign;        /**< 1 for negative values. */
+  int16_t *exponent;    /**< Unbiased exponent, see `float_word_exponent`. */
+  uint64_t *mantissa;   /**< Significand, see `float_word_significand`. */
+  uint8_t *float_class; /**< An `enum float_class`. */
+  size_t count;         /**< Rows filled. */
+  size_t capacity;      /**< Rows allocated. */
+  enum float_columns_stores stores; /**< How rows are stored. */
+};
+
+/**
+ * @brief Grows the columns to hold at least `capacity` rows.
+ *
+ * @param columns Columns to grow; filled rows are kept.
+ * @param capacity Rows needed.
+ * @return int 0 on success, -1 if memory ran out.
+ */
+int float_columns_reserve(struct float_columns *columns, size_t capacity);
+
+/**
+ * @brief Decodes packed words into rows `first .. first + count - 1`.
+ *
+ * Allocates nothing and leaves `columns->count` alone. Streamed rows are
+ * fenced before returning, so they are visible to other threads like any
+ * other store.
+ *
+ * @param columns Columns with at least `first + count` rows allocated.
+ * @param first First row to write.
+ * @param words Packed words, as produced by `pack_binary_float`.
+ * @param count Number of words.
+ * @param layout Layout of the words.
+ */
+void float_columns_decode(struct float_columns *columns, size_t first,
+                          const uint64_t *words, size_t count,
+                          const struct float_layout *layout);
+
+/**
+ * @brief Decodes packed words into new rows after the filled ones.
+ *
+ * @param columns Columns to extend, grown as needed.
+ * @param words Packed words, as produced by `pack_binary_float`.
+ * @param count Number of words.
+ * @param layout Layout of the words.
+ * @return int 0 on success, -1 if memory ran out.
+ */
+int float_columns_append(struct float_columns *columns, const uint64_t *words,
+                         size_t count, const struct float_layout *layout);
+
+/**
+ * @brief Releases the columns and empties them for reuse; `stores` is kept.
+ *
+ * @param columns Columns to release.
+ */
+void float_columns_free(struct float_columns *columns);
+
+#endif
@@ -0,0 +1,168 @@
+/**
+ * @file corpus.c
+ * @brief Reproducible synthetic float corpora for benchmarks.
+ */
+
+#include "corpus.h"
+
+#include <math.h>
+#include <string.h>
+
+static const char *const distribution_names[] = {"uniform", "normal",
+                                                 "subnormal", "nan", "repeat"};
+
+static uint64_t splitmix64(uint64_t *x) {
+  uint64_t z = (*x += UINT64_C(0x9e3779b97f4a7c15));
+  z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+  z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+  return z ^ (z >> 31);
+}
+
+static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+static uint64_t next_random(struct corpus *corpus) {
+  uint64_t *s = corpus->state;
+  uint64_t result = rotl(s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl(s[3], 45);
+  return result;
+}
+
+static double next_unit(struct corpus *corpus) {
+  return (double)(next_random(corpus) >> 11) * 0x1.0p-53; // [0, 1)
+}
+
+static double next_normal(struct corpus *corpus) {
+  double u, v, r;
+
+  if (corpus->has_spare) {
+    corpus->has_spare = 0;
+    return corpus->spare;
+  }
+
+  // Marsaglia's polar method yields two independent values per accepted pair
+  do {
+    u = 2 * next_unit(corpus) - 1;
+    v = 2 * next_unit(corpus) - 1;
+    r = u * u + v * v;
+  } while (r >= 1 || r == 0);
+
+  r = sqrt(-2 * log(r) / r);
+  corpus->spare = v * r;
+  corpus->has_spare = 1;
+  return u * r;
+}
+
+static uint64_t word_of(double value, const struct float_layout *layout) {
+  if (layout->width == 32) {
+    float narrow = (float)value;
+    uint32_t word;
+    memcpy(&word, &narrow, sizeof(word));
+    return word;
+  }
+
+  uint64_t word;
+  memcpy(&word, &value, sizeof(word));
+  return word;
+}
+
+static uint64_t next_word(struct corpus *corpus) {
+  const struct float_layout *layout = corpus->layout;
+  uint64_t width_mask = UINT64_MAX >> (64 - layout->width);
+  uint64_t fraction_mask = (UINT64_C(1) << layout->fraction_bits) - 1;
+  uint64_t bits = next_random(corpus);
+
+  switch (corpus->distribution) {
+  case CORPUS_NORMAL:
+    return word_of(next_normal(corpus), layout);
+  case CORPUS_SUBNORMAL:
+    if ((bits & 7) == 0) {
+      return next_random(corpus) & width_mask; // One in eight stays uniform
+    }
+    // Random sign and fraction under a zero exponent
+    return (bits >> 63) << (layout->width - 1) | ((bits >> 3) & fraction_mask);
+  case CORPUS_NAN:
+    if (bits & 1) {
+      return word_of(NAN, layout);
+    }
+    return word_of(next_normal(corpus), layout);
+  case CORPUS_REPEAT:
+    if ((bits & 7) == 0) {
+      corpus->last = corpus->palette[(bits >> 3) & 15];
+    }
+    return corpus->last;
+  default:
+    return bits & width_mask;
+  }
+}
+
+/**
+ * @brief Looks up a distribution by name.
+ *
+ * @param name "uniform", "normal", "subnormal", "nan" or "repeat".
+ * @param distribution Receives the distribution.
+ * @return int 0 on success, -1 if the name is unknown.
+ */
+int corpus_distribution_from_name(const char *name,
+                                  enum corpus_distribution *distribution) {
+  size_t count = sizeof(distribution_names) / sizeof(*distribution_names);
+
+  for (size_t i = 0; i < count; i++) {
+    if (strcmp(name, distribution_names[i]) == 0) {
+      *distribution = (enum corpus_distribution)i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief Starts generating a corpus.
+ *
+ * @param corpus Generator to initialize.
+ * @param options Distribution, seed and size of the corpus.
+ * @param layout Layout of the generated words.
+ */
+void corpus_init(struct corpus *corpus, const struct corpus_options *options,
+                 const struct float_layout *layout) {
+  uint64_t seed = options->seed;
+
+  memset(corpus, 0, sizeof(*corpus));
+  corpus->layout = layout;
+  corpus->distribution = options->distribution;
+  corpus->remaining = options->count;
+  for (int i = 0; i < 4; i++) {
+    corpus->state[i] = splitmix64(&seed);
+  }
+
+  // A handful of plausible readings, e.g. a sensor at a few set points
+  for (int i = 0; i < 16; i++) {
+    double reading = round(next_normal(corpus) * 1000) / 100;
+    corpus->palette[i] = word_of(reading, layout);
+  }
+  corpus->last = corpus->palette[0];
+}
+
+/**
+ * @brief Generates the next words of the corpus.
+ *
+ * @param corpus Initialized generator.
+ * @param words Receives up to `max` words.
+ * @param max Capacity of `words`.
+ * @return size_t Number of words generated, 0 once the corpus is complete.
+ */
+size_t corpus_fill(struct corpus *corpus, uint64_t *words, size_t max) {
+  size_t count = corpus->remaining < max ? (size_t)corpus->remaining : max;
+
+  for (size_t i = 0; i < count; i++) {
+    words[i] = next_word(corpus);
+  }
+  corpus->remaining -= count;
+  return count;
+}
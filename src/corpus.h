@@ -0,0 +1,82 @@
+/**
+ * @file corpus.h
+ * @brief Reproducible synthetic float corpora for benchmarks.
+ *
+ * Words are drawn from a seeded xoshiro256** generator, so the same seed,
+ * distribution and count always produce the same corpus and benchmarks never
+ * need large fixture files.
+ */
+
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "float_word.h"
+
+/**
+ * @brief Shapes of generated data.
+ */
+enum corpus_distribution {
+  CORPUS_UNIFORM,   /**< Uniformly random bit patterns. */
+  CORPUS_NORMAL,    /**< Standard normal values. */
+  CORPUS_SUBNORMAL, /**< Mostly subnormals, some uniform patterns. */
+  CORPUS_NAN,       /**< Normal values with half of them replaced by NaN. */
+  CORPUS_REPEAT,    /**< Long runs over a small palette of values. */
+};
+
+/**
+ * @brief Parameters of a generated corpus.
+ */
+struct corpus_options {
+  enum corpus_distribution distribution; /**< Shape of the data. */
+  uint64_t seed;                         /**< PRNG seed. */
+  uint64_t count;                        /**< Number of words to generate. */
+};
+
+/**
+ * @brief State of a corpus being generated.
+ */
+struct corpus {
+  const struct float_layout *layout;     /**< Layout of the words. */
+  enum corpus_distribution distribution; /**< Shape of the data. */
+  uint64_t state[4];                     /**< xoshiro256** state. */
+  uint64_t remaining;                    /**< Words left to generate. */
+  uint64_t last;                         /**< Previous word, for runs. */
+  uint64_t palette[16];                  /**< Values used by repeats. */
+  double spare;                          /**< Second normal of a pair. */
+  int has_spare;                         /**< Whether `spare` is valid. */
+};
+
+/**
+ * @brief Looks up a distribution by name.
+ *
+ * @param name "uniform", "normal", "subnormal", "nan" or "repeat".
+ * @param distribution Receives the distribution.
+ * @return int 0 on success, -1 if the name is unknown.
+ */
+int corpus_distribution_from_name(const char *name,
+                                  enum corpus_distribution *distribution);
+
+/**
+ * @brief Starts generating a corpus.
+ *
+ * @param corpus Generator to initialize.
+ * @param options Distribution, seed and size of the corpus.
+ * @param layout Layout of the generated words.
+ */
+void corpus_init(struct corpus *corpus, const struct corpus_options *options,
+                 const struct float_layout *layout);
+
+/**
+ * @brief Generates the next words of the corpus.
+ *
+ * @param corpus Initialized generator.
+ * @param words Receives up to `max` words.
+ * @param max Capacity of `words`.
+ * @return size_t Number of words generated, 0 once the corpus is complete.
+ */
+size_t corpus_fill(struct corpus *corpus, uint64_t *words, size_t max);
+
+#endif
@@ -0,0 +1,58 @@
+/**
+ * @file explain.c
+ * @brief Fixed-width field breakdown of every record for audit logs.
+ */
+
+#include "explain.h"
+
+#define EXPONENT_DIGITS 4 // Unbiased exponents stay within +-1024
+
+/**
+ * @brief Prepares the explain layout for a word width.
+ *
+ * @param format Format to initialize.
+ * @param layout Layout of the words to explain.
+ */
+void explain_init(struct explain_format *format,
+                  const struct float_layout *layout) {
+  format->layout = layout;
+  bit_picture_init(&format->picture, layout, ' ');
+
+  // 2^24 - 1 and 2^53 - 1 have 8 and 16 digits
+  format->significand_digits = layout->width == 32 ? 8 : 16;
+  format->record_bytes = format->picture.length + 1 + 1 + EXPONENT_DIGITS +
+                         1 + (size_t)format->significand_digits + 1;
+}
+
+/**
+ * @brief Writes the breakdown of a block of words.
+ *
+ * @param format Format built by `explain_init`.
+ * @param words Words to explain.
+ * @param count Number of words.
+ * @param out Output buffer of at least `count * format->record_bytes` bytes
+ *            plus `BIT_PICTURE_SLACK`.
+ * @return size_t Number of bytes written.
+ */
+size_t explain_emit(const struct explain_format *format, const uint64_t *words,
+                    size_t count, char *out) {
+  const struct float_layout *layout = format->layout;
+  char *start = out;
+
+  for (size_t i = 0; i < count; i++) {
+    uint64_t word = words[i];
+    int exponent = float_word_exponent(word, layout);
+
+    out = bit_picture_render(&format->picture, word, out);
+    *out++ = ' ';
+    *out++ = exponent < 0 ? '-' : '+';
+    out = write_fixed_digits(
+        out, (uint64_t)(exponent < 0 ? -exponent : exponent), EXPONENT_DIGITS);
+    *out++ = ' ';
+    out = write_fixed_digits(out, float_word_significand(word, layout),
+                             format->significand_digits);
+    *out++ = '\n';
+  }
+
+  return (size_t)(out - start);
+}
@@ -0,0 +1,59 @@
+/**
+ * @file explain.h
+ * @brief Fixed-width field breakdown of every record for audit logs.
+ *
+ * Each record becomes one line with the same columns `split_binary_float` and
+ * `convert_ieee_float` print interactively:
+ *
+ *     S EEEEEEEE FFFFFFFFFFFFFFFFFFFFFFF +EEEE SSSSSSSS
+ *
+ * that is the sign bit, the exponent bits, the fraction bits, the unbiased
+ * exponent and the integer significand, zero-padded to 8 digits for binary32
+ * and 16 digits for binary64. Finite values equal
+ * `significand * 2^(exponent - fraction_bits)`. Because every column has a
+ * fixed width, the bit fields are rendered with precomputed byte shuffles and
+ * the numbers with table-driven digits instead of `printf`.
+ */
+
+#ifndef EXPLAIN_H
+#define EXPLAIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bit_text.h"
+#include "float_word.h"
+
+/**
+ * @brief Precomputed explain layout for one word width.
+ */
+struct explain_format {
+  const struct float_layout *layout; /**< Layout of the words. */
+  struct bit_picture picture;        /**< Sign, exponent and fraction bits. */
+  int significand_digits;            /**< Width of the significand column. */
+  size_t record_bytes;               /**< Length of one line. */
+};
+
+/**
+ * @brief Prepares the explain layout for a word width.
+ *
+ * @param format Format to initialize.
+ * @param layout Layout of the words to explain.
+ */
+void explain_init(struct explain_format *format,
+                  const struct float_layout *layout);
+
+/**
+ * @brief Writes the breakdown of a block of words.
+ *
+ * @param format Format built by `explain_init`.
+ * @param words Words to explain.
+ * @param count Number of words.
+ * @param out Output buffer of at least `count * format->record_bytes` bytes
+ *            plus `BIT_PICTURE_SLACK`.
+ * @return size_t Number of bytes written.
+ */
+size_t explain_emit(const struct explain_format *format, const uint64_t *words,
+                    size_t count, char *out);
+
+#endif
@@ -0,0 +1,116 @@
+/**
+ * @file file_input.c
+ * @brief Reads of input files that keep cold data out of the page cache.
+ */
+
+#define _GNU_SOURCE // O_DIRECT
+
+#include "file_input.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Switches to sequential reads that drop the pages behind them.
+ */
+static void read_sequentially(struct file_input *input) {
+  input->mode = STREAM_READ_SEQUENTIAL;
+  posix_fadvise(input->fd, (off_t)input->offset, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+/**
+ * @brief Releases the cached pages from the last release up to `end`.
+ */
+static void drop_behind(struct file_input *input, uint64_t end) {
+  if (end > input->dropped) {
+    posix_fadvise(input->fd, (off_t)input->dropped,
+                  (off_t)(end - input->dropped), POSIX_FADV_DONTNEED);
+    input->dropped = end;
+  }
+}
+
+/**
+ * @brief Prepares a descriptor for reads in the given mode.
+ *
+ * Descriptors that are not regular files, and modes the file system does not
+ * support, fall back to a mode that works; `input->mode` tells which one is
+ * in effect.
+ *
+ * @param input Receives the state of the reads.
+ * @param fd Descriptor to read from.
+ * @param mode Requested mode.
+ */
+void file_input_open(struct file_input *input, int fd, enum stream_read mode) {
+  struct stat info;
+  off_t offset;
+
+  input->fd = fd;
+  input->mode = STREAM_READ_BUFFERED;
+  input->saved_flags = -1;
+  // O_DIRECT means packet mode on a pipe, so only files get a strategy
+  if (mode == STREAM_READ_BUFFERED || fstat(fd, &info) ||
+      !S_ISREG(info.st_mode) || (offset = lseek(fd, 0, SEEK_CUR)) < 0) {
+    return;
+  }
+  input->offset = input->dropped = (uint64_t)offset;
+
+  if (mode == STREAM_READ_DIRECT) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags >= 0 && fcntl(fd, F_SETFL, flags | O_DIRECT) == 0) {
+      input->mode = STREAM_READ_DIRECT;
+      input->saved_flags = flags;
+      return;
+    }
+  }
+  read_sequentially(input);
+}
+
+/**
+ * @brief Reads from the descriptor like `read`.
+ *
+ * In `STREAM_READ_DIRECT` mode `buffer` and `bytes` must be multiples of
+ * `FILE_INPUT_ALIGNMENT`. A file that turns out not to allow direct reads,
+ * for example at an unaligned offset, is switched to
+ * `STREAM_READ_SEQUENTIAL` and read again.
+ *
+ * @param input Descriptor being read.
+ * @param buffer Receives the bytes.
+ * @param bytes Most bytes to read.
+ * @return ssize_t Bytes read, 0 at end of file, -1 with `errno` set on error.
+ */
+ssize_t file_input_read(struct file_input *input, void *buffer, size_t bytes) {
+  ssize_t got = read(input->fd, buffer, bytes);
+
+  if (got < 0 && errno == EINVAL && input->mode == STREAM_READ_DIRECT) {
+    fcntl(input->fd, F_SETFL, input->saved_flags);
+    input->saved_flags = -1;
+    read_sequentially(input);
+    got = read(input->fd, buffer, bytes);
+  }
+  if (got > 0 && input->mode != STREAM_READ_BUFFERED) {
+    input->offset += (uint64_t)got;
+    if (input->mode == STREAM_READ_SEQUENTIAL &&
+        input->offset - input->dropped >= FILE_INPUT_DROP_BYTES) {
+      // The page the reader is in is released next time
+      drop_behind(input, input->offset & ~(uint64_t)(FILE_INPUT_ALIGNMENT - 1));
+    }
+  }
+  return got;
+}
+
+/**
+ * @brief Restores the descriptor's flags and releases the last pages read.
+ *
+ * @param input Descriptor being read.
+ */
+void file_input_close(struct file_input *input) {
+  if (input->saved_flags >= 0) {
+    fcntl(input->fd, F_SETFL, input->saved_flags);
+    input->saved_flags = -1;
+  } else if (input->mode == STREAM_READ_SEQUENTIAL) {
+    drop_behind(input, input->offset + FILE_INPUT_ALIGNMENT - 1);
+  }
+  input->mode = STREAM_READ_BUFFERED;
+}
@@ -0,0 +1,76 @@
+/**
+ * @file file_input.h
+ * @brief Reads of input files that keep cold data out of the page cache.
+ *
+ * Dumps are usually read once, straight from disk, and a plain read leaves
+ * every page of them cached, evicting data other processes still need. In
+ * `STREAM_READ_SEQUENTIAL` mode the kernel is told the file is read in order,
+ * which widens its readahead, and the pages behind the reader are released
+ * every `FILE_INPUT_DROP_BYTES`. In `STREAM_READ_DIRECT` mode the file is
+ * switched to `O_DIRECT`, so reads go from the device straight into the
+ * caller's buffer; they must then start at `FILE_INPUT_ALIGNMENT` in memory
+ * and in the file and span whole multiples of it.
+ */
+
+#ifndef FILE_INPUT_H
+#define FILE_INPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "stream.h"
+
+/** @brief Alignment of direct reads in memory, file offset and size. */
+#define FILE_INPUT_ALIGNMENT 4096
+
+/** @brief Bytes read between two releases of the pages behind the reader. */
+#define FILE_INPUT_DROP_BYTES (1u << 20)
+
+/**
+ * @brief A descriptor being read in one of the `stream_read` modes.
+ */
+struct file_input {
+  int fd;                // Descriptor read from
+  enum stream_read mode; // Mode in effect after any fallback
+  int saved_flags;       // File status flags before `O_DIRECT` was set
+  uint64_t offset;       // File offset of the next read
+  uint64_t dropped;      // Cached pages before this offset were released
+};
+
+/**
+ * @brief Prepares a descriptor for reads in the given mode.
+ *
+ * Descriptors that are not regular files, and modes the file system does not
+ * support, fall back to a mode that works; `input->mode` tells which one is
+ * in effect.
+ *
+ * @param input Receives the state of the reads.
+ * @param fd Descriptor to read from.
+ * @param mode Requested mode.
+ */
+void file_input_open(struct file_input *input, int fd, enum stream_read mode);
+
+/**
+ * @brief Reads from the descriptor like `read`.
+ *
+ * In `STREAM_READ_DIRECT` mode `buffer` and `bytes` must be multiples of
+ * `FILE_INPUT_ALIGNMENT`. A file that turns out not to allow direct reads,
+ * for example at an unaligned offset, is switched to
+ * `STREAM_READ_SEQUENTIAL` and read again.
+ *
+ * @param input Descriptor being read.
+ * @param buffer Receives the bytes.
+ * @param bytes Most bytes to read.
+ * @return ssize_t Bytes read, 0 at end of file, -1 with `errno` set on error.
+ */
+ssize_t file_input_read(struct file_input *input, void *buffer, size_t bytes);
+
+/**
+ * @brief Restores the descriptor's flags and releases the last pages read.
+ *
+ * @param input Descriptor being read.
+ */
+void file_input_close(struct file_input *input);
+
+#endif
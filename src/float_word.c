@@ -0,0 +1,163 @@
+/**
+ * @file float_word.c
+ * @brief Packed IEEE 754 words and their sign/exponent/fraction layout.
+ */
+
+#include "float_word.h"
+
+#include <math.h>
+
+static const struct float_layout binary32_layout = {32, 8, 23, 127};
+static const struct float_layout binary64_layout = {64, 11, 52, 1023};
+
+static const char *const float_class_names[] = {"zero", "subnormal", "normal",
+                                                "infinite", "nan"};
+
+/**
+ * @brief Returns the field layout for a given word width.
+ *
+ * @param width Word width in bits, 32 for binary32 or 64 for binary64.
+ * @return const struct float_layout* Layout for the width, or NULL if the
+ *         width is not supported.
+ */
+const struct float_layout *float_layout_for(int width) {
+  if (width == 32) {
+    return &binary32_layout;
+  } else if (width == 64) {
+    return &binary64_layout;
+  }
+  return NULL;
+}
+
+/**
+ * @brief Packs a binary float string into a word.
+ *
+ * The first character of the string becomes the most significant bit of the
+ * word, so a 32-bit string fills the low 32 bits of the result.
+ *
+ * @param bits String of '0's and '1's, not necessarily NUL-terminated.
+ * @param length Number of characters to pack (at most 64).
+ * @param word Receives the packed value.
+ * @return int 0 on success, -1 if a character is not '0' or '1'.
+ */
+int pack_binary_float(const char *bits, size_t length, uint64_t *word) {
+  uint64_t acc = 0; // Accumulator
+  unsigned char invalid = 0;
+
+  for (size_t i = 0; i < length; i++) {
+    unsigned char bit = (unsigned char)(bits[i] - '0');
+    invalid |= bit & ~1u; // Anything but 0 or 1 leaves a high bit set
+    acc = (acc << 1) | (bit & 1u);
+  }
+
+  if (invalid) {
+    return -1;
+  }
+  *word = acc;
+  return 0;
+}
+
+/**
+ * @brief Converts a packed IEEE 754 word to a decimal double.
+ *
+ * Unlike `convert_ieee_float`, this handles the whole encoding space: an
+ * all-ones exponent yields infinity or NaN, and subnormals are scaled without
+ * the implicit leading one.
+ *
+ * @param word Packed word, as produced by `pack_binary_float`.
+ * @param layout Layout of the word.
+ * @return double The value of the word. Every binary32 and binary64 value is
+ *         exactly representable as a double.
+ */
+double decode_float_word(uint64_t word, const struct float_layout *layout) {
+  int exponent_max = (1 << layout->exponent_bits) - 1;
+  uint64_t fraction_mask = (UINT64_C(1) << layout->fraction_bits) - 1;
+
+  int sign = (int)(word >> (layout->width - 1)) & 1;
+  int exponent = (int)(word >> layout->fraction_bits) & exponent_max;
+  uint64_t fraction = word & fraction_mask;
+
+  double magnitude;
+  if (exponent == exponent_max) {
+    magnitude = fraction ? NAN : INFINITY;
+  } else if (exponent == 0) {
+    // Subnormals: 0.fraction * 2^(1 - bias)
+    magnitude = ldexp((double)fraction,
+                      1 - layout->bias - layout->fraction_bits);
+  } else {
+    // Normals: 1.fraction * 2^(exponent - bias)
+    magnitude = ldexp((double)(fraction | (fraction_mask + 1)),
+                      exponent - layout->bias - layout->fraction_bits);
+  }
+
+  return sign ? -magnitude : magnitude;
+}
+
+/**
+ * @brief Returns the unbiased exponent of a packed word.
+ *
+ * Subnormals and zeros report the exponent of the smallest normal, so that
+ * the value is always `significand * 2^(exponent - fraction_bits)` for finite
+ * words.
+ *
+ * @param word Packed word, as produced by `pack_binary_float`.
+ * @param layout Layout of the word.
+ * @return int The unbiased exponent.
+ */
+int float_word_exponent(uint64_t word, const struct float_layout *layout) {
+  int exponent_max = (1 << layout->exponent_bits) - 1;
+  int exponent = (int)(word >> layout->fraction_bits) & exponent_max;
+
+  return exponent ? exponent - layout->bias : 1 - layout->bias;
+}
+
+/**
+ * @brief Returns the significand of a packed word as an integer.
+ *
+ * Normals include the implicit leading one above the fraction bits; every
+ * other class returns the bare fraction.
+ *
+ * @param word Packed word, as produced by `pack_binary_float`.
+ * @param layout Layout of the word.
+ * @return uint64_t The significand.
+ */
+uint64_t float_word_significand(uint64_t word,
+                                const struct float_layout *layout) {
+  int exponent_max = (1 << layout->exponent_bits) - 1;
+  int exponent = (int)(word >> layout->fraction_bits) & exponent_max;
+  uint64_t implicit = UINT64_C(1) << layout->fraction_bits;
+  uint64_t fraction = word & (implicit - 1);
+
+  return exponent && exponent != exponent_max ? fraction | implicit : fraction;
+}
+
+/**
+ * @brief Classifies a packed IEEE 754 word.
+ *
+ * @param word Packed word, as produced by `pack_binary_float`.
+ * @param layout Layout of the word.
+ * @return enum float_class The class of the word.
+ */
+enum float_class classify_float_word(uint64_t word,
+                                    const struct float_layout *layout) {
+  int exponent_max = (1 << layout->exponent_bits) - 1;
+  int exponent = (int)(word >> layout->fraction_bits) & exponent_max;
+  uint64_t fraction = word & ((UINT64_C(1) << layout->fraction_bits) - 1);
+
+  if (exponent == exponent_max) {
+    return fraction ? FLOAT_NAN : FLOAT_INFINITE;
+  } else if (exponent == 0) {
+    return fraction ? FLOAT_SUBNORMAL : FLOAT_ZERO;
+  }
+  return FLOAT_NORMAL;
+}
+
+/**
+ * @brief Returns the lowercase name of a float class.
+ *
+ * @param float_class Class to name.
+ * @return const char* "zero", "subnormal", "normal", "infinite" or "nan".
+ */
+const char *float_class_name(enum float_class float_class) {
+  return float_class_names[float_class];
+}
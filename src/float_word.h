@@ -0,0 +1,118 @@
+/**
+ * @file float_word.h
+ * @brief Packed IEEE 754 words and their sign/exponent/fraction layout.
+ *
+ * The interactive converter works on strings of '0's and '1's. The batch
+ * modes instead pack every record into a 64-bit word once, and the helpers in
+ * this file describe how that word splits into sign, exponent and fraction
+ * fields for binary32 and binary64 values.
+ */
+
+#ifndef FLOAT_WORD_H
+#define FLOAT_WORD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Field layout of an IEEE 754 binary interchange format.
+ */
+struct float_layout {
+  int width;         /**< Total number of bits (32 or 64). */
+  int exponent_bits; /**< Number of exponent bits (8 or 11). */
+  int fraction_bits; /**< Number of fraction bits (23 or 52). */
+  int bias;          /**< Exponent bias (127 or 1023). */
+};
+
+/**
+ * @brief IEEE 754 classes of a packed word.
+ */
+enum float_class {
+  FLOAT_ZERO,      /**< Exponent and fraction are zero. */
+  FLOAT_SUBNORMAL, /**< Exponent is zero, fraction is not. */
+  FLOAT_NORMAL,    /**< Exponent is neither zero nor all ones. */
+  FLOAT_INFINITE,  /**< Exponent is all ones, fraction is zero. */
+  FLOAT_NAN,       /**< Exponent is all ones, fraction is not. */
+};
+
+/**
+ * @brief Returns the field layout for a given word width.
+ *
+ * @param width Word width in bits, 32 for binary32 or 64 for binary64.
+ * @return const struct float_layout* Layout for the width, or NULL if the
+ *         width is not supported.
+ */
+const struct float_layout *float_layout_for(int width);
+
+/**
+ * @brief Packs a binary float string into a word.
+ *
+ * The first character of the string becomes the most significant bit of the
+ * word, so a 32-bit string fills the low 32 bits of the result.
+ *
+ * @param bits String of '0's and '1's, not necessarily NUL-terminated.
+ * @param length Number of characters to pack (at most 64).
+ * @param word Receives the packed value.
+ * @return int 0 on success, -1 if a character is not '0' or '1'.
+ */
+int pack_binary_float(const char *bits, size_t length, uint64_t *word);
+
+/**
+ * @brief Converts a packed IEEE 754 word to a decimal double.
+ *
+ * Unlike `convert_ieee_float`, this handles the whole encoding space: an
+ * all-ones exponent yields infinity or NaN, and subnormals are scaled without
+ * the implicit leading one.
+ *
+ * @param word Packed word, as produced by `pack_binary_float`.
+ * @param layout Layout of the word.
+ * @return double The value of the word. Every binary32 and binary64 value is
+ *         exactly representable as a double.
+ */
+double decode_float_word(uint64_t word, const struct float_layout *layout);
+
+/**
+ * @brief Returns the unbiased exponent of a packed word.
+ *
+ * Subnormals and zeros report the exponent of the smallest normal, so that
+ * the value is always `significand * 2^(exponent - fraction_bits)` for finite
+ * words.
+ *
+ * @param word Packed word, as produced by `pack_binary_float`.
+ * @param layout Layout of the word.
+ * @return int The unbiased exponent.
+ */
+int float_word_exponent(uint64_t word, const struct float_layout *layout);
+
+/**
+ * @brief Returns the significand of a packed word as an integer.
+ *
+ * Normals include the implicit leading one above the fraction bits; every
+ * other class returns the bare fraction.
+ *
+ * @param word Packed word, as produced by `pack_binary_float`.
+ * @param layout Layout of the word.
+ * @return uint64_t The significand.
+ */
+uint64_t float_word_significand(uint64_t word,
+                                const struct float_layout *layout);
+
+/**
+ * @brief Classifies a packed IEEE 754 word.
+ *
+ * @param word Packed word, as produced by `pack_binary_float`.
+ * @param layout Layout of the word.
+ * @return enum float_class The class of the word.
+ */
+enum float_class classify_float_word(uint64_t word,
+                                    const struct float_layout *layout);
+
+/**
+ * @brief Returns the lowercase name of a float class.
+ *
+ * @param float_class Class to name.
+ * @return const char* "zero", "subnormal", "normal", "infinite" or "nan".
+ */
+const char *float_class_name(enum float_class float_class);
+
+#endif
@@ -0,0 +1,1190 @@
+/**
+ * @file http.c
+ * @brief Minimal loopback HTTP/1.1 server for tools and metrics scrapers.
+ */
+
+#define _GNU_SOURCE // fopencookie()
+
+#include "http.h"
+
+#include "latency.h"
+#include "metrics.h"
+#include "parallel.h"
+#include "stream.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HEAD_BYTES 8192     // Longest accepted request head
+#define METRICS_BYTES 4096  // First guess at the size of a scrape
+#define CHUNK_BYTES 65536   // Response buffer, flushed as one chunk
+#define DISCARD_BYTES 65536 // Largest unwanted body drained to keep alive
+#define BATCH_MEMBERS 64    // Most requests coalesced into one conversion
+
+/**
+ * @brief One client connection and the request being served on it.
+ */
+struct connection {
+  int fd;
+  char buffer[HEAD_BYTES + 1]; // Received bytes, plus a terminator
+  size_t start;                // First unconsumed byte of `buffer`
+  size_t end;                  // End of the received bytes
+  uint64_t body_left;          // Body bytes of the request still unread
+  int keep_alive;              // Serve another request after this one
+  int started;                 // Head of a chunked response was sent
+  int broken;                  // A send failed, so the connection is dead
+  const char *content_type;    // Type of the chunked response
+  struct bf2d_ctx *ctx;        // Conversion context reused by every request
+  struct http_server *server;  // Server counting the connection, or NULL
+  enum http_class class;       // Priority class of the current request
+  const char *batch_body;      // Body being coalesced
+  size_t batch_length;         // Bytes of `batch_body`
+  size_t batch_records;        // Records in `batch_body`
+  const char *share;           // Its part of the batch output
+  size_t share_length;         // Bytes of `share`
+};
+
+/**
+ * @brief Small requests converted together in one pass.
+ *
+ * Created by the first request to arrive, which gathers the others until
+ * the budget is spent or the batch is full, and converts for all of them.
+ * Freed by whichever member takes its share last.
+ */
+struct http_batch {
+  struct stream_options options;             // Options every member asked
+  struct connection *members[BATCH_MEMBERS]; // In the order they joined
+  size_t count;                              // Entries in `members`
+  size_t records;                            // Records of all the members
+  size_t left;                               // Members yet to leave
+  int closed;                                // No more members may join
+  int converted;                             // Shares are set, or `failed`
+  int failed;                                // Members must convert alone
+  char *output;                              // Output of every member
+  size_t length;                             // Bytes of `output`
+  pthread_cond_t changed;                    // Closed or converted
+};
+
+static const char *const class_names[HTTP_CLASSES] = {"interactive", "bulk"};
+
+/**
+ * @brief Returns the name of a priority class.
+ *
+ * @param class Class to name.
+ * @return const char* "interactive" or "bulk".
+ */
+const char *http_class_name(enum http_class class) {
+  return class_names[class];
+}
+
+/**
+ * @brief Fills in the capacity `serve` uses by default.
+ *
+ * One worker per processor, at least two, with a quarter of them (at least
+ * one) kept for interactive requests, no connection limit and no
+ * coalescing.
+ *
+ * @param options Receives the defaults.
+ */
+void http_options_default(struct http_options *options) {
+  size_t workers = parallel_cpu_count();
+
+  options->max_connections = 0;
+  options->workers = workers > 2 ? workers : 2;
+  options->interactive = options->workers / 4 ? options->workers / 4 : 1;
+  options->batch_us = 0;
+}
+
+/**
+ * @brief Bytes one connection holds besides its conversion context.
+ *
+ * @return size_t Request and response buffers of a connection.
+ */
+size_t http_connection_bytes(void) {
+  return sizeof(struct connection) + CHUNK_BYTES;
+}
+
+/**
+ * @brief Gives back a counted connection's place under the limit.
+ */
+static void release_connection(struct http_server *server) {
+  pthread_mutex_lock(&server->lock);
+  server->open--;
+  pthread_cond_broadcast(&server->closed);
+  pthread_mutex_unlock(&server->lock);
+}
+
+/**
+ * @brief Waits until the limit, if any, allows another connection and takes
+ *        its place.
+ *
+ * @return int 0 once a place is taken, -1 if the server is stopping.
+ */
+static int admit_connection(struct http_server *server) {
+  int stopping;
+
+  pthread_mutex_lock(&server->lock);
+  while (server->options.max_connections &&
+         server->open >= server->options.max_connections &&
+         !server->stopping) {
+    pthread_cond_wait(&server->closed, &server->lock);
+  }
+  stopping = server->stopping;
+  if (!stopping) {
+    server->open++;
+  }
+  pthread_mutex_unlock(&server->lock);
+  return stopping ? -1 : 0;
+}
+
+/**
+ * @brief Tells whether a request of `class` may start a conversion now.
+ */
+static int worker_free(const struct http_server *server,
+                       enum http_class class) {
+  size_t running = server->running[HTTP_INTERACTIVE] +
+                   server->running[HTTP_BULK];
+
+  if (running >= server->options.workers) {
+    return 0;
+  }
+  // Bulk work leaves the reserved workers alone and yields to lookups
+  return class == HTTP_INTERACTIVE ||
+         (server->running[HTTP_BULK] <
+              server->options.workers - server->options.interactive &&
+          !server->waiting[HTTP_INTERACTIVE]);
+}
+
+/**
+ * @brief Queues a conversion behind earlier ones of its class and waits for
+ *        a worker.
+ */
+static void take_worker(struct http_server *server, enum http_class class) {
+  pthread_mutex_lock(&server->lock);
+  uint64_t ticket = server->tickets[class]++;
+  server->waiting[class]++;
+  metrics_gauge_add((enum metric_gauge)(METRIC_QUEUED_INTERACTIVE + class), 1);
+  while (ticket != server->turn[class] || !worker_free(server, class)) {
+    pthread_cond_wait(&server->ready, &server->lock);
+  }
+  server->waiting[class]--;
+  server->turn[class]++;
+  server->running[class]++;
+  metrics_gauge_add((enum metric_gauge)(METRIC_QUEUED_INTERACTIVE + class),
+                    -1);
+  metrics_gauge_add((enum metric_gauge)(METRIC_RUNNING_INTERACTIVE + class),
+                    1);
+  pthread_cond_broadcast(&server->ready); // The next in line may fit too
+  pthread_mutex_unlock(&server->lock);
+}
+
+/**
+ * @brief Hands a worker back once a conversion ends.
+ */
+static void release_worker(struct http_server *server, enum http_class class) {
+  pthread_mutex_lock(&server->lock);
+  server->running[class]--;
+  metrics_gauge_add((enum metric_gauge)(METRIC_RUNNING_INTERACTIVE + class),
+                    -1);
+  pthread_cond_broadcast(&server->ready);
+  pthread_mutex_unlock(&server->lock);
+}
+
+/**
+ * @brief Tells whether two requests may share one conversion.
+ */
+static int same_batch(const struct stream_options *a,
+                      const struct stream_options *b) {
+  return a->width == b->width && a->input == b->input &&
+         a->output == b->output && a->separator == b->separator &&
+         (a->output != STREAM_TEMPLATE ||
+          strcmp(a->template_spec, b->template_spec) == 0);
+}
+
+/**
+ * @brief Stops a batch from taking members and wakes the request gathering
+ *        it.
+ */
+static void close_batch(struct http_server *server,
+                        struct http_batch *batch) {
+  if (server->batch == batch) {
+    server->batch = NULL;
+  }
+  batch->closed = 1;
+  pthread_cond_broadcast(&batch->changed);
+}
+
+/**
+ * @brief Joins the batch gathering requests like this one, or starts one.
+ *
+ * @return struct http_batch* The batch, and whether this request leads it,
+ *         or NULL if it is to be converted alone.
+ */
+static struct http_batch *join_batch(struct connection *c,
+                                     const struct stream_options *options,
+                                     int *leader) {
+  struct http_server *server = c->server;
+  struct http_batch *batch;
+  pthread_condattr_t attributes;
+
+  pthread_mutex_lock(&server->lock);
+  batch = server->batch;
+  *leader = !batch;
+  if (batch && !same_batch(&batch->options, options)) {
+    // One batch gathers at a time; requests unlike it are not held back
+    pthread_mutex_unlock(&server->lock);
+    return NULL;
+  } else if (!batch) {
+    if (!(batch = (struct http_batch *)calloc(1, sizeof(*batch)))) {
+      pthread_mutex_unlock(&server->lock);
+      perror("Memory allocation error.\n");
+      return NULL;
+    }
+    batch->options = *options;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&batch->changed, &attributes);
+    pthread_condattr_destroy(&attributes);
+    server->batch = batch;
+  }
+
+  batch->members[batch->count++] = c;
+  batch->left++;
+  batch->records += c->batch_records;
+  if (batch->count == BATCH_MEMBERS ||
+      batch->records >= STREAM_BLOCK_VALUES) {
+    close_batch(server, batch);
+  }
+  pthread_mutex_unlock(&server->lock);
+  return batch;
+}
+
+/**
+ * @brief Gives a member's hold on a batch back, freeing it after the last.
+ */
+static void leave_batch(struct http_server *server,
+                        struct http_batch *batch) {
+  int last;
+
+  pthread_mutex_lock(&server->lock);
+  last = --batch->left == 0;
+  pthread_mutex_unlock(&server->lock);
+  if (last) {
+    pthread_cond_destroy(&batch->changed);
+    free(batch->output);
+    free(batch);
+  }
+}
+
+/**
+ * @brief Waits for the budget to run out or the batch to fill up.
+ */
+static void gather_batch(struct http_server *server,
+                         struct http_batch *batch) {
+  struct timespec deadline;
+  uint64_t budget = server->options.batch_us;
+
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += (time_t)(budget / 1000000u);
+  deadline.tv_nsec += (long)(budget % 1000000u) * 1000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+
+  pthread_mutex_lock(&server->lock);
+  while (!batch->closed &&
+         pthread_cond_timedwait(&batch->changed, &server->lock, &deadline) !=
+             ETIMEDOUT) {
+  }
+  close_batch(server, batch);
+  pthread_mutex_unlock(&server->lock);
+}
+
+/**
+ * @brief Cuts the batch output into the share of every member.
+ *
+ * Every record of the joined input gave one line, or one word of raw
+ * output, in input order.
+ *
+ * @return int 0 on success, -1 if the output does not hold one record per
+ *         input record.
+ */
+static int split_batch(struct http_batch *batch) {
+  const char *at = batch->output;
+  const char *end = batch->output + batch->length;
+  size_t word_bytes = (size_t)batch->options.width / 8;
+
+  for (size_t m = 0; m < batch->count; m++) {
+    struct connection *member = batch->members[m];
+    member->share = at;
+    if (batch->options.output == STREAM_RAW) {
+      size_t length = member->batch_records * word_bytes;
+      if ((size_t)(end - at) < length) {
+        return -1;
+      }
+      at += length;
+    } else {
+      for (size_t i = 0; i < member->batch_records; i++) {
+        const char *newline = (const char *)memchr(at, '\n',
+                                                   (size_t)(end - at));
+        if (!newline) {
+          return -1;
+        }
+        at = newline + 1;
+      }
+    }
+    member->share_length = (size_t)(at - member->share);
+  }
+  return at == end ? 0 : -1;
+}
+
+/**
+ * @brief Converts the joined bodies of a closed batch in one pass.
+ *
+ * Runs on the leading request's context, whose options every member shares.
+ * Sets `failed` if any member's records kept the joined input from
+ * converting.
+ */
+static void convert_batch(struct connection *c, struct http_batch *batch) {
+  struct http_server *server = c->server;
+  size_t total = 0;
+  char *input;
+  FILE *in, *out;
+  int status = -1;
+
+  for (size_t m = 0; m < batch->count; m++) {
+    total += batch->members[m]->batch_length;
+  }
+  input = (char *)malloc(total);
+  in = input ? fmemopen(input, total, "r") : NULL;
+  out = in ? open_memstream(&batch->output, &batch->length) : NULL;
+  if (!out) {
+    perror("Memory allocation error.\n");
+  } else {
+    total = 0;
+    for (size_t m = 0; m < batch->count; m++) {
+      memcpy(input + total, batch->members[m]->batch_body,
+             batch->members[m]->batch_length);
+      total += batch->members[m]->batch_length;
+    }
+    if (server->options.workers) {
+      take_worker(server, HTTP_BULK);
+    }
+    status = bf2d_ctx_convert(c->ctx, in, out);
+    if (server->options.workers) {
+      release_worker(server, HTTP_BULK);
+    }
+  }
+  if (out && fclose(out)) {
+    status = -1;
+  }
+  if (in) {
+    fclose(in);
+  }
+  free(input);
+
+  pthread_mutex_lock(&server->lock);
+  batch->failed = status || split_batch(batch);
+  batch->converted = 1;
+  pthread_cond_broadcast(&batch->changed);
+  pthread_mutex_unlock(&server->lock);
+  if (!batch->failed && metrics_enabled()) {
+    metrics_add(METRIC_COALESCED_REQUESTS, batch->count);
+    metrics_add(METRIC_COALESCED_BATCHES, 1);
+  }
+}
+
+/**
+ * @brief Waits for the batch of a request to be converted.
+ *
+ * @return int 0 if its share of the output is set, -1 if the request must be
+ *         converted alone.
+ */
+static int await_batch(struct connection *c, struct http_batch *batch,
+                       int leader) {
+  if (leader) {
+    gather_batch(c->server, batch);
+    if (batch->count == 1) {
+      return -1; // Nothing came to share with
+    }
+    convert_batch(c, batch);
+  } else {
+    pthread_mutex_lock(&c->server->lock);
+    while (!batch->converted) {
+      pthread_cond_wait(&batch->changed, &c->server->lock);
+    }
+    pthread_mutex_unlock(&c->server->lock);
+  }
+  return batch->failed ? -1 : 0;
+}
+
+static int send_vector(int fd, struct iovec *parts, int count) {
+  while (count) {
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = parts;
+    message.msg_iovlen = (size_t)count;
+
+    ssize_t sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    while (count && (size_t)sent >= parts->iov_len) {
+      sent -= (ssize_t)parts->iov_len;
+      parts++;
+      count--;
+    }
+    if (count) {
+      parts->iov_base = (char *)parts->iov_base + sent;
+      parts->iov_len -= (size_t)sent;
+    }
+  }
+  return 0;
+}
+
+static int send_response(struct connection *c, const char *status,
+                         const char *type, const char *body, size_t length) {
+  char head[256];
+  int head_length = snprintf(head, sizeof(head),
+                             "HTTP/1.1 %s\r\n"
+                             "Content-Type: %s\r\n"
+                             "Content-Length: %zu\r\n"
+                             "%s"
+                             "\r\n",
+                             status, type, length,
+                             c->keep_alive ? "" : "Connection: close\r\n");
+  struct iovec parts[2] = {{head, (size_t)head_length},
+                           {(void *)body, length}};
+
+  if (send_vector(c->fd, parts, 2)) {
+    c->broken = 1;
+    return -1;
+  }
+  return 0;
+}
+
+static int send_error(struct connection *c, const char *status) {
+  char body[64];
+  int length = snprintf(body, sizeof(body), "%s\n", status);
+  return send_response(c, status, "text/plain", body, (size_t)length);
+}
+
+static int send_metrics(struct connection *c) {
+  size_t size = METRICS_BYTES;
+  char *body = NULL;
+  size_t length;
+
+  // Render again into a larger buffer if the first guess was short
+  for (;;) {
+    char *grown = (char *)realloc(body, size);
+    if (!grown) {
+      perror("Memory allocation error.\n");
+      free(body);
+      return send_error(c, "500 Internal Server Error");
+    }
+    body = grown;
+    length = metrics_render(body, size);
+    if (length < size) {
+      break;
+    }
+    size = length + 1;
+  }
+
+  int status = send_response(c, "200 OK", "text/plain; version=0.0.4", body,
+                             length);
+  free(body);
+  return status;
+}
+
+/**
+ * @brief Receives more bytes after the unconsumed part of the buffer.
+ *
+ * @return ssize_t Bytes received, 0 if the client closed the connection,
+ *         -1 on error.
+ */
+static ssize_t receive(struct connection *c) {
+  size_t pending = c->end - c->start;
+  ssize_t got;
+
+  memmove(c->buffer, c->buffer + c->start, pending);
+  c->start = 0;
+  c->end = pending;
+
+  do {
+    got = recv(c->fd, c->buffer + c->end, HEAD_BYTES - c->end, 0);
+  } while (got < 0 && errno == EINTR);
+  if (got > 0) {
+    c->end += (size_t)got;
+  }
+  return got;
+}
+
+/**
+ * @brief Waits for a complete request head at the start of the buffer.
+ *
+ * @return char* The head, terminated in place, or NULL if the connection
+ *         closed or the head is too long (which has been answered).
+ */
+static char *read_head(struct connection *c) {
+  for (;;) {
+    c->buffer[c->end] = '\0';
+    char *head = c->buffer + c->start;
+    char *blank = strstr(head, "\r\n\r\n");
+    if (blank) {
+      *blank = '\0';
+      c->start = (size_t)(blank + 4 - c->buffer);
+      return head;
+    }
+
+    if (c->end - c->start == HEAD_BYTES) {
+      c->keep_alive = 0;
+      send_error(c, "431 Request Header Fields Too Large");
+      return NULL;
+    }
+    if (receive(c) <= 0) {
+      return NULL;
+    }
+  }
+}
+
+static ssize_t read_body(void *cookie, char *out, size_t size) {
+  struct connection *c = (struct connection *)cookie;
+  size_t buffered = c->end - c->start;
+  ssize_t got;
+
+  if (size > c->body_left) {
+    size = (size_t)c->body_left;
+  }
+  if (!size) {
+    return 0;
+  }
+
+  // Pipelined bytes already received come first, then the socket
+  if (buffered) {
+    got = (ssize_t)(buffered < size ? buffered : size);
+    memcpy(out, c->buffer + c->start, (size_t)got);
+    c->start += (size_t)got;
+  } else {
+    do {
+      got = recv(c->fd, out, size, 0);
+    } while (got < 0 && errno == EINTR);
+    if (got <= 0) {
+      c->broken = 1;
+      return -1; // Closed before the announced length
+    }
+  }
+  c->body_left -= (uint64_t)got;
+  return got;
+}
+
+static int send_chunk_head(struct connection *c) {
+  char head[160];
+  int length = snprintf(head, sizeof(head),
+                        "HTTP/1.1 200 OK\r\n"
+                        "Content-Type: %s\r\n"
+                        "Transfer-Encoding: chunked\r\n"
+                        "%s"
+                        "\r\n",
+                        c->content_type,
+                        c->keep_alive ? "" : "Connection: close\r\n");
+  struct iovec part = {head, (size_t)length};
+
+  c->started = 1;
+  return send_vector(c->fd, &part, 1);
+}
+
+static ssize_t write_chunk(void *cookie, const char *data, size_t size) {
+  struct connection *c = (struct connection *)cookie;
+  char size_line[24];
+  int length = snprintf(size_line, sizeof(size_line), "%zx\r\n", size);
+  struct iovec parts[3] = {{size_line, (size_t)length},
+                           {(void *)data, size},
+                           {"\r\n", 2}};
+
+  if (!size) {
+    return 0; // An empty chunk would end the response
+  }
+  if (c->broken || (!c->started && send_chunk_head(c)) ||
+      send_vector(c->fd, parts, 3)) {
+    c->broken = 1;
+    return -1;
+  }
+  return (ssize_t)size;
+}
+
+/**
+ * @brief Reads and drops the rest of a body so the connection can be reused.
+ */
+static void discard_body(struct connection *c) {
+  char scratch[4096];
+
+  if (c->body_left > DISCARD_BYTES) {
+    c->keep_alive = 0; // Cheaper to close than to drain
+    return;
+  }
+  while (c->body_left && read_body(c, scratch, sizeof(scratch)) > 0) {
+  }
+  if (c->body_left) {
+    c->keep_alive = 0;
+  }
+}
+
+static void url_decode(char *text) {
+  char *out = text;
+
+  for (; *text; text++) {
+    if (*text == '+') {
+      *out++ = ' ';
+    } else if (*text == '%' && text[1] && text[2]) {
+      char hex[3] = {text[1], text[2], '\0'};
+      *out++ = (char)strtol(hex, NULL, 16);
+      text += 2;
+    } else {
+      *out++ = *text;
+    }
+  }
+  *out = '\0';
+}
+
+/**
+ * @brief Applies `/convert` query parameters to the pipeline options.
+ *
+ * @param query Query string, decoded in place; must outlive `options`.
+ * @param class Receives the class the request asks for, if it names one.
+ * @return int 0 on success, -1 on an unknown or invalid parameter.
+ */
+static int parse_query(char *query, struct stream_options *options,
+                       enum http_class *class) {
+  char *saved;
+
+  for (char *pair = strtok_r(query, "&", &saved); pair;
+       pair = strtok_r(NULL, "&", &saved)) {
+    char *value = strchr(pair, '=');
+    if (!value) {
+      return -1;
+    }
+    *value++ = '\0';
+    url_decode(value);
+
+    if (strcmp(pair, "width") == 0) {
+      options->width = atoi(value);
+      if (!float_layout_for(options->width)) {
+        return -1;
+      }
+    } else if (strcmp(pair, "input") == 0) {
+      if (stream_format_from_name(value, &options->input) ||
+          options->input == STREAM_DECIMAL ||
+          options->input == STREAM_EXPLAIN) {
+        return -1;
+      }
+    } else if (strcmp(pair, "output") == 0) {
+      if (stream_format_from_name(value, &options->output)) {
+        return -1;
+      }
+    } else if (strcmp(pair, "format") == 0) {
+      options->output = STREAM_TEMPLATE;
+      options->template_spec = value;
+    } else if (strcmp(pair, "separator") == 0) {
+      options->separator = value[0];
+    } else if (strcmp(pair, "on_error") == 0) {
+      if (stream_rejects_from_name(value, &options->rejects)) {
+        return -1;
+      }
+    } else if (strcmp(pair, "class") == 0) {
+      if (strcmp(value, class_names[HTTP_INTERACTIVE]) == 0) {
+        *class = HTTP_INTERACTIVE;
+      } else if (strcmp(value, class_names[HTTP_BULK]) == 0) {
+        *class = HTTP_BULK;
+      } else {
+        return -1;
+      }
+    } else {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Converts `in` and streams the result back as the response.
+ *
+ * Closes `in`.
+ */
+static void respond_converted(struct connection *c, FILE *in) {
+  cookie_io_functions_t chunk_io = {.write = write_chunk};
+  int scheduled = c->server && c->server->options.workers;
+  FILE *out;
+  int status;
+
+  // Unbuffered, every block of an interactive response is sent once formatted
+  out = fopencookie(c, "w", chunk_io);
+  if (!out ||
+      setvbuf(out, NULL, c->class == HTTP_INTERACTIVE ? _IONBF : _IOFBF,
+              CHUNK_BYTES)) {
+    perror("Memory allocation error.\n");
+    fclose(in);
+    if (out) {
+      fclose(out);
+    }
+    c->keep_alive = 0;
+    send_error(c, "500 Internal Server Error");
+    return;
+  }
+
+  if (scheduled) {
+    take_worker(c->server, c->class);
+  }
+  status = bf2d_ctx_convert(c->ctx, in, out);
+  if (fclose(out)) {
+    status = -1;
+  }
+  fclose(in);
+  if (scheduled) {
+    release_worker(c->server, c->class);
+  }
+
+  if (c->broken) {
+    return;
+  } else if (status == 0) {
+    struct iovec last = {"0\r\n\r\n", 5};
+    if ((!c->started && send_chunk_head(c)) || send_vector(c->fd, &last, 1)) {
+      c->broken = 1;
+    }
+  } else if (!c->started) {
+    char body[STREAM_ERROR_BYTES + 1];
+    int length = snprintf(body, sizeof(body), "%s\n", bf2d_ctx_error(c->ctx));
+    discard_body(c);
+    send_response(c, "422 Unprocessable Entity", "text/plain", body,
+                  (size_t)length < sizeof(body) ? (size_t)length
+                                                : sizeof(body) - 1);
+  } else {
+    c->keep_alive = 0; // Drop the connection before the final chunk
+  }
+}
+
+/**
+ * @brief Tells whether a request may wait to share a conversion.
+ *
+ * @param asked Class named by the request, or `HTTP_CLASSES` if none.
+ */
+static int coalescible(const struct connection *c,
+                       const struct stream_options *options,
+                       enum http_class asked) {
+  return c->server && c->server->options.batch_us &&
+         asked != HTTP_INTERACTIVE &&
+         c->body_left <= HTTP_BATCH_BYTES &&
+         (options->input == STREAM_BITS || options->input == STREAM_RAW) &&
+         options->output != STREAM_XOR &&
+         options->rejects == STREAM_REJECT_FAIL;
+}
+
+/**
+ * @brief Counts the records of a whole body that can be joined to others.
+ *
+ * @return size_t Number of records, or 0 if the body holds none or would not
+ *         split back off a joined input: text must end with a newline, and
+ *         raw input must hold whole words.
+ */
+static size_t count_records(const char *body, size_t length,
+                            const struct stream_options *options) {
+  size_t word_bytes = (size_t)options->width / 8;
+  size_t records = 0;
+
+  if (options->input == STREAM_RAW) {
+    return length % word_bytes ? 0 : length / word_bytes;
+  }
+  if (!length || body[length - 1] != '\n') {
+    return 0;
+  }
+  // Blank lines give no output, so they are not counted
+  for (const char *line = body, *end = body + length; line < end;) {
+    const char *newline = (const char *)memchr(line, '\n',
+                                               (size_t)(end - line));
+    size_t line_length = (size_t)(newline - line);
+    if (line_length && line[line_length - 1] == '\r') {
+      line_length--;
+    }
+    records += line_length > 0;
+    line = newline + 1;
+  }
+  return records;
+}
+
+/**
+ * @brief Sends a coalesced request its share of the batch output.
+ */
+static void send_share(struct connection *c) {
+  struct iovec last = {"0\r\n\r\n", 5};
+
+  if ((c->share_length && write_chunk(c, c->share, c->share_length) < 0) ||
+      (!c->started && send_chunk_head(c)) || send_vector(c->fd, &last, 1)) {
+    c->broken = 1;
+  }
+}
+
+/**
+ * @brief Reads a small body whole and converts it together with those of
+ *        concurrent requests, or alone if none can join it.
+ */
+static void serve_coalesced(struct connection *c,
+                            const struct stream_options *options) {
+  cookie_io_functions_t body_io = {.read = read_body};
+  char body[HTTP_BATCH_BYTES];
+  size_t length = 0;
+  ssize_t got;
+  struct http_batch *batch = NULL;
+  int leader, shared = 0;
+  FILE *in;
+
+  while (c->body_left &&
+         (got = read_body(c, body + length, sizeof(body) - length)) > 0) {
+    length += (size_t)got;
+  }
+  if (c->broken) {
+    return;
+  }
+
+  c->batch_body = body;
+  c->batch_length = length;
+  c->batch_records = count_records(body, length, options);
+  if (c->batch_records && (batch = join_batch(c, options, &leader))) {
+    shared = await_batch(c, batch, leader) == 0;
+    if (shared) {
+      send_share(c);
+    }
+    leave_batch(c->server, batch);
+  }
+  if (shared) {
+    return;
+  }
+
+  // An empty body is read through the drained connection instead
+  in = length ? fmemopen(body, length, "r") : fopencookie(c, "r", body_io);
+  if (!in) {
+    perror("Memory allocation error.\n");
+    c->keep_alive = 0;
+    send_error(c, "500 Internal Server Error");
+    return;
+  }
+  respond_converted(c, in);
+}
+
+/**
+ * @brief Streams the request body through the batch pipeline.
+ */
+static void serve_convert(struct connection *c, char *query) {
+  struct stream_options options = {
+      .width = 32, .input = STREAM_BITS, .output = STREAM_DECIMAL};
+  cookie_io_functions_t body_io = {.read = read_body};
+  enum http_class asked = HTTP_CLASSES;
+  FILE *in;
+
+  if (query && parse_query(query, &options, &asked)) {
+    c->class = HTTP_INTERACTIVE;
+    discard_body(c);
+    send_error(c, "400 Bad Request");
+    return;
+  }
+  c->class = asked != HTTP_CLASSES ? asked
+             : c->body_left <= HTTP_INTERACTIVE_BYTES ? HTTP_INTERACTIVE
+                                                      : HTTP_BULK;
+  if (c->body_left > HTTP_INTERACTIVE_BYTES) {
+    c->class = HTTP_BULK; // Only short bodies may use the reserved workers
+  }
+  c->content_type =
+      options.output == STREAM_XOR || options.output == STREAM_RAW
+          ? "application/octet-stream"
+          : "text/plain";
+  c->started = 0;
+
+  if (c->ctx ? bf2d_ctx_set_options(c->ctx, &options)
+             : !(c->ctx = bf2d_ctx_create(&options))) {
+    discard_body(c);
+    send_error(c, "500 Internal Server Error");
+    return;
+  }
+
+  if (coalescible(c, &options, asked)) {
+    c->class = HTTP_BULK; // Waiting for company trades latency for throughput
+    serve_coalesced(c, &options);
+    return;
+  }
+  if (!(in = fopencookie(c, "r", body_io))) {
+    perror("Memory allocation error.\n");
+    c->keep_alive = 0;
+    send_error(c, "500 Internal Server Error");
+    return;
+  }
+  respond_converted(c, in);
+}
+
+/**
+ * @brief Parses one request head and answers the request.
+ */
+static void serve_request(struct connection *c, char *head) {
+  char *line_end = strstr(head, "\r\n");
+  char *method = head, *target, *version, *query;
+  int has_length = 0;
+
+  if (line_end) {
+    *line_end = '\0';
+  }
+  target = strchr(method, ' ');
+  version = target ? strchr(target + 1, ' ') : NULL;
+  if (!version) {
+    c->keep_alive = 0;
+    send_error(c, "400 Bad Request");
+    return;
+  }
+  *target++ = '\0';
+  *version++ = '\0';
+  c->keep_alive = strcmp(version, "HTTP/1.0") != 0;
+  c->body_left = 0;
+
+  for (char *header = line_end ? line_end + 2 : NULL; header && *header;) {
+    char *next = strstr(header, "\r\n");
+    if (next) {
+      *next = '\0';
+    }
+    char *value = strchr(header, ':');
+    if (value) {
+      *value++ = '\0';
+      value += strspn(value, " \t");
+      if (strcasecmp(header, "Content-Length") == 0) {
+        c->body_left = strtoull(value, NULL, 10);
+        has_length = 1;
+      } else if (strcasecmp(header, "Connection") == 0) {
+        c->keep_alive = strcasecmp(value, "close") != 0 &&
+                        (c->keep_alive || !strcasecmp(value, "keep-alive"));
+      } else if (strcasecmp(header, "Transfer-Encoding") == 0) {
+        c->keep_alive = 0; // Chunked request bodies are not supported
+        send_error(c, "411 Length Required");
+        return;
+      }
+    }
+    header = next ? next + 2 : NULL;
+  }
+
+  if ((query = strchr(target, '?'))) {
+    *query++ = '\0';
+  }
+
+  if (strcmp(target, "/convert") == 0) {
+    if (strcmp(method, "POST") != 0) {
+      discard_body(c);
+      send_error(c, "405 Method Not Allowed");
+    } else if (!has_length) {
+      c->keep_alive = 0;
+      send_error(c, "411 Length Required");
+    } else {
+      uint64_t start = latency_enabled() ? latency_now() : 0;
+      serve_convert(c, query);
+      if (latency_enabled()) {
+        uint64_t elapsed = latency_now() - start;
+        latency_record(LATENCY_REQUEST, elapsed);
+        latency_record((enum latency_metric)(LATENCY_INTERACTIVE + c->class),
+                       elapsed);
+      }
+      if (metrics_enabled()) {
+        metrics_add(METRIC_REQUESTS, 1);
+        metrics_add(
+            (enum metric_counter)(METRIC_INTERACTIVE_REQUESTS + c->class), 1);
+      }
+    }
+  } else if (strcmp(target, "/metrics") == 0) {
+    discard_body(c);
+    if (strcmp(method, "GET") != 0) {
+      send_error(c, "405 Method Not Allowed");
+    } else {
+      send_metrics(c);
+    }
+  } else {
+    discard_body(c);
+    send_error(c, "404 Not Found");
+  }
+}
+
+static void *serve_connection(void *argument) {
+  struct connection *c = (struct connection *)argument;
+  char *head;
+
+  do {
+    if (!(head = read_head(c))) {
+      break;
+    }
+    serve_request(c, head);
+  } while (c->keep_alive && !c->broken);
+
+  close(c->fd);
+  bf2d_ctx_destroy(c->ctx);
+  if (c->server) {
+    release_connection(c->server);
+  }
+  free(c);
+  return NULL;
+}
+
+static void *serve(void *argument) {
+  struct http_server *server = (struct http_server *)argument;
+  // Counted connections use the server's lock, so stopping waits for them
+  int counted = server->options.max_connections || server->options.workers ||
+                server->options.batch_us;
+  pthread_attr_t attributes;
+  int no_delay = 1;
+
+  pthread_attr_init(&attributes);
+  pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+
+  for (;;) {
+    // At the limit, clients queue in the backlog until a connection ends
+    if (counted && admit_connection(server)) {
+      break;
+    }
+    int fd = accept(server->fd, NULL, NULL);
+    if (fd < 0) {
+      if (counted) {
+        release_connection(server);
+      }
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      break; // Listening socket shut down by http_server_stop
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+    struct connection *c = (struct connection *)calloc(1, sizeof(*c));
+    pthread_t thread;
+    if (!c) {
+      perror("Memory allocation error.\n");
+      close(fd);
+      if (counted) {
+        release_connection(server);
+      }
+      continue;
+    }
+    c->fd = fd;
+    c->server = counted ? server : NULL;
+    if (pthread_create(&thread, &attributes, serve_connection, c)) {
+      close(fd);
+      free(c);
+      if (counted) {
+        release_connection(server);
+      }
+    }
+  }
+
+  pthread_attr_destroy(&attributes);
+  return NULL;
+}
+
+/**
+ * @brief Binds a loopback port and starts serving it.
+ *
+ * @param server Server to start.
+ * @param port TCP port on 127.0.0.1, or 0 for any free port.
+ * @param options Capacity of the server, or NULL for no limits.
+ * @return int The bound port on success, -1 if the port could not be bound
+ *         or the thread not started. The reason is printed to stderr.
+ */
+int http_server_start(struct http_server *server, int port,
+                      const struct http_options *options) {
+  struct sockaddr_in address;
+  socklen_t address_length = sizeof(address);
+  int reuse = 1;
+
+  server->fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (server->fd < 0) {
+    perror("socket");
+    return -1;
+  }
+  setsockopt(server->fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons((uint16_t)port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(server->fd, (struct sockaddr *)&address, sizeof(address)) ||
+      listen(server->fd, 128) ||
+      getsockname(server->fd, (struct sockaddr *)&address, &address_length)) {
+    perror("HTTP server");
+    close(server->fd);
+    return -1;
+  }
+
+  memset(&server->options, 0, sizeof(server->options));
+  if (options) {
+    server->options = *options;
+  }
+  server->open = 0;
+  server->stopping = 0;
+  memset(server->running, 0, sizeof(server->running));
+  memset(server->waiting, 0, sizeof(server->waiting));
+  memset(server->tickets, 0, sizeof(server->tickets));
+  memset(server->turn, 0, sizeof(server->turn));
+  server->batch = NULL;
+  pthread_mutex_init(&server->lock, NULL);
+  pthread_cond_init(&server->closed, NULL);
+  pthread_cond_init(&server->ready, NULL);
+  int error = pthread_create(&server->thread, NULL, serve, server);
+  if (error) {
+    fprintf(stderr, "HTTP server: %s\n", strerror(error));
+    pthread_cond_destroy(&server->ready);
+    pthread_cond_destroy(&server->closed);
+    pthread_mutex_destroy(&server->lock);
+    close(server->fd);
+    return -1;
+  }
+  return ntohs(address.sin_port);
+}
+
+/**
+ * @brief Blocks until the server stops accepting connections.
+ *
+ * @param server Server started by `http_server_start`.
+ */
+void http_server_wait(struct http_server *server) {
+  pthread_join(server->thread, NULL);
+}
+
+/**
+ * @brief Stops accepting connections and waits for the server thread.
+ *
+ * Connections already open are served to completion on their own threads.
+ * With a connection limit, workers or a batch budget the call also waits
+ * for them, since they report back to the server when they end.
+ *
+ * @param server Server started by `http_server_start`.
+ */
+void http_server_stop(struct http_server *server) {
+  pthread_mutex_lock(&server->lock);
+  server->stopping = 1;
+  pthread_cond_broadcast(&server->closed); // Wakes a wait for a free place
+  pthread_mutex_unlock(&server->lock);
+  shutdown(server->fd, SHUT_RDWR); // Wakes the blocked accept()
+  pthread_join(server->thread, NULL);
+
+  pthread_mutex_lock(&server->lock);
+  while (server->open) {
+    pthread_cond_wait(&server->closed, &server->lock);
+  }
+  pthread_mutex_unlock(&server->lock);
+  pthread_cond_destroy(&server->ready);
+  pthread_cond_destroy(&server->closed);
+  pthread_mutex_destroy(&server->lock);
+  close(server->fd);
+}
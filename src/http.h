@@ -0,0 +1,173 @@
+/**
+ * @file http.h
+ * @brief Minimal loopback HTTP/1.1 server for tools and metrics scrapers.
+ *
+ * The server listens on 127.0.0.1 only and serves every connection on its own
+ * thread. Connections are kept alive unless the client asks otherwise, and
+ * pipelined requests are answered in order. A server started with a
+ * connection limit stops accepting while that many are open, so further
+ * clients wait in the listen backlog instead of each adding a thread and a
+ * conversion context.
+ *
+ * A server started with workers runs that many conversions at once, and
+ * queues the rest by priority class so bulk conversions cannot starve
+ * single-value lookups. Each class has a queue of its own, served in
+ * arrival order:
+ *
+ * - interactive requests may take any free worker, and bulk requests wait
+ *   while any are queued;
+ * - bulk requests get the workers left over once `interactive` are kept
+ *   free for interactive ones.
+ *
+ * A request is interactive when its body is at most
+ * `HTTP_INTERACTIVE_BYTES` long, unless its `class` parameter says `bulk`;
+ * a longer body is always bulk. Interactive responses are unbuffered, so
+ * every converted block goes out as a chunk of its own as soon as it is
+ * formatted, where bulk responses are gathered into 64 KiB chunks.
+ *
+ * A server started with a batch budget coalesces small requests: bodies of
+ * at most `HTTP_BATCH_BYTES` that ask for the same options and arrive on
+ * different connections within the budget of the first one are joined into
+ * one input, converted in one pass on one worker, and each connection is
+ * sent the records of its own body. Coalesced requests run as bulk, trading
+ * up to the budget in latency for far fewer, fuller conversions; a request
+ * whose `class` parameter says `interactive` skips coalescing. Bits and
+ * raw input are coalesced into any output but XOR, under the `fail` policy
+ * only; if the joined input fails to convert, every request is converted
+ * alone so each gets its own answer.
+ *
+ * | Request         | Response                                            |
+ * |-----------------|-----------------------------------------------------|
+ * | `GET /metrics`  | Counters in the Prometheus text format              |
+ * | `POST /convert` | The body run through the batch pipeline, chunked    |
+ *
+ * `/convert` takes the pipeline options as query parameters, all optional:
+ * `width` (32 or 64), `input` (bits, xor or raw), `output` (decimal, bits,
+ * xor, explain or raw), `format` (a URL-encoded template), `separator`,
+ * `on_error` (fail, skip or nan, see `enum stream_rejects`) and `class`
+ * (interactive or bulk).
+ * The body must carry a `Content-Length`. The response streams out as the
+ * body is converted, with `Transfer-Encoding: chunked`. Malformed input
+ * found before any output was sent is answered with
+ * `422 Unprocessable Entity`; found later, it ends the connection before
+ * the final chunk, so the client sees a truncated response.
+ */
+
+#ifndef HTTP_H
+#define HTTP_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief Longest body a request can have and still be interactive. */
+#define HTTP_INTERACTIVE_BYTES 65536
+
+/** @brief Longest body a request can have and still be coalesced. */
+#define HTTP_BATCH_BYTES 4096
+
+/**
+ * @brief Priority classes of conversion requests.
+ */
+enum http_class {
+  HTTP_INTERACTIVE, /**< Short lookups, served first. */
+  HTTP_BULK,        /**< Large conversions, served with what is left. */
+  HTTP_CLASSES,     /**< Number of classes. */
+};
+
+/**
+ * @brief Capacity of a server.
+ */
+struct http_options {
+  size_t max_connections; /**< Connections served at once, 0 for no limit. */
+  size_t workers;         /**< Conversions run at once, 0 for no limit and
+                               no priority classes. */
+  size_t interactive;     /**< Of the workers, how many bulk requests must
+                               leave free; less than `workers`. */
+  uint64_t batch_us;      /**< Longest wait for other small requests to
+                               coalesce with, 0 to convert each alone. */
+};
+
+struct http_batch;
+
+/**
+ * @brief Listening socket and the thread serving it.
+ */
+struct http_server {
+  int fd;                         /**< Listening socket. */
+  pthread_t thread;               /**< Thread accepting connections. */
+  struct http_options options;    /**< Capacity the server was started
+                                       with. */
+  size_t open;                    /**< Connections being served, when
+                                       counted. */
+  int stopping;                   /**< `http_server_stop` was called. */
+  size_t running[HTTP_CLASSES];   /**< Conversions running, per class. */
+  size_t waiting[HTTP_CLASSES];   /**< Conversions queued, per class. */
+  uint64_t tickets[HTTP_CLASSES]; /**< Places handed out in each queue. */
+  uint64_t turn[HTTP_CLASSES];    /**< Place at the head of each queue. */
+  struct http_batch *batch;       /**< Batch still gathering requests, or
+                                       NULL. */
+  pthread_mutex_t lock;           /**< Guards the fields above. */
+  pthread_cond_t closed;          /**< Signalled when a counted connection
+                                       ends. */
+  pthread_cond_t ready;           /**< Signalled when a worker frees up or
+                                       a queue moves. */
+};
+
+/**
+ * @brief Returns the name of a priority class.
+ *
+ * @param class Class to name.
+ * @return const char* "interactive" or "bulk".
+ */
+const char *http_class_name(enum http_class class);
+
+/**
+ * @brief Fills in the capacity `serve` uses by default.
+ *
+ * One worker per processor, at least two, with a quarter of them (at least
+ * one) kept for interactive requests, no connection limit and no
+ * coalescing.
+ *
+ * @param options Receives the defaults.
+ */
+void http_options_default(struct http_options *options);
+
+/**
+ * @brief Bytes one connection holds besides its conversion context.
+ *
+ * @return size_t Request and response buffers of a connection.
+ */
+size_t http_connection_bytes(void);
+
+/**
+ * @brief Binds a loopback port and starts serving it.
+ *
+ * @param server Server to start.
+ * @param port TCP port on 127.0.0.1, or 0 for any free port.
+ * @param options Capacity of the server, or NULL for no limits.
+ * @return int The bound port on success, -1 if the port could not be bound
+ *         or the thread not started. The reason is printed to stderr.
+ */
+int http_server_start(struct http_server *server, int port,
+                      const struct http_options *options);
+
+/**
+ * @brief Blocks until the server stops accepting connections.
+ *
+ * @param server Server started by `http_server_start`.
+ */
+void http_server_wait(struct http_server *server);
+
+/**
+ * @brief Stops accepting connections and waits for the server thread.
+ *
+ * Connections already open are served to completion on their own threads.
+ * With a connection limit, workers or a batch budget the call also waits
+ * for them, since they report back to the server when they end.
+ *
+ * @param server Server started by `http_server_start`.
+ */
+void http_server_stop(struct http_server *server);
+
+#endif
@@ -0,0 +1,358 @@
+/**
+ * @file latency.c
+ * @brief Per-thread HDR-style latency histograms.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "latency.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SUB_COUNT (1u << LATENCY_SUB_BITS)
+
+/**
+ * @brief Histograms owned by one recording thread.
+ */
+struct latency_thread {
+  struct latency_histogram metrics[LATENCY_METRICS];
+  struct latency_thread *next; // Next live thread
+};
+
+static const char *const metric_names[LATENCY_METRICS] = {
+    "block", "read", "convert", "format", "write", "request", "interactive",
+    "bulk"};
+
+static const struct {
+  const char *label; // Column heading
+  const char *key;   // JSON key
+  double quantile;
+} percentiles[] = {{"p50", "p50", 0.5},      {"p90", "p90", 0.9},
+                   {"p99", "p99", 0.99},     {"p99.9", "p999", 0.999},
+                   {"p99.99", "p9999", 0.9999}};
+
+#define PERCENTILE_COUNT (sizeof(percentiles) / sizeof(percentiles[0]))
+
+static pthread_mutex_t threads_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct latency_thread *threads; // Live threads, under threads_lock
+static struct latency_thread retired;  // Samples of threads that exited
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t thread_key; // Its destructor retires a thread
+static _Thread_local struct latency_thread *local;
+static int enabled;
+static const char *report_path;
+static volatile sig_atomic_t report_requested;
+
+static unsigned bucket_of(uint64_t value) {
+  if (value < SUB_COUNT) {
+    return (unsigned)value;
+  }
+  // Power of two above the linear range, then the sub-bucket within it
+  unsigned shift = (unsigned)(63 - __builtin_clzll(value)) - LATENCY_SUB_BITS;
+  return ((shift + 1) << LATENCY_SUB_BITS) +
+         (unsigned)(value >> shift) - SUB_COUNT;
+}
+
+static uint64_t bucket_upper(unsigned bucket) {
+  if (bucket < SUB_COUNT) {
+    return bucket;
+  }
+  unsigned shift = (bucket >> LATENCY_SUB_BITS) - 1;
+  uint64_t low = (uint64_t)(SUB_COUNT + (bucket & (SUB_COUNT - 1))) << shift;
+  return low + ((UINT64_C(1) << shift) - 1);
+}
+
+// Only the owning thread writes, so a load and store replace a locked add
+static void bump(_Atomic uint64_t *counter, uint64_t amount) {
+  uint64_t value = atomic_load_explicit(counter, memory_order_relaxed);
+  atomic_store_explicit(counter, value + amount, memory_order_relaxed);
+}
+
+static void add_histogram(struct latency_histogram *merged,
+                          const struct latency_histogram *histogram) {
+  for (unsigned i = 0; i < LATENCY_BUCKETS; i++) {
+    bump(&merged->counts[i],
+         atomic_load_explicit(&histogram->counts[i], memory_order_relaxed));
+  }
+  bump(&merged->total,
+       atomic_load_explicit(&histogram->total, memory_order_relaxed));
+  bump(&merged->sum,
+       atomic_load_explicit(&histogram->sum, memory_order_relaxed));
+
+  uint64_t max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+  if (max > atomic_load_explicit(&merged->max, memory_order_relaxed)) {
+    atomic_store_explicit(&merged->max, max, memory_order_relaxed);
+  }
+}
+
+/**
+ * @brief Folds the histograms of an exiting thread into the retired totals
+ *        and frees them, so short-lived threads do not pile up.
+ */
+static void retire_thread(void *data) {
+  struct latency_thread *thread = (struct latency_thread *)data;
+
+  pthread_mutex_lock(&threads_lock);
+  for (int m = 0; m < LATENCY_METRICS; m++) {
+    add_histogram(&retired.metrics[m], &thread->metrics[m]);
+  }
+  for (struct latency_thread **link = &threads; *link;
+       link = &(*link)->next) {
+    if (*link == thread) {
+      *link = thread->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&threads_lock);
+
+  local = NULL;
+  free(thread);
+}
+
+static void create_key(void) {
+  if (pthread_key_create(&thread_key, retire_thread)) {
+    perror("pthread_key_create");
+  }
+}
+
+static struct latency_thread *register_thread(void) {
+  struct latency_thread *thread =
+      (struct latency_thread *)calloc(1, sizeof(*thread));
+  if (!thread) {
+    perror("Memory allocation error.\n");
+    return NULL;
+  }
+
+  pthread_once(&key_once, create_key);
+  pthread_mutex_lock(&threads_lock);
+  thread->next = threads;
+  threads = thread;
+  pthread_mutex_unlock(&threads_lock);
+  pthread_setspecific(thread_key, thread);
+  local = thread;
+  return thread;
+}
+
+static void request_report(int signal_number) {
+  (void)signal_number;
+  report_requested = 1;
+}
+
+/**
+ * @brief Turns recording on and installs the SIGUSR1 handler.
+ *
+ * @param json_path File rewritten with a JSON report on every report, or
+ *                  NULL for the text table only.
+ * @return int 0 on success, -1 if the handler could not be installed.
+ */
+int latency_enable(const char *json_path) {
+  struct sigaction action;
+
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = request_report;
+  action.sa_flags = SA_RESTART; // Keep blocking reads going
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGUSR1, &action, NULL)) {
+    perror("sigaction");
+    return -1;
+  }
+
+  report_path = json_path;
+  enabled = 1;
+  return 0;
+}
+
+/**
+ * @brief Tells whether recording was turned on by `latency_enable`.
+ *
+ * @return int Non-zero when latencies should be recorded.
+ */
+int latency_enabled(void) { return enabled; }
+
+/**
+ * @brief Reads the monotonic clock.
+ *
+ * @return uint64_t Nanoseconds since an arbitrary fixed point.
+ */
+uint64_t latency_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * @brief Adds a sample to the calling thread's histogram of a metric.
+ *
+ * @param metric Metric the sample belongs to.
+ * @param nanoseconds Measured latency.
+ */
+void latency_record(enum latency_metric metric, uint64_t nanoseconds) {
+  struct latency_thread *thread = local ? local : register_thread();
+  if (!thread) {
+    return;
+  }
+
+  struct latency_histogram *histogram = &thread->metrics[metric];
+  bump(&histogram->counts[bucket_of(nanoseconds)], 1);
+  bump(&histogram->total, 1);
+  bump(&histogram->sum, nanoseconds);
+  if (nanoseconds > atomic_load_explicit(&histogram->max,
+                                         memory_order_relaxed)) {
+    atomic_store_explicit(&histogram->max, nanoseconds, memory_order_relaxed);
+  }
+}
+
+/**
+ * @brief Sums the histograms of all threads for one metric.
+ *
+ * @param metric Metric to merge.
+ * @param merged Receives the merged histogram.
+ */
+void latency_merge(enum latency_metric metric,
+                   struct latency_histogram *merged) {
+  memset(merged, 0, sizeof(*merged));
+
+  pthread_mutex_lock(&threads_lock);
+  add_histogram(merged, &retired.metrics[metric]);
+  for (struct latency_thread *thread = threads; thread;
+       thread = thread->next) {
+    add_histogram(merged, &thread->metrics[metric]);
+  }
+  pthread_mutex_unlock(&threads_lock);
+}
+
+/**
+ * @brief Finds the latency at or below which a fraction of samples fall.
+ *
+ * @param histogram Histogram to query.
+ * @param quantile Fraction of samples, from 0 to 1.
+ * @return uint64_t Upper bound of the bucket holding the quantile, capped at
+ *         the largest sample; 0 for an empty histogram.
+ */
+uint64_t latency_quantile(const struct latency_histogram *histogram,
+                          double quantile) {
+  uint64_t total = atomic_load_explicit(&histogram->total,
+                                        memory_order_relaxed);
+  uint64_t max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+  uint64_t rank = (uint64_t)(quantile * (double)total + 0.5);
+  uint64_t seen = 0;
+
+  if (!total) {
+    return 0;
+  }
+  if (rank < 1) {
+    rank = 1;
+  }
+
+  for (unsigned i = 0; i < LATENCY_BUCKETS; i++) {
+    seen += atomic_load_explicit(&histogram->counts[i], memory_order_relaxed);
+    if (seen >= rank) {
+      uint64_t upper = bucket_upper(i);
+      return upper < max ? upper : max;
+    }
+  }
+  return max;
+}
+
+static void print_table(FILE *out, struct latency_histogram *merged) {
+  fprintf(out, "%-11s %10s %10s", "stage", "count", "mean");
+  for (size_t p = 0; p < PERCENTILE_COUNT; p++) {
+    fprintf(out, " %10s", percentiles[p].label);
+  }
+  fprintf(out, " %10s  (microseconds)\n", "max");
+
+  for (int m = 0; m < LATENCY_METRICS; m++) {
+    latency_merge((enum latency_metric)m, merged);
+    uint64_t total = atomic_load_explicit(&merged->total, memory_order_relaxed);
+    if (!total) {
+      continue;
+    }
+
+    fprintf(out, "%-11s %10llu %10.1f", metric_names[m],
+            (unsigned long long)total,
+            (double)atomic_load_explicit(&merged->sum, memory_order_relaxed) /
+                (double)total / 1e3);
+    for (size_t p = 0; p < PERCENTILE_COUNT; p++) {
+      fprintf(out, " %10.1f",
+              (double)latency_quantile(merged, percentiles[p].quantile) / 1e3);
+    }
+    fprintf(out, " %10.1f\n",
+            (double)atomic_load_explicit(&merged->max, memory_order_relaxed) /
+                1e3);
+  }
+}
+
+static int write_json(const char *path, struct latency_histogram *merged) {
+  FILE *out = fopen(path, "w");
+  if (!out) {
+    perror(path);
+    return -1;
+  }
+
+  fprintf(out, "{\"unit\": \"ns\", \"metrics\": {");
+  for (int m = 0; m < LATENCY_METRICS; m++) {
+    latency_merge((enum latency_metric)m, merged);
+    uint64_t total = atomic_load_explicit(&merged->total, memory_order_relaxed);
+    uint64_t sum = atomic_load_explicit(&merged->sum, memory_order_relaxed);
+
+    fprintf(out, "%s\n  \"%s\": {\"count\": %llu, \"mean\": %.1f",
+            m ? "," : "", metric_names[m], (unsigned long long)total,
+            total ? (double)sum / (double)total : 0.0);
+    for (size_t p = 0; p < PERCENTILE_COUNT; p++) {
+      fprintf(out, ", \"%s\": %llu", percentiles[p].key,
+              (unsigned long long)latency_quantile(merged,
+                                                   percentiles[p].quantile));
+    }
+    fprintf(out, ", \"max\": %llu}",
+            (unsigned long long)atomic_load_explicit(&merged->max,
+                                                     memory_order_relaxed));
+  }
+  fprintf(out, "\n}}\n");
+
+  if (fclose(out)) {
+    perror(path);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Prints the percentile table of every metric and writes the JSON
+ *        report if one was requested.
+ *
+ * @param out Stream for the table.
+ * @return int 0 on success, -1 if the JSON file could not be written.
+ */
+int latency_report(FILE *out) {
+  struct latency_histogram *merged =
+      (struct latency_histogram *)malloc(sizeof(*merged));
+  int status = 0;
+
+  if (!merged) {
+    perror("Memory allocation error.\n");
+    return -1;
+  }
+  print_table(out, merged);
+  if (report_path) {
+    status = write_json(report_path, merged);
+  }
+  free(merged);
+  return status;
+}
+
+/**
+ * @brief Prints a report to stderr if SIGUSR1 arrived since the last call.
+ *
+ * Signal handlers cannot safely print, so the handler only sets a flag and
+ * the converter polls it between blocks.
+ */
+void latency_poll(void) {
+  if (report_requested) {
+    report_requested = 0;
+    latency_report(stderr);
+  }
+}
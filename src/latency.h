@@ -0,0 +1,131 @@
+/**
+ * @file latency.h
+ * @brief Per-thread HDR-style latency histograms.
+ *
+ * Latencies are counted in log-linear buckets: values below
+ * 2^`LATENCY_SUB_BITS` nanoseconds get a bucket each, and every further
+ * power of two is split into 2^`LATENCY_SUB_BITS` equal buckets, so any
+ * recorded value is known to within 1/32 (about 3%) over the whole 64-bit
+ * range.
+ *
+ * Every thread records into its own histograms, which it registers once on a
+ * list. Recording is a plain relaxed load and store on memory no other thread
+ * writes, so it never contends; readers merge all registered histograms with
+ * relaxed loads and may see a sample in flight, never a torn one. When a
+ * thread exits, its samples are folded into a retired total and its
+ * histograms freed, so a server that runs a thread per connection keeps a
+ * fixed footprint. Only registration, exit and merging take the list's lock.
+ *
+ * Reports are printed as percentile tables and written as JSON on demand: at
+ * exit, and whenever the process receives SIGUSR1 once the recording thread
+ * next calls `latency_poll`.
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/** @brief Bits of linear sub-bucket resolution per power of two. */
+#define LATENCY_SUB_BITS 5
+
+/** @brief Number of buckets covering every 64-bit nanosecond count. */
+#define LATENCY_BUCKETS ((64 - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+
+/**
+ * @brief Latencies tracked by the converter.
+ */
+enum latency_metric {
+  LATENCY_BLOCK,       /**< One block through every stage. */
+  LATENCY_READ,        /**< Read stage of a block. */
+  LATENCY_CONVERT,     /**< Convert stage of a block. */
+  LATENCY_FORMAT,      /**< Format stage of a block. */
+  LATENCY_WRITE,       /**< Write stage of a block. */
+  LATENCY_REQUEST,     /**< One HTTP conversion request, head to last byte. */
+  LATENCY_INTERACTIVE, /**< Interactive conversion requests, then one
+                            metric per `http_class`. */
+  LATENCY_BULK,        /**< Bulk conversion requests. */
+  LATENCY_METRICS,     /**< Number of metrics. */
+};
+
+/**
+ * @brief Log-linear histogram of nanosecond latencies.
+ */
+struct latency_histogram {
+  _Atomic uint64_t counts[LATENCY_BUCKETS]; /**< Samples per bucket. */
+  _Atomic uint64_t total;                   /**< Number of samples. */
+  _Atomic uint64_t sum;                     /**< Sum of all samples. */
+  _Atomic uint64_t max;                     /**< Largest sample. */
+};
+
+/**
+ * @brief Turns recording on and installs the SIGUSR1 handler.
+ *
+ * @param json_path File rewritten with a JSON report on every report, or
+ *                  NULL for the text table only.
+ * @return int 0 on success, -1 if the handler could not be installed.
+ */
+int latency_enable(const char *json_path);
+
+/**
+ * @brief Tells whether recording was turned on by `latency_enable`.
+ *
+ * @return int Non-zero when latencies should be recorded.
+ */
+int latency_enabled(void);
+
+/**
+ * @brief Reads the monotonic clock.
+ *
+ * @return uint64_t Nanoseconds since an arbitrary fixed point.
+ */
+uint64_t latency_now(void);
+
+/**
+ * @brief Adds a sample to the calling thread's histogram of a metric.
+ *
+ * @param metric Metric the sample belongs to.
+ * @param nanoseconds Measured latency.
+ */
+void latency_record(enum latency_metric metric, uint64_t nanoseconds);
+
+/**
+ * @brief Sums the histograms of all threads for one metric.
+ *
+ * @param metric Metric to merge.
+ * @param merged Receives the merged histogram.
+ */
+void latency_merge(enum latency_metric metric,
+                   struct latency_histogram *merged);
+
+/**
+ * @brief Finds the latency at or below which a fraction of samples fall.
+ *
+ * @param histogram Histogram to query.
+ * @param quantile Fraction of samples, from 0 to 1.
+ * @return uint64_t Upper bound of the bucket holding the quantile, capped at
+ *         the largest sample; 0 for an empty histogram.
+ */
+uint64_t latency_quantile(const struct latency_histogram *histogram,
+                          double quantile);
+
+/**
+ * @brief Prints the percentile table of every metric and writes the JSON
+ *        report if one was requested.
+ *
+ * @param out Stream for the table.
+ * @return int 0 on success, -1 if the JSON file could not be written.
+ */
+int latency_report(FILE *out);
+
+/**
+ * @brief Prints a report to stderr if SIGUSR1 arrived since the last call.
+ *
+ * Signal handlers cannot safely print, so the handler only sets a flag and
+ * the converter polls it between blocks.
+ */
+void latency_poll(void);
+
+#endif
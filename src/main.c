@@ -62,10 +62,28 @@
  * @date 22/02/2025
  */
 
+#define _POSIX_C_SOURCE 200809L // readlink()
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "corpus.h"
+#include "float_word.h"
+#include "http.h"
+#include "latency.h"
+#include "memory_limit.h"
+#include "metrics.h"
+#include "parallel.h"
+#include "shard.h"
+#include "stream.h"
+#include "tuning.h"
 
 /**
  * @brief Splits a binary float string into sign, exponent, and fraction parts.
@@ -118,17 +136,356 @@ float parse_bits(char *binary_string, int is_fractional);
  */
 double convert_ieee_float(char **full_float);
 
+/**
+ * @brief Prints the command line usage to the given stream.
+ *
+ * @param out Stream to print to.
+ * @param program Name the program was invoked with.
+ */
+void print_usage(FILE *out, const char *program);
+
+/**
+ * @brief Converts stdin to stdout in batch mode.
+ *
+ * @param options Conversion options.
+ * @param report Print how the input was read to stderr afterwards.
+ * @param checksum Receives the XXH3-64 of the output when
+ *                 `options->checksum` is set.
+ * @return int 0 on success, -1 if the conversion failed.
+ */
+int convert_stdin(const struct stream_options *options, int report,
+                  uint64_t *checksum);
+
+/**
+ * @brief Prints the checksum of the output to stderr.
+ *
+ * @param checksum XXH3-64 of everything written to stdout.
+ * @param path File to also write it to in the `xxhsum -H3` format, naming
+ *             stdout by its path, or NULL.
+ * @return int 0 on success, -1 if the file could not be written.
+ */
+int report_checksum(uint64_t checksum, const char *path);
+
+/**
+ * @brief Applies a memory plan to the helper threads and the tuning.
+ *
+ * @param plan Plan from `memory_plan_convert` or `memory_plan_serve`, or NULL
+ *             for no limit.
+ * @param pin Pin the helper threads to processors.
+ * @param options Receives the tuning for the planned thread count.
+ */
+void apply_memory_plan(const struct memory_plan *plan, int pin,
+                       struct stream_options *options);
+
+/**
+ * @brief Prints the peak resident size of the process to stderr.
+ *
+ * @param limit Memory limit to compare it with, or 0 for none.
+ */
+void report_memory(uint64_t limit);
+
 /**
  * @brief Main function of the binary float to decimal converter program.
  *
- * Prompts the user to enter a 32-bit binary floating-point number,
- * converts it to its decimal representation, and prints the result.
+ * Without arguments, prompts the user to enter a 32-bit binary floating-point
+ * number, converts it to its decimal representation, and prints the result.
+ * With arguments, converts a whole stream from stdin to stdout in batch mode.
  *
  * @param argc Integer argument count.
  * @param argv Character array of argument strings.
- * @return int Returns 0 if the program executes successfully.
+ * @return int Returns 0 if the program executes successfully, 1 on invalid
+ *         arguments or a failed batch conversion.
  */
 int main(int argc, char *argv[]) {
+  if (argc > 1) {
+    static const struct option long_options[] = {
+        {"width", required_argument, NULL, 'w'},
+        {"input", required_argument, NULL, 'i'},
+        {"output", required_argument, NULL, 'o'},
+        {"format", required_argument, NULL, 'f'},
+        {"separator", required_argument, NULL, 's'},
+        {"distribution", required_argument, NULL, 'd'},
+        {"count", required_argument, NULL, 'n'},
+        {"seed", required_argument, NULL, 'S'},
+        {"latency", no_argument, NULL, 'L'},
+        {"latency-json", required_argument, NULL, 'J'},
+        {"metrics", required_argument, NULL, 'M'},
+        {"latency-budget", required_argument, NULL, 'T'},
+        {"port", required_argument, NULL, 'p'},
+        {"workers", required_argument, NULL, 'W'},
+        {"interactive", required_argument, NULL, 'I'},
+        {"calibrate", no_argument, NULL, 'C'},
+        {"pin", no_argument, NULL, 'P'},
+        {"read", required_argument, NULL, 'r'},
+        {"read-size", required_argument, NULL, 'R'},
+        {"shard", required_argument, NULL, 'k'},
+        {"manifest", required_argument, NULL, 'm'},
+        {"max-memory", required_argument, NULL, 'x'},
+        {"on-error", required_argument, NULL, 'e'},
+        {"error-report", required_argument, NULL, 'E'},
+        {"checksum", optional_argument, NULL, 'H'},
+        {"verify", required_argument, NULL, 'V'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}};
+    struct stream_options options = {
+        .width = 32, .input = STREAM_BITS, .output = STREAM_DECIMAL};
+    int generate = strcmp(argv[1], "gen") == 0;
+    int serve = strcmp(argv[1], "serve") == 0;
+    int port = 8080;
+    int latency = 0;
+    const char *latency_json = NULL;
+    struct http_server server;
+    struct http_options http;
+    int metrics_port = -1;
+    size_t shard_index = 0, shard_count = 0;
+    const char *manifest = NULL;
+    uint64_t max_memory = 0;
+    const char *reject_path = NULL;
+    const char *checksum_path = NULL;
+    uint64_t checksum;
+    struct memory_plan plan;
+    char *end;
+    int pin = 0;
+    int status, opt;
+
+    options.corpus.count = 1000000;
+    options.corpus.seed = 1;
+    http_options_default(&http);
+    if (strcmp(argv[1], "merge") == 0) {
+      if (argc != 3) {
+        print_usage(stderr, argv[0]);
+        return 1;
+      }
+      return shard_merge(argv[2], STDOUT_FILENO) ? 1 : 0;
+    }
+    if (generate) {
+      options.input = STREAM_GEN;
+      options.output = STREAM_BITS;
+      optind = 2;
+    } else if (serve) {
+      optind = 2;
+    }
+
+    while ((opt = getopt_long(argc, argv,
+                              "w:i:o:f:s:d:n:S:LJ:M:T:p:W:I:"
+                              "CPr:R:k:m:x:e:E:H::V:h",
+                              long_options, NULL)) != -1) {
+      switch (opt) {
+      case 'w':
+        options.width = atoi(optarg);
+        if (!float_layout_for(options.width)) {
+          fprintf(stderr, "Width must be 32 or 64\n");
+          return 1;
+        }
+        break;
+      case 'i':
+        if (generate || stream_format_from_name(optarg, &options.input) ||
+            options.input == STREAM_DECIMAL ||
+            options.input == STREAM_EXPLAIN) {
+          fprintf(stderr, "Unknown input format: %s\n", optarg);
+          return 1;
+        }
+        break;
+      case 'o':
+        if (stream_format_from_name(optarg, &options.output)) {
+          fprintf(stderr, "Unknown output format: %s\n", optarg);
+          return 1;
+        }
+        break;
+      case 'f':
+        options.output = STREAM_TEMPLATE;
+        options.template_spec = optarg;
+        break;
+      case 's':
+        options.separator = optarg[0];
+        break;
+      case 'd':
+        if (corpus_distribution_from_name(optarg,
+                                          &options.corpus.distribution)) {
+          fprintf(stderr, "Unknown distribution: %s\n", optarg);
+          return 1;
+        }
+        break;
+      case 'n':
+        options.corpus.count = strtoull(optarg, NULL, 0);
+        break;
+      case 'S':
+        options.corpus.seed = strtoull(optarg, NULL, 0);
+        break;
+      case 'J':
+        latency_json = optarg;
+        // fall through
+      case 'L':
+        latency = 1;
+        break;
+      case 'M':
+        metrics_port = atoi(optarg);
+        break;
+      case 'T':
+        options.latency_budget_us = strtoull(optarg, NULL, 0);
+        break;
+      case 'p':
+        port = atoi(optarg);
+        break;
+      case 'W':
+        http.workers = strtoull(optarg, NULL, 0);
+        break;
+      case 'I':
+        http.interactive = strtoull(optarg, NULL, 0);
+        break;
+      case 'C':
+        return tuning_calibrate(stderr) ? 1 : 0;
+      case 'P':
+        pin = 1;
+        break;
+      case 'r':
+        if (stream_read_from_name(optarg, &options.read_mode)) {
+          fprintf(stderr, "Unknown read mode: %s\n", optarg);
+          return 1;
+        }
+        break;
+      case 'R':
+        options.read_bytes = strtoull(optarg, NULL, 0);
+        if (options.read_bytes < 4096) {
+          fprintf(stderr, "Read size must be at least 4096 bytes\n");
+          return 1;
+        }
+        break;
+      case 'k':
+        if (shard_parse(optarg, &shard_index, &shard_count)) {
+          fprintf(stderr, "Shard must be I/N with I below N: %s\n", optarg);
+          return 1;
+        }
+        break;
+      case 'm':
+        manifest = optarg;
+        break;
+      case 'e':
+        if (stream_rejects_from_name(optarg, &options.rejects)) {
+          fprintf(stderr, "Unknown error policy: %s\n", optarg);
+          return 1;
+        }
+        break;
+      case 'E':
+        reject_path = optarg;
+        break;
+      case 'H':
+        options.checksum = 1;
+        checksum_path = optarg;
+        break;
+      case 'V':
+        options.verify_rate = strtod(optarg, &end);
+        if (*end || !(options.verify_rate >= 0 && options.verify_rate <= 1)) {
+          fprintf(stderr, "Verify rate must be from 0 to 1: %s\n", optarg);
+          return 1;
+        }
+        options.verify_log = stderr;
+        break;
+      case 'x':
+        if (memory_limit_parse(optarg, &max_memory)) {
+          fprintf(stderr, "Memory limit must be a size such as 512M: %s\n",
+                  optarg);
+          return 1;
+        }
+        break;
+      case 'h':
+        print_usage(stdout, argv[0]);
+        return 0;
+      default:
+        print_usage(stderr, argv[0]);
+        return 1;
+      }
+    }
+
+    if (latency && latency_enable(latency_json)) {
+      return 1;
+    }
+    if (options.verify_rate > 0 && options.output != STREAM_DECIMAL) {
+      fprintf(stderr, "--verify checks decimal output only\n");
+      return 1;
+    }
+    if (serve) {
+      if (!http.workers || http.interactive >= http.workers) {
+        fprintf(stderr, "Workers must outnumber the interactive ones\n");
+        return 1;
+      }
+      metrics_enable();
+      http.batch_us = options.latency_budget_us;
+      if (max_memory) {
+        memory_plan_serve(max_memory, &plan);
+        http.max_connections = plan.connections;
+      }
+      apply_memory_plan(max_memory ? &plan : NULL, pin, &options);
+      if ((port = http_server_start(&server, port, &http)) < 0) {
+        return 1;
+      }
+      fprintf(stderr, "Serving http://127.0.0.1:%d/convert\n", port);
+      fprintf(stderr, "Workers: %zu, %zu kept for interactive requests\n",
+              http.workers, http.interactive);
+      if (max_memory) {
+        fprintf(stderr, "Connections served at once: %zu\n",
+                plan.connections);
+      }
+      http_server_wait(&server);
+      if (max_memory || latency) {
+        report_memory(max_memory);
+      }
+      return 0;
+    }
+    if (metrics_port >= 0) {
+      metrics_enable();
+      if (http_server_start(&server, metrics_port, NULL) < 0) {
+        return 1;
+      }
+    }
+    if (max_memory) {
+      memory_plan_convert(max_memory, &options, &plan);
+    }
+    apply_memory_plan(max_memory ? &plan : NULL, pin, &options);
+    if (reject_path) {
+      if (!(options.reject_report = fopen(reject_path, "w"))) {
+        perror(reject_path);
+        return 1;
+      }
+      fputs("offset,record,reason\n", options.reject_report);
+    }
+    if (shard_count && !manifest) {
+      fprintf(stderr, "--shard needs a --manifest to record the shard in\n");
+      return 1;
+    } else if (shard_count) {
+      status = shard_convert(&options, shard_index, shard_count, manifest,
+                             stdin, stdout, &checksum)
+                   ? 1
+                   : 0;
+    } else {
+      status = convert_stdin(&options, latency, &checksum) ? 1 : 0;
+    }
+    // The tail of the output is still buffered, and can fail to be written
+    if (fflush(stdout) || ferror(stdout)) {
+      perror("stdout");
+      status = 1;
+    }
+    // A failed conversion leaves a partial output not worth a checksum
+    if (options.checksum && status == 0 &&
+        report_checksum(checksum, checksum_path)) {
+      status = 1;
+    }
+    if (options.reject_report && fclose(options.reject_report)) {
+      perror(reject_path);
+      status = 1;
+    }
+    if (metrics_port >= 0) {
+      http_server_stop(&server);
+    }
+    if (latency && latency_report(stderr)) {
+      status = 1;
+    }
+    if (max_memory || latency) {
+      report_memory(max_memory);
+    }
+    return status;
+  }
+
   printf("Insert the binary float: ");
 
   char user_binary_float[33];
@@ -148,6 +505,109 @@ int main(int argc, char *argv[]) {
   return 0;
 }
 
+/**
+ * @brief Prints the command line usage to the given stream.
+ *
+ * @param out Stream to print to.
+ * @param program Name the program was invoked with.
+ */
+void print_usage(FILE *out, const char *program) {
+  fprintf(out,
+          "Usage: %s [options] < input > output\n"
+          "       %s gen [options] > output\n"
+          "       %s serve [-p PORT]\n"
+          "       %s merge MANIFEST > output\n"
+          "Without options, prompts for a single 32-bit binary float.\n"
+          "\n"
+          "  -w, --width=32|64   binary32 or binary64 records (default 32)\n"
+          "  -i, --input=FORMAT  bits (default), xor or raw\n"
+          "  -o, --output=FORMAT decimal (default), bits, xor, explain or raw\n"
+          "  -f, --format=TEMPLATE\n"
+          "                      print each record as TEMPLATE, e.g.\n"
+          "                      '{bits},{value:sci},{exponent},{class}'\n"
+          "  -s, --separator=C   separate sign, exponent and fraction with C\n"
+          "                      in bits output\n"
+          "  -T, --latency-budget=MICROSECONDS\n"
+          "                      convert and flush a partly filled block once\n"
+          "                      its first text or raw record has waited this\n"
+          "                      long (default: wait for full blocks)\n"
+          "  -L, --latency       print per-stage latency percentiles to\n"
+          "                      stderr at exit and on SIGUSR1\n"
+          "  -J, --latency-json=FILE\n"
+          "                      also write them to FILE as JSON\n"
+          "  -M, --metrics=PORT  serve Prometheus metrics at\n"
+          "                      http://127.0.0.1:PORT/metrics while running\n"
+          "  -C, --calibrate     measure when to split blocks across threads\n"
+          "                      and which bit renderer is fastest, save the\n"
+          "                      result for later runs and exit\n"
+          "  -P, --pin           pin helper threads to processors 1, 2, ...\n"
+          "  -r, --read=MODE     read an input file buffered (default),\n"
+          "                      sequential (drop pages once read) or\n"
+          "                      direct (O_DIRECT, bypassing the cache)\n"
+          "  -R, --read-size=BYTES\n"
+          "                      bytes per read (default 65536); -L also\n"
+          "                      reports read counts and time\n"
+          "  -k, --shard=I/N     convert only the I-th of N record-aligned\n"
+          "                      parts of a bits or raw input file (I from\n"
+          "                      0); the output must be a file\n"
+          "  -m, --manifest=FILE record the shard's output in FILE, whose\n"
+          "                      shards merge combines in order\n"
+          "  -e, --on-error=POLICY\n"
+          "                      fail at the first malformed text or raw\n"
+          "                      record (default), skip it, or write a\n"
+          "                      quiet nan in its place\n"
+          "  -E, --error-report=FILE\n"
+          "                      list skipped records in FILE as CSV:\n"
+          "                      offset,record,reason\n"
+          "  -H, --checksum[=FILE]\n"
+          "                      print the XXH3-64 of the output, hashed as\n"
+          "                      it is written; also write it to FILE in\n"
+          "                      the xxhsum -H3 format\n"
+          "  -V, --verify=RATE   reparse this fraction of decimal output\n"
+          "                      (0 to 1) and report values that do not\n"
+          "                      read back as the same bits\n"
+          "  -x, --max-memory=BYTES\n"
+          "                      size blocks, reads, threads and serve\n"
+          "                      connections to stay under BYTES (K, M, G\n"
+          "                      suffixes); -x or -L print the peak RSS\n"
+          "\n"
+          "gen writes a reproducible synthetic corpus (bits by default):\n"
+          "  -d, --distribution=NAME uniform (default), normal, subnormal,\n"
+          "                          nan or repeat\n"
+          "  -n, --count=N           number of values (default 1000000)\n"
+          "  -S, --seed=N            PRNG seed (default 1)\n"
+          "  -h, --help          show this help\n"
+          "\n"
+          "serve answers POST /convert?input=..&output=.. and GET /metrics\n"
+          "over HTTP/1.1 on 127.0.0.1:\n"
+          "  -p, --port=PORT         TCP port (default 8080)\n"
+          "  -W, --workers=N         conversions run at once (default: one\n"
+          "                          per processor, at least 2)\n"
+          "  -I, --interactive=N     workers bulk requests leave free for\n"
+          "                          interactive ones (default: a quarter,\n"
+          "                          at least 1); a request is bulk when its\n"
+          "                          body passes 64 KiB or it asks for\n"
+          "                          class=bulk\n"
+          "  -T, --latency-budget=MICROSECONDS\n"
+          "                          wait this long for requests of at most\n"
+          "                          4 KiB with the same options and convert\n"
+          "                          them together (default: each alone)\n"
+          "  -x, --max-memory=BYTES  also limits connections served at once\n"
+          "\n"
+          "Formats:\n"
+          "  bits     one string of '0's and '1's per line\n"
+          "  decimal  one round-trippable decimal value per line\n"
+          "  xor      Gorilla-style XOR-delta compressed binary stream\n"
+          "  explain  fixed-width sign, exponent bits, fraction bits,\n"
+          "           unbiased exponent and integer significand per line\n"
+          "  raw      native binary32 or binary64 array\n"
+          "\n"
+          "Template fields: {bits} {hex} {sign} {exponent_bits}\n"
+          "  {fraction_bits} {exponent} {class} {value} {value:shortest}\n"
+          "  {value:sci} {value:fixed}; {{ and }} print literal braces\n",
+          program, program, program, program);
+}
+
 /**
  * @brief Splits a binary float string into sign, exponent, and fraction parts.
  *
@@ -295,3 +755,132 @@ double convert_ieee_float(char **full_float) {
 
   return sign_part * exp_part * frac_part;
 }
+
+/**
+ * @brief Converts stdin to stdout in batch mode.
+ *
+ * @param options Conversion options.
+ * @param report Print how the input was read to stderr afterwards.
+ * @param checksum Receives the XXH3-64 of the output when
+ *                 `options->checksum` is set.
+ * @return int 0 on success, -1 if the conversion failed.
+ */
+int convert_stdin(const struct stream_options *options, int report,
+                  uint64_t *checksum) {
+  struct bf2d_ctx *ctx = bf2d_ctx_create(options);
+  int status;
+
+  if (!ctx) {
+    fprintf(stderr, "Memory allocation error.\n");
+    return -1;
+  }
+  status = bf2d_ctx_convert(ctx, stdin, stdout);
+  if (status) {
+    fprintf(stderr, "%s\n", bf2d_ctx_error(ctx));
+  }
+  *checksum = bf2d_ctx_checksum(ctx);
+  if (bf2d_ctx_stats(ctx)->rejected) {
+    fprintf(stderr, "Rejected %llu malformed records\n",
+            (unsigned long long)bf2d_ctx_stats(ctx)->rejected);
+  }
+  if (options->verify_rate > 0) {
+    fprintf(stderr, "verify: %llu values reparsed, %llu mismatches\n",
+            (unsigned long long)bf2d_ctx_stats(ctx)->verified,
+            (unsigned long long)bf2d_ctx_stats(ctx)->mismatches);
+  }
+  if (report) {
+    const struct bf2d_stats *stats = bf2d_ctx_stats(ctx);
+    double seconds = (double)stats->read_ns * 1e-9;
+    fprintf(stderr, "read: %.1f MB in %llu reads, %.3f s (%.1f MB/s)\n",
+            (double)stats->bytes_in * 1e-6, (unsigned long long)stats->reads,
+            seconds,
+            seconds > 0 ? (double)stats->bytes_in * 1e-6 / seconds : 0.0);
+  }
+  bf2d_ctx_destroy(ctx);
+  return status;
+}
+
+/**
+ * @brief Applies a memory plan to the helper threads and the tuning.
+ *
+ * @param plan Plan from `memory_plan_convert` or `memory_plan_serve`, or NULL
+ *             for no limit.
+ * @param pin Pin the helper threads to processors.
+ * @param options Receives the tuning for the planned thread count.
+ */
+void apply_memory_plan(const struct memory_plan *plan, int pin,
+                       struct stream_options *options) {
+  static struct tuning tuning;
+  struct parallel_options helpers = {plan ? plan->threads : 0,
+                                     PARALLEL_SPIN_NS, pin, 1};
+
+  if (plan || pin) {
+    parallel_configure(&helpers);
+  }
+  if (!plan) {
+    return;
+  }
+  if (!plan->fits) {
+    fprintf(stderr,
+            "Memory limit is below the %.1f MB the smallest configuration "
+            "needs; using it anyway\n",
+            (double)plan->bytes / (1 << 20));
+  }
+  // Blocks are split into no more ranges than there are threads to run them
+  tuning = *tuning_get();
+  if (tuning.threads > plan->threads) {
+    tuning.threads = plan->threads;
+  }
+  options->tuning = &tuning;
+}
+
+/**
+ * @brief Prints the peak resident size of the process to stderr.
+ *
+ * @param limit Memory limit to compare it with, or 0 for none.
+ */
+void report_memory(uint64_t limit) {
+  double peak = (double)memory_peak_bytes() / (1 << 20);
+
+  if (limit) {
+    fprintf(stderr, "memory: peak %.1f MB resident, limit %.1f MB\n", peak,
+            (double)limit / (1 << 20));
+  } else {
+    fprintf(stderr, "memory: peak %.1f MB resident\n", peak);
+  }
+}
+
+/**
+ * @brief Prints the checksum of the output to stderr.
+ *
+ * @param checksum XXH3-64 of everything written to stdout.
+ * @param path File to also write it to in the `xxhsum -H3` format, naming
+ *             stdout by its path, or NULL.
+ * @return int 0 on success, -1 if the file could not be written.
+ */
+int report_checksum(uint64_t checksum, const char *path) {
+  char name[PATH_MAX] = "-";
+  struct stat info;
+  FILE *file;
+  ssize_t length;
+
+  fprintf(stderr, "xxh3: %016" PRIx64 "\n", checksum);
+  if (!path) {
+    return 0;
+  }
+  // Only a file can be checked again later, anything else stays "-"
+  if (fstat(STDOUT_FILENO, &info) == 0 && S_ISREG(info.st_mode) &&
+      (length = readlink("/proc/self/fd/1", name, sizeof(name) - 1)) > 0) {
+    name[length] = '\0';
+  }
+  if (!(file = fopen(path, "w"))) {
+    perror(path);
+    return -1;
+  }
+  fprintf(file, "XXH3_%016" PRIx64 "  %s\n", checksum, name);
+  if (fclose(file)) {
+    perror(path);
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,225 @@
+/**
+ * @file memory_limit.c
+ * @brief Sizing of blocks, reads, threads and connections under a memory cap.
+ */
+
+#include "memory_limit.h"
+
+#include "http.h"
+#include "parallel.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#define MODERATE_BLOCK 1024 // Blocks shrink to this before threads are dropped
+#define MODERATE_READ 16384 // Reads likewise
+#define MIN_READ 4096       // Smallest read a context accepts
+
+/**
+ * @brief Parses a byte count with an optional K, M or G suffix.
+ *
+ * @param text Count such as "512M"; suffixes are powers of 1024.
+ * @param bytes Receives the count.
+ * @return int 0 on success, -1 if the text is malformed or zero.
+ */
+int memory_limit_parse(const char *text, uint64_t *bytes) {
+  unsigned long long value;
+  unsigned shift = 0;
+  char *end;
+
+  if (*text < '0' || *text > '9') {
+    return -1;
+  }
+  errno = 0;
+  value = strtoull(text, &end, 10);
+  if (errno) {
+    return -1;
+  }
+  switch (*end) {
+  case 'k':
+  case 'K':
+    shift = 10;
+    break;
+  case 'm':
+  case 'M':
+    shift = 20;
+    break;
+  case 'g':
+  case 'G':
+    shift = 30;
+    break;
+  }
+  end += shift ? 1 : 0;
+  if (*end || !value || value > (UINT64_MAX >> shift)) {
+    return -1;
+  }
+  *bytes = (uint64_t)value << shift;
+  return 0;
+}
+
+/**
+ * @brief Threads a loop uses before any limit, counting the caller.
+ */
+static size_t threads_wanted(void) {
+  size_t threads = parallel_cpu_count();
+  return threads > PARALLEL_MAX_HELPERS + 1 ? PARALLEL_MAX_HELPERS + 1
+                                            : threads;
+}
+
+/**
+ * @brief Halves `*value` down to no less than `floor`.
+ *
+ * @return int 1 if the value shrank, 0 if it was already at `floor`.
+ */
+static int halve(size_t *value, size_t floor) {
+  if (*value <= floor) {
+    return 0;
+  }
+  *value = *value / 2 > floor ? *value / 2 : floor;
+  return 1;
+}
+
+/**
+ * @brief Sizes a batch conversion to fit under `limit`.
+ *
+ * Shrinks blocks and reads to moderate sizes first, then drops helper
+ * threads, then shrinks blocks and reads to their minimums.
+ *
+ * @param limit Most resident bytes of the whole process.
+ * @param options Conversion options; `block_values` and `read_bytes` are
+ *                lowered to fit.
+ * @param plan Receives the thread count and the estimate.
+ */
+void memory_plan_convert(uint64_t limit, struct stream_options *options,
+                         struct memory_plan *plan) {
+  uint64_t fixed = memory_resident_bytes() + MEMORY_LIMIT_RESERVE_BYTES;
+  size_t *block = &options->block_values;
+  size_t *read = &options->read_bytes;
+
+  if (!*block || *block > STREAM_BLOCK_VALUES) {
+    *block = STREAM_BLOCK_VALUES;
+  }
+  if (!*read) {
+    *read = STREAM_READ_BYTES;
+  }
+  plan->threads = threads_wanted();
+  plan->connections = 0;
+
+  for (;;) {
+    plan->bytes = fixed + stream_memory_bytes(options) +
+                  (uint64_t)(plan->threads - 1) * MEMORY_LIMIT_THREAD_BYTES;
+    if (plan->bytes <= limit) {
+      plan->fits = 1;
+      return;
+    }
+    if (halve(block, MODERATE_BLOCK) || halve(read, MODERATE_READ)) {
+      continue;
+    } else if (plan->threads > 1) {
+      plan->threads--;
+    } else if (!halve(block, MEMORY_LIMIT_MIN_BLOCK) &&
+               !halve(read, MIN_READ)) {
+      plan->fits = 0;
+      return;
+    }
+  }
+}
+
+/**
+ * @brief Sizes the HTTP server to fit under `limit`.
+ *
+ * Every connection is counted with its thread and a context for the widest
+ * built-in format. Helper threads are dropped when the limit leaves no room
+ * for a single connection beside them.
+ *
+ * @param limit Most resident bytes of the whole process.
+ * @param plan Receives the thread and connection counts and the estimate.
+ */
+void memory_plan_serve(uint64_t limit, struct memory_plan *plan) {
+  static const enum stream_format inputs[] = {STREAM_BITS, STREAM_XOR,
+                                              STREAM_RAW};
+  static const enum stream_format outputs[] = {
+      STREAM_BITS, STREAM_DECIMAL, STREAM_XOR, STREAM_EXPLAIN, STREAM_RAW};
+  // The accepting thread is there whatever the limit
+  uint64_t fixed = memory_resident_bytes() + MEMORY_LIMIT_RESERVE_BYTES +
+                   MEMORY_LIMIT_THREAD_BYTES;
+  uint64_t connection, used;
+  size_t context = 0;
+
+  for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+    for (size_t o = 0; o < sizeof(outputs) / sizeof(outputs[0]); o++) {
+      struct stream_options options = {
+          .width = 64, .input = inputs[i], .output = outputs[o],
+          .separator = ' '};
+      size_t bytes = stream_memory_bytes(&options);
+      context = bytes > context ? bytes : context;
+    }
+  }
+  connection = context + http_connection_bytes() + MEMORY_LIMIT_THREAD_BYTES;
+
+  plan->threads = threads_wanted();
+  for (;;) {
+    used = fixed + (uint64_t)(plan->threads - 1) * MEMORY_LIMIT_THREAD_BYTES;
+    if (used + connection <= limit || plan->threads == 1) {
+      break;
+    }
+    plan->threads--;
+  }
+  plan->fits = used + connection <= limit;
+  plan->connections = plan->fits ? (size_t)((limit - used) / connection) : 1;
+  plan->bytes = used + plan->connections * connection;
+}
+
+/**
+ * @brief Returns the resident size of the process.
+ *
+ * @return uint64_t Resident bytes now, or the peak so far where the current
+ *         size cannot be read.
+ */
+uint64_t memory_resident_bytes(void) {
+  FILE *statm = fopen("/proc/self/statm", "r");
+  unsigned long long size, resident;
+  int parsed;
+
+  if (!statm) {
+    return memory_peak_bytes();
+  }
+  parsed = fscanf(statm, "%llu %llu", &size, &resident);
+  fclose(statm);
+  if (parsed != 2) {
+    return memory_peak_bytes();
+  }
+  return (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE);
+}
+
+/**
+ * @brief Returns the largest resident size the process has reached.
+ *
+ * @return uint64_t Peak resident bytes.
+ */
+uint64_t memory_peak_bytes(void) {
+  FILE *status = fopen("/proc/self/status", "r");
+  unsigned long long peak = 0;
+  struct rusage usage;
+  char line[128];
+
+  // The high-water mark of the address space, unlike `ru_maxrss`, does not
+  // carry over the size of the process that ran `execve`
+  if (status) {
+    while (fgets(line, sizeof(line), status)) {
+      if (sscanf(line, "VmHWM: %llu kB", &peak) == 1) {
+        break;
+      }
+    }
+    fclose(status);
+    if (peak) {
+      return (uint64_t)peak * 1024u;
+    }
+  }
+  if (getrusage(RUSAGE_SELF, &usage)) {
+    return 0;
+  }
+  return (uint64_t)usage.ru_maxrss * 1024u; // Reported in KiB on Linux
+}
@@ -0,0 +1,96 @@
+/**
+ * @file memory_limit.h
+ * @brief Sizing of blocks, reads, threads and connections under a memory cap.
+ *
+ * Shared ingest hosts give each process a fixed amount of memory. A plan
+ * starts from the fastest configuration and gives up the parts that hold the
+ * most memory per unit of throughput until its estimated peak fits under the
+ * limit. The estimate counts what the process already holds, every buffer a
+ * conversion context keeps (see `stream_memory_bytes`), the threads it runs
+ * and the connections it serves, plus `MEMORY_LIMIT_RESERVE_BYTES` for state
+ * allocated along the way. A limit too small for even the smallest
+ * configuration still runs, with that configuration, rather than failing.
+ *
+ * The limit sizes the process; it is not enforced by the kernel. The peak
+ * resident size actually reached is reported by `memory_peak_bytes`.
+ */
+
+#ifndef MEMORY_LIMIT_H
+#define MEMORY_LIMIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "stream.h"
+
+/** @brief Fewest values per block a limit shrinks blocks to. */
+#define MEMORY_LIMIT_MIN_BLOCK 256
+
+/** @brief Resident bytes counted per thread: touched stack and histograms. */
+#define MEMORY_LIMIT_THREAD_BYTES (256u << 10)
+
+/** @brief Resident bytes set aside for stdio buffers and lazily built state. */
+#define MEMORY_LIMIT_RESERVE_BYTES (1u << 20)
+
+/**
+ * @brief Configuration chosen to fit under a limit.
+ */
+struct memory_plan {
+  size_t threads;     /**< Threads on a split block, counting the caller. */
+  size_t connections; /**< Connections served at once, for `serve`. */
+  uint64_t bytes;     /**< Estimated peak resident bytes. */
+  int fits;           /**< 0 if even the smallest configuration exceeds the
+                           limit; it is chosen anyway. */
+};
+
+/**
+ * @brief Parses a byte count with an optional K, M or G suffix.
+ *
+ * @param text Count such as "512M"; suffixes are powers of 1024.
+ * @param bytes Receives the count.
+ * @return int 0 on success, -1 if the text is malformed or zero.
+ */
+int memory_limit_parse(const char *text, uint64_t *bytes);
+
+/**
+ * @brief Sizes a batch conversion to fit under `limit`.
+ *
+ * Shrinks blocks and reads to moderate sizes first, then drops helper
+ * threads, then shrinks blocks and reads to their minimums.
+ *
+ * @param limit Most resident bytes of the whole process.
+ * @param options Conversion options; `block_values` and `read_bytes` are
+ *                lowered to fit.
+ * @param plan Receives the thread count and the estimate.
+ */
+void memory_plan_convert(uint64_t limit, struct stream_options *options,
+                         struct memory_plan *plan);
+
+/**
+ * @brief Sizes the HTTP server to fit under `limit`.
+ *
+ * Every connection is counted with its thread and a context for the widest
+ * built-in format. Helper threads are dropped when the limit leaves no room
+ * for a single connection beside them.
+ *
+ * @param limit Most resident bytes of the whole process.
+ * @param plan Receives the thread and connection counts and the estimate.
+ */
+void memory_plan_serve(uint64_t limit, struct memory_plan *plan);
+
+/**
+ * @brief Returns the resident size of the process.
+ *
+ * @return uint64_t Resident bytes now, or the peak so far where the current
+ *         size cannot be read.
+ */
+uint64_t memory_resident_bytes(void);
+
+/**
+ * @brief Returns the largest resident size the process has reached.
+ *
+ * @return uint64_t Peak resident bytes.
+ */
+uint64_t memory_peak_bytes(void);
+
+#endif
@@ -0,0 +1,394 @@
+/**
+ * @file metrics.c
+ * @brief Process-wide counters rendered in the Prometheus text format.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "metrics.h"
+
+#include "http.h"
+#include "latency.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/**
+ * @brief Counters owned by one thread, padded to whole cache lines.
+ */
+struct metrics_shard {
+  _Alignas(METRICS_CACHE_LINE) _Atomic uint64_t counters[METRIC_COUNTERS];
+  struct metrics_shard *next; // Next live shard
+};
+
+/**
+ * @brief Text of a plain counter in the exposition.
+ */
+struct counter_text {
+  const char *name;
+  const char *help;
+};
+
+static const struct counter_text counter_texts[METRIC_CLASS_ZERO] = {
+    {"bf2d_values_total", "Values converted."},
+    {"bf2d_blocks_total", "Blocks converted."},
+    {"bf2d_input_bytes_total", "Input bytes consumed."},
+    {"bf2d_output_bytes_total", "Output bytes written."},
+    {"bf2d_requests_total", "HTTP conversion requests served."}};
+
+static const double summary_quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+static pthread_mutex_t shards_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct metrics_shard *shards;      // Live shards, under shards_lock
+static uint64_t retired[METRIC_COUNTERS]; // Counts of threads that exited
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t shard_key; // Its destructor retires a shard
+static _Thread_local struct metrics_shard *local;
+static _Atomic int64_t gauges[METRIC_GAUGES];
+static int enabled;
+static double start_time;
+
+/**
+ * @brief Appends formatted text to a bounded buffer, tracking the full length.
+ */
+struct text_buffer {
+  char *out;
+  size_t size;
+  size_t length;
+};
+
+static void append(struct text_buffer *text, const char *format, ...) {
+  va_list args;
+  size_t room = text->length < text->size ? text->size - text->length : 0;
+
+  va_start(args, format);
+  int written = vsnprintf(room ? text->out + text->length : NULL, room,
+                          format, args);
+  va_end(args);
+  if (written > 0) {
+    text->length += (size_t)written;
+  }
+}
+
+/**
+ * @brief Adds the counts of an exiting thread to the retired totals and
+ *        frees its shard.
+ */
+static void retire_shard(void *data) {
+  struct metrics_shard *shard = (struct metrics_shard *)data;
+
+  pthread_mutex_lock(&shards_lock);
+  for (int i = 0; i < METRIC_COUNTERS; i++) {
+    retired[i] +=
+        atomic_load_explicit(&shard->counters[i], memory_order_relaxed);
+  }
+  for (struct metrics_shard **link = &shards; *link; link = &(*link)->next) {
+    if (*link == shard) {
+      *link = shard->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&shards_lock);
+
+  local = NULL;
+  free(shard);
+}
+
+static void create_key(void) {
+  if (pthread_key_create(&shard_key, retire_shard)) {
+    perror("pthread_key_create");
+  }
+}
+
+static struct metrics_shard *register_shard(void) {
+  struct metrics_shard *shard;
+
+  if (posix_memalign((void **)&shard, METRICS_CACHE_LINE, sizeof(*shard))) {
+    perror("Memory allocation error.\n");
+    return NULL;
+  }
+  for (int i = 0; i < METRIC_COUNTERS; i++) {
+    atomic_init(&shard->counters[i], 0);
+  }
+
+  pthread_once(&key_once, create_key);
+  pthread_mutex_lock(&shards_lock);
+  shard->next = shards;
+  shards = shard;
+  pthread_mutex_unlock(&shards_lock);
+  pthread_setspecific(shard_key, shard);
+  local = shard;
+  return shard;
+}
+
+/**
+ * @brief Turns counting on for the rest of the process.
+ */
+void metrics_enable(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  start_time = (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+  enabled = 1;
+}
+
+/**
+ * @brief Tells whether counting was turned on by `metrics_enable`.
+ *
+ * @return int Non-zero when counters should be updated.
+ */
+int metrics_enabled(void) { return enabled; }
+
+/**
+ * @brief Adds to a counter in the calling thread's shard.
+ *
+ * @param counter Counter to increase.
+ * @param amount Amount to add.
+ */
+void metrics_add(enum metric_counter counter, uint64_t amount) {
+  struct metrics_shard *shard = local ? local : register_shard();
+  if (!shard) {
+    return;
+  }
+
+  // Only the owning thread writes, so a load and store replace a locked add
+  uint64_t value =
+      atomic_load_explicit(&shard->counters[counter], memory_order_relaxed);
+  atomic_store_explicit(&shard->counters[counter], value + amount,
+                        memory_order_relaxed);
+}
+
+/**
+ * @brief Raises or lowers a gauge.
+ *
+ * @param gauge Gauge to change.
+ * @param delta Amount to add, negative to lower it.
+ */
+void metrics_gauge_add(enum metric_gauge gauge, int64_t delta) {
+  atomic_fetch_add_explicit(&gauges[gauge], delta, memory_order_relaxed);
+}
+
+/**
+ * @brief Counts the float class of every word of a block.
+ *
+ * @param words Words to classify.
+ * @param count Number of words.
+ * @param layout Layout of the words.
+ */
+void metrics_count_classes(const uint64_t *words, size_t count,
+                           const struct float_layout *layout) {
+  uint64_t classes[FLOAT_NAN + 1] = {0};
+
+  for (size_t i = 0; i < count; i++) {
+    classes[classify_float_word(words[i], layout)]++;
+  }
+  for (int c = FLOAT_ZERO; c <= FLOAT_NAN; c++) {
+    if (classes[c]) {
+      metrics_add((enum metric_counter)(METRIC_CLASS_ZERO + c), classes[c]);
+    }
+  }
+}
+
+/**
+ * @brief Sums a counter over the shards of all threads.
+ *
+ * @param counter Counter to read.
+ * @return uint64_t Total so far.
+ */
+uint64_t metrics_total(enum metric_counter counter) {
+  uint64_t total;
+
+  pthread_mutex_lock(&shards_lock);
+  total = retired[counter];
+  for (struct metrics_shard *shard = shards; shard; shard = shard->next) {
+    total +=
+        atomic_load_explicit(&shard->counters[counter], memory_order_relaxed);
+  }
+  pthread_mutex_unlock(&shards_lock);
+  return total;
+}
+
+/**
+ * @brief Renders the summary of one latency metric.
+ *
+ * @param help Help text, or NULL to continue the summary rendered before.
+ * @param label `class` label of the series, or NULL for none.
+ */
+static void render_latency(struct text_buffer *text, enum latency_metric metric,
+                           const char *name, const char *help,
+                           const char *label,
+                           struct latency_histogram *merged) {
+  char labels[64] = "";
+
+  if (label) {
+    snprintf(labels, sizeof(labels), "class=\"%s\"", label);
+  }
+  latency_merge(metric, merged);
+  if (help) {
+    append(text, "# HELP %s %s\n# TYPE %s summary\n", name, help, name);
+  }
+  for (size_t q = 0;
+       q < sizeof(summary_quantiles) / sizeof(summary_quantiles[0]); q++) {
+    append(text, "%s{%s%squantile=\"%g\"} %.9f\n", name, labels,
+           label ? "," : "", summary_quantiles[q],
+           (double)latency_quantile(merged, summary_quantiles[q]) / 1e9);
+  }
+  append(text, "%s_sum%s%s%s %.9f\n%s_count%s%s%s %llu\n", name,
+         label ? "{" : "", labels, label ? "}" : "",
+         (double)atomic_load_explicit(&merged->sum, memory_order_relaxed) /
+             1e9,
+         name, label ? "{" : "", labels, label ? "}" : "",
+         (unsigned long long)atomic_load_explicit(&merged->total,
+                                                  memory_order_relaxed));
+}
+
+/**
+ * @brief Renders every counter in the Prometheus text exposition format.
+ *
+ * Server queue depths and running conversions are rendered per priority
+ * class. Block and request latency quantiles, the latter also by priority
+ * class, are included when latency recording is on.
+ *
+ * @param out Output buffer.
+ * @param size Size of `out` in bytes.
+ * @return size_t Length of the rendering, which is truncated if it is not
+ *         less than `size`.
+ */
+size_t metrics_render(char *out, size_t size) {
+  struct text_buffer text = {out, size, 0};
+
+  for (int c = 0; c < METRIC_CLASS_ZERO; c++) {
+    append(&text, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+           counter_texts[c].name, counter_texts[c].help,
+           counter_texts[c].name, counter_texts[c].name,
+           (unsigned long long)metrics_total((enum metric_counter)c));
+  }
+
+  append(&text, "# HELP bf2d_values_by_class_total Values converted, by "
+                "IEEE 754 class.\n"
+                "# TYPE bf2d_values_by_class_total counter\n");
+  for (int c = FLOAT_ZERO; c <= FLOAT_NAN; c++) {
+    append(&text, "bf2d_values_by_class_total{class=\"%s\"} %llu\n",
+           float_class_name((enum float_class)c),
+           (unsigned long long)metrics_total(
+               (enum metric_counter)(METRIC_CLASS_ZERO + c)));
+  }
+
+  append(&text, "# HELP bf2d_requests_by_class_total HTTP conversion "
+                "requests served, by priority class.\n"
+                "# TYPE bf2d_requests_by_class_total counter\n");
+  for (int c = 0; c < HTTP_CLASSES; c++) {
+    append(&text, "bf2d_requests_by_class_total{class=\"%s\"} %llu\n",
+           http_class_name((enum http_class)c),
+           (unsigned long long)metrics_total(
+               (enum metric_counter)(METRIC_INTERACTIVE_REQUESTS + c)));
+  }
+
+  append(&text, "# HELP bf2d_queue_depth HTTP conversions waiting for a "
+                "worker, by priority class.\n"
+                "# TYPE bf2d_queue_depth gauge\n");
+  for (int c = 0; c < HTTP_CLASSES; c++) {
+    append(&text, "bf2d_queue_depth{class=\"%s\"} %lld\n",
+           http_class_name((enum http_class)c),
+           (long long)atomic_load_explicit(&gauges[METRIC_QUEUED_INTERACTIVE +
+                                                   c],
+                                           memory_order_relaxed));
+  }
+  append(&text, "# HELP bf2d_running_conversions HTTP conversions running "
+                "on a worker, by priority class.\n"
+                "# TYPE bf2d_running_conversions gauge\n");
+  for (int c = 0; c < HTTP_CLASSES; c++) {
+    append(&text, "bf2d_running_conversions{class=\"%s\"} %lld\n",
+           http_class_name((enum http_class)c),
+           (long long)atomic_load_explicit(
+               &gauges[METRIC_RUNNING_INTERACTIVE + c], memory_order_relaxed));
+  }
+
+  append(&text,
+         "# HELP bf2d_coalesced_requests_total HTTP conversion requests "
+         "answered from a conversion shared with others.\n"
+         "# TYPE bf2d_coalesced_requests_total counter\n"
+         "bf2d_coalesced_requests_total %llu\n"
+         "# HELP bf2d_coalesced_batches_total Conversions shared by "
+         "coalesced requests.\n"
+         "# TYPE bf2d_coalesced_batches_total counter\n"
+         "bf2d_coalesced_batches_total %llu\n",
+         (unsigned long long)metrics_total(METRIC_COALESCED_REQUESTS),
+         (unsigned long long)metrics_total(METRIC_COALESCED_BATCHES));
+
+  append(&text,
+         "# HELP bf2d_format_cache_hits_total Conversions that reused the "
+         "compiled output format of their context.\n"
+         "# TYPE bf2d_format_cache_hits_total counter\n"
+         "bf2d_format_cache_hits_total %llu\n"
+         "# HELP bf2d_format_cache_misses_total Conversions that compiled "
+         "their output format.\n"
+         "# TYPE bf2d_format_cache_misses_total counter\n"
+         "bf2d_format_cache_misses_total %llu\n",
+         (unsigned long long)metrics_total(METRIC_FORMAT_HITS),
+         (unsigned long long)metrics_total(METRIC_FORMAT_MISSES));
+
+  append(&text,
+         "# HELP bf2d_errors_total Failed conversions, by cause.\n"
+         "# TYPE bf2d_errors_total counter\n"
+         "bf2d_errors_total{kind=\"input\"} %llu\n"
+         "bf2d_errors_total{kind=\"output\"} %llu\n",
+         (unsigned long long)metrics_total(METRIC_INPUT_ERRORS),
+         (unsigned long long)metrics_total(METRIC_OUTPUT_ERRORS));
+
+  append(&text,
+         "# HELP bf2d_rejected_records_total Malformed records skipped or "
+         "replaced.\n"
+         "# TYPE bf2d_rejected_records_total counter\n"
+         "bf2d_rejected_records_total %llu\n",
+         (unsigned long long)metrics_total(METRIC_REJECTED_RECORDS));
+
+  append(&text,
+         "# HELP bf2d_verified_values_total Decimal outputs reparsed to "
+         "check them.\n"
+         "# TYPE bf2d_verified_values_total counter\n"
+         "bf2d_verified_values_total %llu\n"
+         "# HELP bf2d_verify_mismatches_total Reparsed outputs that did not "
+         "match their word.\n"
+         "# TYPE bf2d_verify_mismatches_total counter\n"
+         "bf2d_verify_mismatches_total %llu\n",
+         (unsigned long long)metrics_total(METRIC_VERIFIED_VALUES),
+         (unsigned long long)metrics_total(METRIC_VERIFY_MISMATCHES));
+
+  append(&text,
+         "# HELP bf2d_start_time_seconds Start time since the Unix epoch.\n"
+         "# TYPE bf2d_start_time_seconds gauge\n"
+         "bf2d_start_time_seconds %.3f\n",
+         start_time);
+
+  if (latency_enabled()) {
+    struct latency_histogram *merged =
+        (struct latency_histogram *)malloc(sizeof(*merged));
+    if (merged) {
+      render_latency(&text, LATENCY_BLOCK, "bf2d_block_latency_seconds",
+                     "Time for one block through all stages.", NULL, merged);
+      render_latency(&text, LATENCY_REQUEST, "bf2d_request_latency_seconds",
+                     "Time to serve one HTTP conversion request.", NULL,
+                     merged);
+      for (int c = 0; c < HTTP_CLASSES; c++) {
+        render_latency(&text, (enum latency_metric)(LATENCY_INTERACTIVE + c),
+                       "bf2d_request_latency_by_class_seconds",
+                       c ? NULL
+                         : "Time to serve one HTTP conversion request, by "
+                           "priority class.",
+                       http_class_name((enum http_class)c), merged);
+      }
+      free(merged);
+    } else {
+      perror("Memory allocation error.\n");
+    }
+  }
+
+  if (size) {
+    out[text.length < size ? text.length : size - 1] = '\0';
+  }
+  return text.length;
+}
@@ -0,0 +1,134 @@
+/**
+ * @file metrics.h
+ * @brief Process-wide counters rendered in the Prometheus text format.
+ *
+ * Every thread counts into its own shard, aligned and padded to whole cache
+ * lines so shards of different threads never share one. A shard is written
+ * only by its owner with relaxed loads and stores, and a scrape sums all
+ * shards with relaxed loads, so collecting metrics never stalls the
+ * conversion threads. A thread's counts move to a retired total when it
+ * exits and its shard is freed.
+ *
+ * Gauges, which rise and fall from different threads, are single atomics
+ * instead; they change once per queued request, not per value.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "float_word.h"
+
+/** @brief Cache line size assumed for padding shards. */
+#define METRICS_CACHE_LINE 64
+
+/**
+ * @brief Counters kept by the converter.
+ */
+enum metric_counter {
+  METRIC_VALUES,               /**< Values converted. */
+  METRIC_BLOCKS,               /**< Blocks converted. */
+  METRIC_BYTES_IN,             /**< Input bytes consumed. */
+  METRIC_BYTES_OUT,            /**< Output bytes written. */
+  METRIC_REQUESTS,             /**< HTTP conversion requests served. */
+  METRIC_CLASS_ZERO,           /**< Zeros, then one counter per
+                                    `float_class`. */
+  METRIC_CLASS_SUBNORMAL,      /**< Subnormals. */
+  METRIC_CLASS_NORMAL,         /**< Normal values. */
+  METRIC_CLASS_INFINITE,       /**< Infinities. */
+  METRIC_CLASS_NAN,            /**< NaNs. */
+  METRIC_INPUT_ERRORS,         /**< Malformed or unreadable input. */
+  METRIC_OUTPUT_ERRORS,        /**< Failed writes. */
+  METRIC_REJECTED_RECORDS,     /**< Malformed records skipped or replaced. */
+  METRIC_VERIFIED_VALUES,      /**< Decimal outputs reparsed to check them. */
+  METRIC_VERIFY_MISMATCHES,    /**< Of those, outputs that reparsed to
+                                    another word. */
+  METRIC_INTERACTIVE_REQUESTS, /**< Interactive conversion requests, then
+                                    one counter per `http_class`. */
+  METRIC_BULK_REQUESTS,        /**< Bulk conversion requests. */
+  METRIC_COALESCED_REQUESTS,   /**< Requests answered from a conversion
+                                    shared with others. */
+  METRIC_COALESCED_BATCHES,    /**< Those shared conversions. */
+  METRIC_FORMAT_HITS,          /**< Conversions that reused a context's
+                                    compiled output format. */
+  METRIC_FORMAT_MISSES,        /**< Conversions that had to build it. */
+  METRIC_COUNTERS,             /**< Number of counters. */
+};
+
+/**
+ * @brief Levels kept by the server, rendered as gauges.
+ */
+enum metric_gauge {
+  METRIC_QUEUED_INTERACTIVE,  /**< Interactive conversions waiting for a
+                                   worker, then one gauge per
+                                   `http_class`. */
+  METRIC_QUEUED_BULK,         /**< Bulk conversions waiting. */
+  METRIC_RUNNING_INTERACTIVE, /**< Interactive conversions running, then
+                                   one gauge per `http_class`. */
+  METRIC_RUNNING_BULK,        /**< Bulk conversions running. */
+  METRIC_GAUGES,              /**< Number of gauges. */
+};
+
+/**
+ * @brief Turns counting on for the rest of the process.
+ */
+void metrics_enable(void);
+
+/**
+ * @brief Tells whether counting was turned on by `metrics_enable`.
+ *
+ * @return int Non-zero when counters should be updated.
+ */
+int metrics_enabled(void);
+
+/**
+ * @brief Adds to a counter in the calling thread's shard.
+ *
+ * @param counter Counter to increase.
+ * @param amount Amount to add.
+ */
+void metrics_add(enum metric_counter counter, uint64_t amount);
+
+/**
+ * @brief Raises or lowers a gauge.
+ *
+ * @param gauge Gauge to change.
+ * @param delta Amount to add, negative to lower it.
+ */
+void metrics_gauge_add(enum metric_gauge gauge, int64_t delta);
+
+/**
+ * @brief Counts the float class of every word of a block.
+ *
+ * @param words Words to classify.
+ * @param count Number of words.
+ * @param layout Layout of the words.
+ */
+void metrics_count_classes(const uint64_t *words, size_t count,
+                           const struct float_layout *layout);
+
+/**
+ * @brief Sums a counter over the shards of all threads.
+ *
+ * @param counter Counter to read.
+ * @return uint64_t Total so far.
+ */
+uint64_t metrics_total(enum metric_counter counter);
+
+/**
+ * @brief Renders every counter in the Prometheus text exposition format.
+ *
+ * Server queue depths and running conversions are rendered per priority
+ * class. Block and request latency quantiles, the latter also by priority
+ * class, are included when latency recording is on.
+ *
+ * @param out Output buffer.
+ * @param size Size of `out` in bytes.
+ * @return size_t Length of the rendering, which is truncated if it is not
+ *         less than `size`.
+ */
+size_t metrics_render(char *out, size_t size);
+
+#endif
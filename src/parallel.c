@@ -0,0 +1,285 @@
+/**
+ * @file parallel.c
+ * @brief Parallel loops on a lazily started set of helper threads.
+ */
+
+#define _GNU_SOURCE // pthread_attr_setaffinity_np()
+
+#include "parallel.h"
+
+#include "latency.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define SPIN_CHECK 64 // Polls between two reads of the clock
+
+/**
+ * @brief The helper threads and the loop they are working on.
+ */
+struct helpers {
+  pthread_mutex_t busy;         // Held by loops, configuration and shutdown
+  pthread_mutex_t lock;         // Guards the loop and the parked count
+  pthread_cond_t wake;          // Signalled on a new loop or shutdown
+  pthread_cond_t done;          // Signalled when a helper leaves a loop
+  struct parallel_options options;
+  int started;                  // Helpers were started, guarded by `busy`
+  uint64_t spin_ns;             // `options.spin_ns` of the running helpers
+  size_t count;                 // Helper threads running
+  pthread_t ids[PARALLEL_MAX_HELPERS];
+  _Atomic uint64_t generation;  // Incremented for every posted loop
+  atomic_int stopping;          // Set to make the helpers exit
+  parallel_task task;           // The posted loop
+  void *argument;
+  size_t tasks;
+  size_t threads;               // Threads allowed, counting the caller
+  atomic_size_t next;           // Next unclaimed task
+  atomic_size_t finished;       // Tasks completed
+  atomic_size_t active;         // Helpers inside the posted loop
+  size_t parked;                // Helpers asleep on `wake`
+};
+
+static struct helpers helpers = {.busy = PTHREAD_MUTEX_INITIALIZER,
+                                 .lock = PTHREAD_MUTEX_INITIALIZER,
+                                 .wake = PTHREAD_COND_INITIALIZER,
+                                 .done = PTHREAD_COND_INITIALIZER,
+                                 .options = {0, PARALLEL_SPIN_NS, 0, 0}};
+
+static inline void relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause(); // Yield the core to its sibling while polling
+#endif
+}
+
+/**
+ * @brief Polls `done` until it returns non-zero or `spin_ns` have passed.
+ *
+ * @return int Non-zero if `done` was met while spinning.
+ */
+static int spin_until(int (*done)(const void *), const void *argument,
+                      uint64_t spin_ns) {
+  uint64_t deadline = spin_ns ? latency_now() + spin_ns : 0;
+
+  while (deadline) {
+    for (int i = 0; i < SPIN_CHECK; i++) {
+      if (done(argument)) {
+        return 1;
+      }
+      relax();
+    }
+    if (latency_now() >= deadline) {
+      break;
+    }
+  }
+  return done(argument);
+}
+
+static int loop_posted(const void *argument) {
+  return atomic_load_explicit(&helpers.generation, memory_order_acquire) !=
+             *(const uint64_t *)argument ||
+         atomic_load_explicit(&helpers.stopping, memory_order_relaxed);
+}
+
+static int loop_finished(const void *argument) {
+  return atomic_load(&helpers.finished) == *(const size_t *)argument &&
+         atomic_load(&helpers.active) == 0;
+}
+
+/**
+ * @brief Claims and runs tasks of the posted loop until none are left.
+ */
+static void claim_tasks(parallel_task task, void *argument, size_t tasks) {
+  size_t index;
+
+  while ((index = atomic_fetch_add(&helpers.next, 1)) < tasks) {
+    task(argument, index);
+    atomic_fetch_add(&helpers.finished, 1);
+  }
+}
+
+static void *help(void *argument) {
+  size_t id = (size_t)(uintptr_t)argument;
+  uint64_t seen = atomic_load(&helpers.generation);
+
+  for (;;) {
+    // Poll for the next loop for a while, then sleep until it is posted
+    spin_until(loop_posted, &seen, helpers.spin_ns);
+    pthread_mutex_lock(&helpers.lock);
+    while (!loop_posted(&seen)) {
+      helpers.parked++;
+      pthread_cond_wait(&helpers.wake, &helpers.lock);
+      helpers.parked--;
+    }
+    if (atomic_load(&helpers.stopping)) {
+      pthread_mutex_unlock(&helpers.lock);
+      return NULL;
+    }
+    seen = atomic_load(&helpers.generation);
+    if (id + 1 >= helpers.threads) {
+      pthread_mutex_unlock(&helpers.lock);
+      continue; // Not needed on this loop
+    }
+
+    // The loop stays posted until every helper that read it has left
+    parallel_task task = helpers.task;
+    void *task_argument = helpers.argument;
+    size_t tasks = helpers.tasks;
+    atomic_fetch_add(&helpers.active, 1);
+    pthread_mutex_unlock(&helpers.lock);
+
+    claim_tasks(task, task_argument, tasks);
+
+    pthread_mutex_lock(&helpers.lock);
+    atomic_fetch_sub(&helpers.active, 1);
+    pthread_cond_signal(&helpers.done);
+    pthread_mutex_unlock(&helpers.lock);
+  }
+}
+
+/**
+ * @brief Starts the helpers; the caller holds `busy`.
+ */
+static void start_helpers(void) {
+  const struct parallel_options *options = &helpers.options;
+  size_t cpus = parallel_cpu_count();
+  size_t wanted = (options->threads ? options->threads : cpus) - 1;
+
+  helpers.started = 1;
+  helpers.spin_ns = options->spin_ns;
+  if (wanted > PARALLEL_MAX_HELPERS) {
+    wanted = PARALLEL_MAX_HELPERS;
+  }
+  for (; helpers.count < wanted; helpers.count++) {
+    pthread_attr_t attributes;
+    int failed;
+
+    pthread_attr_init(&attributes);
+    if (options->pin) {
+      cpu_set_t cpu;
+      CPU_ZERO(&cpu);
+      CPU_SET((options->first_cpu + helpers.count) % cpus, &cpu);
+      pthread_attr_setaffinity_np(&attributes, sizeof(cpu), &cpu);
+    }
+    failed = pthread_create(&helpers.ids[helpers.count], &attributes, help,
+                            (void *)(uintptr_t)helpers.count);
+    pthread_attr_destroy(&attributes);
+    if (failed && options->pin) {
+      // The processor may be offline or outside our cpuset: run unpinned
+      failed = pthread_create(&helpers.ids[helpers.count], NULL, help,
+                              (void *)(uintptr_t)helpers.count);
+    }
+    if (failed) {
+      fprintf(stderr, "Could not start helper thread\n");
+      break;
+    }
+  }
+}
+
+/**
+ * @brief Sets how the helpers are started.
+ *
+ * Takes effect when the helpers are next started: at once if they are not
+ * running, otherwise after `parallel_shutdown`.
+ *
+ * @param options New options, copied.
+ */
+void parallel_configure(const struct parallel_options *options) {
+  pthread_mutex_lock(&helpers.busy);
+  helpers.options = *options;
+  pthread_mutex_unlock(&helpers.busy);
+}
+
+/**
+ * @brief Stops the helper threads and waits for them to exit.
+ *
+ * Waits for a running loop to finish first. A later `parallel_run` starts
+ * the helpers again.
+ */
+void parallel_shutdown(void) {
+  pthread_mutex_lock(&helpers.busy);
+  pthread_mutex_lock(&helpers.lock);
+  atomic_store(&helpers.stopping, 1);
+  pthread_cond_broadcast(&helpers.wake);
+  pthread_mutex_unlock(&helpers.lock);
+
+  for (size_t i = 0; i < helpers.count; i++) {
+    pthread_join(helpers.ids[i], NULL);
+  }
+  helpers.count = 0;
+  helpers.started = 0;
+  atomic_store(&helpers.active, 0);
+  atomic_store(&helpers.stopping, 0);
+  pthread_mutex_unlock(&helpers.busy);
+}
+
+/**
+ * @brief Runs tasks `0 .. count - 1` and returns when all have finished.
+ *
+ * @param task Body of the loop.
+ * @param argument Passed to every task.
+ * @param count Number of tasks.
+ * @param threads Most threads to use, counting the caller.
+ */
+void parallel_run(parallel_task task, void *argument, size_t count,
+                  size_t threads) {
+  if (threads <= 1 || count <= 1 || pthread_mutex_trylock(&helpers.busy)) {
+    for (size_t i = 0; i < count; i++) {
+      task(argument, i);
+    }
+    return;
+  }
+  if (!helpers.started) {
+    start_helpers();
+  }
+  if (!helpers.count) {
+    pthread_mutex_unlock(&helpers.busy);
+    for (size_t i = 0; i < count; i++) {
+      task(argument, i);
+    }
+    return;
+  }
+
+  pthread_mutex_lock(&helpers.lock);
+  while (atomic_load(&helpers.active)) {
+    // A helper that woke late for the last loop is still reading it
+    pthread_cond_wait(&helpers.done, &helpers.lock);
+  }
+  helpers.task = task;
+  helpers.argument = argument;
+  helpers.tasks = count;
+  helpers.threads = threads;
+  atomic_store(&helpers.next, 0);
+  atomic_store(&helpers.finished, 0);
+  atomic_fetch_add_explicit(&helpers.generation, 1, memory_order_release);
+  if (helpers.parked) {
+    pthread_cond_broadcast(&helpers.wake);
+  }
+  pthread_mutex_unlock(&helpers.lock);
+
+  claim_tasks(task, argument, count);
+
+  // Helpers still on their last tasks usually finish within the spin
+  if (!spin_until(loop_finished, &count, helpers.spin_ns)) {
+    pthread_mutex_lock(&helpers.lock);
+    while (!loop_finished(&count)) {
+      pthread_cond_wait(&helpers.done, &helpers.lock);
+    }
+    pthread_mutex_unlock(&helpers.lock);
+  }
+  pthread_mutex_unlock(&helpers.busy);
+}
+
+/**
+ * @brief Returns the number of processors available to the process.
+ *
+ * @return size_t Online processors, at least 1.
+ */
+size_t parallel_cpu_count(void) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  return cpus > 1 ? (size_t)cpus : 1;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file parallel.h
+ * @brief Parallel loops on a lazily started set of helper threads.
+ *
+ * `parallel_run` splits a loop into tasks that the calling thread and the
+ * helper threads claim one at a time. The helpers are started by the first
+ * call that has work for them and persist until `parallel_shutdown`, so a
+ * loop never pays for a thread creation. Idle helpers poll for the next loop
+ * for `spin_ns` before they sleep, so loops posted back to back are picked up
+ * within microseconds, while an idle process costs no CPU. Only one loop uses
+ * the helpers at a time; a thread that finds them busy runs its tasks by
+ * itself.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief Most helper threads, besides the thread running a loop. */
+#define PARALLEL_MAX_HELPERS 63
+
+/** @brief Default time an idle helper polls before it sleeps. */
+#define PARALLEL_SPIN_NS 50000
+
+/**
+ * @brief How the helper threads are started.
+ */
+struct parallel_options {
+  size_t threads;   /**< Threads on a loop counting the caller, 0 for one per
+                         processor. */
+  uint64_t spin_ns; /**< How long an idle helper polls for the next loop
+                         before it sleeps; 0 to sleep at once. */
+  int pin;          /**< Pin helper `i` to processor `first_cpu + i`,
+                         wrapping around, instead of letting it migrate. */
+  size_t first_cpu; /**< Processor of the first pinned helper. */
+};
+
+/**
+ * @brief Body of a parallel loop.
+ *
+ * @param argument Pointer given to `parallel_run`.
+ * @param index Index of the task, from 0 to the task count minus 1.
+ */
+typedef void (*parallel_task)(void *argument, size_t index);
+
+/**
+ * @brief Runs tasks `0 .. count - 1` and returns when all have finished.
+ *
+ * @param task Body of the loop.
+ * @param argument Passed to every task.
+ * @param count Number of tasks.
+ * @param threads Most threads to use, counting the caller.
+ */
+void parallel_run(parallel_task task, void *argument, size_t count,
+                  size_t threads);
+
+/**
+ * @brief Sets how the helpers are started.
+ *
+ * Takes effect when the helpers are next started: at once if they are not
+ * running, otherwise after `parallel_shutdown`.
+ *
+ * @param options New options, copied.
+ */
+void parallel_configure(const struct parallel_options *options);
+
+/**
+ * @brief Stops the helper threads and waits for them to exit.
+ *
+ * Waits for a running loop to finish first. A later `parallel_run` starts
+ * the helpers again.
+ */
+void parallel_shutdown(void);
+
+/**
+ * @brief Returns the number of processors available to the process.
+ *
+ * @return size_t Online processors, at least 1.
+ */
+size_t parallel_cpu_count(void);
+
+#endif
@@ -0,0 +1,53 @@
+/**
+ * @file probes.h
+ * @brief USDT probes at the stage boundaries of the batch pipeline.
+ *
+ * When built with `BF2D_USDT` and `<sys/sdt.h>` is available, every probe
+ * becomes a `nop` in the instruction stream plus an ELF note that `bpftrace`,
+ * `perf probe` or SystemTap can attach to at run time. Unattached probes cost
+ * the `nop` only; arguments are left wherever the compiler already has them.
+ * Without `BF2D_USDT` the macros discard their arguments.
+ *
+ * Probes of provider `bf2d`:
+ *
+ * | Probe                 | Arguments                                    |
+ * |-----------------------|----------------------------------------------|
+ * | block__read__start    | block                                        |
+ * | block__read__done     | block, values, bytes read                    |
+ * | block__convert__start | block, values                                |
+ * | block__convert__done  | block, values                                |
+ * | block__format__start  | block, values                                |
+ * | block__format__done   | block, bytes formatted                       |
+ * | block__write__start   | block, bytes                                 |
+ * | block__write__done    | block, bytes                                 |
+ * | batch                 | blocks, values, bytes in, bytes out (totals) |
+ *
+ * `block` counts from 0 within a run; `batch` fires once per run after the
+ * last block.
+ */
+
+#ifndef PROBES_H
+#define PROBES_H
+
+#if defined(BF2D_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define BF2D_HAVE_USDT 1
+#endif
+#endif
+
+#ifdef BF2D_HAVE_USDT
+#define BF2D_PROBE1(name, a) DTRACE_PROBE1(bf2d, name, a)
+#define BF2D_PROBE2(name, a, b) DTRACE_PROBE2(bf2d, name, a, b)
+#define BF2D_PROBE3(name, a, b, c) DTRACE_PROBE3(bf2d, name, a, b, c)
+#define BF2D_PROBE4(name, a, b, c, d) DTRACE_PROBE4(bf2d, name, a, b, c, d)
+#else
+// Arguments are still named so values kept only for probes stay "used"
+#define BF2D_PROBE1(name, a) ((void)(a))
+#define BF2D_PROBE2(name, a, b) ((void)(a), (void)(b))
+#define BF2D_PROBE3(name, a, b, c) ((void)(a), (void)(b), (void)(c))
+#define BF2D_PROBE4(name, a, b, c, d)                                          \
+  ((void)(a), (void)(b), (void)(c), (void)(d))
+#endif
+
+#endif
@@ -0,0 +1,420 @@
+/**
+ * @file shard.c
+ * @brief Conversions split across processes, and the merge of their outputs.
+ */
+
+#define _GNU_SOURCE // copy_file_range()
+
+#include "shard.h"
+
+#include "xor_stream.h"
+#include "xxh3.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SCAN_BYTES 4096  // Bytes searched per read for a line start
+#define COPY_BYTES 65536 // Bytes per copy when the kernel cannot copy
+
+/**
+ * @brief One manifest entry.
+ */
+struct shard_entry {
+  int found;
+  struct shard_range range;
+  uint64_t values;
+  uint64_t bytes;
+  char *path;
+};
+
+/**
+ * @brief Parses a shard specification.
+ *
+ * @param spec Text of the form "I/N", with I from 0 to N - 1.
+ * @param index Receives I.
+ * @param count Receives N.
+ * @return int 0 on success, -1 if the text is malformed.
+ */
+int shard_parse(const char *spec, size_t *index, size_t *count) {
+  char *end;
+
+  *index = strtoull(spec, &end, 10);
+  if (end == spec || *end != '/') {
+    return -1;
+  }
+  spec = end + 1;
+  *count = strtoull(spec, &end, 10);
+  return end == spec || *end || *index >= *count ? -1 : 0;
+}
+
+/**
+ * @brief Returns `total * index / count` rounded down, without overflow.
+ */
+static uint64_t split_point(uint64_t total, size_t index, size_t count) {
+  return total / count * index + total % count * index / count;
+}
+
+/**
+ * @brief Finds the first line that starts at or after `offset`.
+ *
+ * @return int64_t Offset of the line, the file size if none starts there, or
+ *         -1 on a read error.
+ */
+static int64_t line_start(int fd, uint64_t offset, uint64_t size) {
+  char buffer[SCAN_BYTES];
+
+  if (offset == 0) {
+    return 0;
+  }
+  // A line starts at `offset` if the byte before it ends a line
+  for (uint64_t at = offset - 1; at < size;) {
+    ssize_t got = pread(fd, buffer, sizeof(buffer), (off_t)at);
+    if (got <= 0) {
+      return got < 0 ? -1 : (int64_t)size;
+    }
+    char *newline = (char *)memchr(buffer, '\n', (size_t)got);
+    if (newline) {
+      return (int64_t)(at + (uint64_t)(newline - buffer) + 1);
+    }
+    at += (uint64_t)got;
+  }
+  return (int64_t)size;
+}
+
+/**
+ * @brief Finds the input range of one shard.
+ *
+ * @param fd Regular file holding the whole input.
+ * @param options Conversion options; only bits and raw input can be split.
+ * @param index Shard to locate, from 0 to `count - 1`.
+ * @param count Number of shards.
+ * @param range Receives the range; ranges of consecutive shards touch.
+ * @return int 0 on success, -1 if the input cannot be split.
+ */
+int shard_range(int fd, const struct stream_options *options, size_t index,
+                size_t count, struct shard_range *range) {
+  struct stat info;
+  uint64_t size;
+
+  if (options->input != STREAM_BITS && options->input != STREAM_RAW) {
+    fprintf(stderr, "Only bits and raw input can be sharded\n");
+    return -1;
+  }
+  if (fstat(fd, &info) || !S_ISREG(info.st_mode)) {
+    fprintf(stderr, "Sharded input must be a regular file\n");
+    return -1;
+  }
+  size = (uint64_t)info.st_size;
+
+  if (options->input == STREAM_RAW) {
+    // A trailing partial record stays with the last shard, which reports it
+    uint64_t record = (uint64_t)options->width / 8;
+    uint64_t records = size / record;
+    range->start = split_point(records, index, count) * record;
+    range->end = index + 1 == count
+                     ? size
+                     : split_point(records, index + 1, count) * record;
+    return 0;
+  }
+
+  int64_t start = line_start(fd, split_point(size, index, count), size);
+  int64_t end = line_start(fd, split_point(size, index + 1, count), size);
+  if (start < 0 || end < 0) {
+    perror("Read error");
+    return -1;
+  }
+  range->start = (uint64_t)start;
+  range->end = (uint64_t)end;
+  return 0;
+}
+
+/**
+ * @brief Appends one line to the manifest with a single write.
+ */
+static int append_entry(const char *manifest, const char *line) {
+  int fd = open(manifest, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  size_t length = strlen(line);
+  int status = 0;
+
+  if (fd < 0) {
+    perror(manifest);
+    return -1;
+  }
+  if (write(fd, line, length) != (ssize_t)length) {
+    perror(manifest);
+    status = -1;
+  }
+  if (close(fd)) {
+    perror(manifest);
+    status = -1;
+  }
+  return status;
+}
+
+/**
+ * @brief Converts one shard of `in` into `out` and records it in the
+ *        manifest.
+ *
+ * @param options Conversion options.
+ * @param index Shard to convert, from 0 to `count - 1`.
+ * @param count Number of shards.
+ * @param manifest Path of the manifest shared by all shards.
+ * @param in Whole input, a regular file.
+ * @param out Output of this shard, a regular file.
+ * @param checksum Receives the XXH3-64 of the shard's output when
+ *                 `options->checksum` is set.
+ * @return int 0 on success, -1 on failure with the reason on stderr.
+ */
+int shard_convert(const struct stream_options *options, size_t index,
+                  size_t count, const char *manifest, FILE *in, FILE *out,
+                  uint64_t *checksum) {
+  struct stream_options shard = *options;
+  struct shard_range range;
+  struct stat info;
+  char link[64], path[PATH_MAX];
+  char line[PATH_MAX + 128];
+  uint64_t values = 0;
+  ssize_t length;
+
+  *checksum = xxh3_64(NULL, 0);
+
+  if (shard_range(fileno(in), options, index, count, &range)) {
+    return -1;
+  }
+  // The manifest names the output, so it must be a file others can open
+  snprintf(link, sizeof(link), "/proc/self/fd/%d", fileno(out));
+  length = readlink(link, path, sizeof(path) - 1);
+  if (fstat(fileno(out), &info) || !S_ISREG(info.st_mode) || length <= 0) {
+    fprintf(stderr, "Shard output must be redirected to a file\n");
+    return -1;
+  } else if (info.st_size) {
+    fprintf(stderr, "Shard output must start empty\n");
+    return -1;
+  }
+  path[length] = '\0';
+
+  if (range.end > range.start) {
+    struct bf2d_ctx *ctx;
+    int status;
+
+    if (lseek(fileno(in), (off_t)range.start, SEEK_SET) < 0) {
+      perror("Seek error");
+      return -1;
+    }
+    shard.input_limit = range.end - range.start;
+    shard.omit_header = index > 0; // Only the first shard starts the stream
+    if (!(ctx = bf2d_ctx_create(&shard))) {
+      fprintf(stderr, "Memory allocation error.\n");
+      return -1;
+    }
+    status = bf2d_ctx_convert(ctx, in, out);
+    if (status) {
+      fprintf(stderr, "%s\n", bf2d_ctx_error(ctx));
+    }
+    if (bf2d_ctx_stats(ctx)->rejected) {
+      fprintf(stderr, "Rejected %llu malformed records\n",
+              (unsigned long long)bf2d_ctx_stats(ctx)->rejected);
+    }
+    if (options->verify_rate > 0) {
+      fprintf(stderr, "verify: %llu values reparsed, %llu mismatches\n",
+              (unsigned long long)bf2d_ctx_stats(ctx)->verified,
+              (unsigned long long)bf2d_ctx_stats(ctx)->mismatches);
+    }
+    values = bf2d_ctx_stats(ctx)->values;
+    *checksum = bf2d_ctx_checksum(ctx);
+    bf2d_ctx_destroy(ctx);
+    if (status) {
+      return -1;
+    }
+  } else if (index == 0 && options->output == STREAM_XOR) {
+    unsigned char header[XOR_STREAM_HEADER_BYTES];
+    xor_stream_header(header, options->width);
+    fwrite(header, 1, sizeof(header), out);
+    *checksum = xxh3_64(header, sizeof(header));
+  }
+  if (fflush(out) || fstat(fileno(out), &info)) {
+    perror("Write error");
+    return -1;
+  }
+
+  snprintf(line, sizeof(line),
+           "shard\t%zu\t%zu\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64
+           "\t%s\n",
+           index, count, range.start, range.end, values,
+           (uint64_t)info.st_size, path);
+  return append_entry(manifest, line);
+}
+
+/**
+ * @brief Reads a manifest into one entry per shard, the last one winning.
+ *
+ * @return struct shard_entry* Entries indexed by shard, or NULL with the
+ *         reason on stderr.
+ */
+static struct shard_entry *read_manifest(const char *manifest,
+                                         size_t *count) {
+  FILE *in = fopen(manifest, "r");
+  struct shard_entry *entries = NULL;
+  char *line = NULL;
+  size_t capacity = 0;
+  size_t line_number = 0;
+  ssize_t length;
+
+  if (!in) {
+    perror(manifest);
+    return NULL;
+  }
+  *count = 0;
+  while ((length = getline(&line, &capacity, in)) > 0) {
+    struct shard_entry entry = {.found = 1};
+    size_t index, shards;
+    int path = 0;
+
+    line_number++;
+    if (line[length - 1] == '\n') {
+      line[--length] = '\0';
+    }
+    if (sscanf(line,
+               "shard\t%zu\t%zu\t%" SCNu64 "\t%" SCNu64 "\t%" SCNu64
+               "\t%" SCNu64 "\t%n",
+               &index, &shards, &entry.range.start, &entry.range.end,
+               &entry.values, &entry.bytes, &path) != 6 ||
+        !path || index >= shards || (*count && shards != *count)) {
+      fprintf(stderr, "%s:%zu: malformed or mismatched entry\n", manifest,
+              line_number);
+      goto fail;
+    }
+    if (!entries) {
+      *count = shards;
+      if (!(entries = (struct shard_entry *)calloc(shards, sizeof(*entries)))) {
+        perror("Memory allocation error.\n");
+        goto fail;
+      }
+    }
+    if (!(entry.path = strdup(line + path))) {
+      perror("Memory allocation error.\n");
+      goto fail;
+    }
+    free(entries[index].path);
+    entries[index] = entry;
+  }
+  free(line);
+  fclose(in);
+  if (!entries) {
+    fprintf(stderr, "%s: no shards\n", manifest);
+  }
+  return entries;
+
+fail:
+  for (size_t i = 0; entries && i < *count; i++) {
+    free(entries[i].path);
+  }
+  free(entries);
+  free(line);
+  fclose(in);
+  return NULL;
+}
+
+/**
+ * @brief Copies `bytes` from `in_fd` to `out_fd`, in the kernel if it can.
+ */
+static int copy_shard(int in_fd, int out_fd, uint64_t bytes) {
+  char buffer[COPY_BYTES];
+  int kernel = 1;
+
+  while (bytes) {
+    size_t chunk = bytes < SSIZE_MAX ? (size_t)bytes : SSIZE_MAX;
+    ssize_t got = -1;
+
+    if (kernel) {
+      got = copy_file_range(in_fd, NULL, out_fd, NULL, chunk, 0);
+      if (got < 0 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS ||
+                      errno == EOPNOTSUPP || errno == EBADF)) {
+        kernel = 0; // Pipes, appending outputs or an old kernel
+        continue;
+      }
+    } else {
+      got = read(in_fd, buffer, chunk < COPY_BYTES ? chunk : COPY_BYTES);
+      for (ssize_t done = 0; got > 0 && done < got;) {
+        ssize_t put = write(out_fd, buffer + done, (size_t)(got - done));
+        if (put < 0 && errno != EINTR) {
+          return -1;
+        }
+        done += put > 0 ? put : 0;
+      }
+    }
+    if (got < 0 && errno == EINTR) {
+      continue;
+    } else if (got <= 0) {
+      errno = got ? errno : EIO; // The shard shrank while it was copied
+      return -1;
+    }
+    bytes -= (uint64_t)got;
+  }
+  return 0;
+}
+
+/**
+ * @brief Concatenates the shard outputs listed in a manifest, in order.
+ *
+ * When a shard was run more than once, its last entry wins.
+ *
+ * @param manifest Path of the manifest.
+ * @param out_fd Descriptor receiving the merged output.
+ * @return int 0 on success, -1 if shards are missing, overlap, have changed
+ *         since they were recorded or could not be copied, with the reason
+ *         on stderr.
+ */
+int shard_merge(const char *manifest, int out_fd) {
+  size_t count;
+  struct shard_entry *entries = read_manifest(manifest, &count);
+  int status = 0;
+
+  if (!entries) {
+    return -1;
+  }
+  for (size_t i = 0; i < count && status == 0; i++) {
+    uint64_t start = i ? entries[i - 1].range.end : 0;
+    if (!entries[i].found) {
+      fprintf(stderr, "Shard %zu/%zu is missing\n", i, count);
+      status = -1;
+    } else if (entries[i].range.start != start) {
+      fprintf(stderr, "Shard %zu/%zu does not start where shard %zu ends\n",
+              i, count, i - 1);
+      status = -1;
+    }
+  }
+
+  for (size_t i = 0; i < count && status == 0; i++) {
+    struct stat info;
+    int in_fd = open(entries[i].path, O_RDONLY | O_CLOEXEC);
+
+    if (in_fd < 0) {
+      perror(entries[i].path);
+      status = -1;
+    } else if (fstat(in_fd, &info) ||
+               (uint64_t)info.st_size != entries[i].bytes) {
+      fprintf(stderr, "%s changed since shard %zu/%zu recorded it\n",
+              entries[i].path, i, count);
+      status = -1;
+    } else if (copy_shard(in_fd, out_fd, entries[i].bytes)) {
+      perror(entries[i].path);
+      status = -1;
+    }
+    if (in_fd >= 0) {
+      close(in_fd);
+    }
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    free(entries[i].path);
+  }
+  free(entries);
+  return status;
+}
@@ -0,0 +1,97 @@
+/**
+ * @file shard.h
+ * @brief Conversions split across processes, and the merge of their outputs.
+ *
+ * A dump too large for one process is converted by N processes, possibly on
+ * several hosts sharing a file system. Process `i` of `N` converts the `i`-th
+ * of N byte ranges of the input. Every range starts and ends on a record
+ * boundary, so the ranges cover each record exactly once whichever process
+ * finishes first. Each process writes its own output file and, on success,
+ * appends one line to a shared manifest:
+ *
+ *     shard <i> <N> <input start> <input end> <values> <output bytes> <path>
+ *
+ * with tab-separated fields and the absolute path of the output last. The
+ * line is appended with a single `write` on an `O_APPEND` descriptor, so
+ * concurrent processes never interleave their entries.
+ *
+ * `shard_merge` checks that the manifest covers every shard and the whole
+ * input without gaps, then concatenates the outputs in shard order, with
+ * `copy_file_range` where the file system can share or copy the data itself.
+ * Shards of a text or raw output merge into exactly the output one process
+ * would have written. XOR outputs merge into a valid stream with the same
+ * values, although its blocks end at shard boundaries.
+ */
+
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "stream.h"
+
+/**
+ * @brief Input byte range of one shard.
+ */
+struct shard_range {
+  uint64_t start; /**< Offset of the first record. */
+  uint64_t end;   /**< Offset just past the last record. */
+};
+
+/**
+ * @brief Parses a shard specification.
+ *
+ * @param spec Text of the form "I/N", with I from 0 to N - 1.
+ * @param index Receives I.
+ * @param count Receives N.
+ * @return int 0 on success, -1 if the text is malformed.
+ */
+int shard_parse(const char *spec, size_t *index, size_t *count);
+
+/**
+ * @brief Finds the input range of one shard.
+ *
+ * @param fd Regular file holding the whole input.
+ * @param options Conversion options; only bits and raw input can be split.
+ * @param index Shard to locate, from 0 to `count - 1`.
+ * @param count Number of shards.
+ * @param range Receives the range; ranges of consecutive shards touch.
+ * @return int 0 on success, -1 if the input cannot be split.
+ */
+int shard_range(int fd, const struct stream_options *options, size_t index,
+                size_t count, struct shard_range *range);
+
+/**
+ * @brief Converts one shard of `in` into `out` and records it in the
+ *        manifest.
+ *
+ * @param options Conversion options.
+ * @param index Shard to convert, from 0 to `count - 1`.
+ * @param count Number of shards.
+ * @param manifest Path of the manifest shared by all shards.
+ * @param in Whole input, a regular file.
+ * @param out Output of this shard, a regular file.
+ * @param checksum Receives the XXH3-64 of the shard's output when
+ *                 `options->checksum` is set.
+ * @return int 0 on success, -1 on failure with the reason on stderr.
+ */
+int shard_convert(const struct stream_options *options, size_t index,
+                  size_t count, const char *manifest, FILE *in, FILE *out,
+                  uint64_t *checksum);
+
+/**
+ * @brief Concatenates the shard outputs listed in a manifest, in order.
+ *
+ * When a shard was run more than once, its last entry wins.
+ *
+ * @param manifest Path of the manifest.
+ * @param out_fd Descriptor receiving the merged output.
+ * @return int 0 on success, -1 if shards are missing, overlap, have changed
+ *         since they were recorded or could not be copied, with the reason
+ *         on stderr.
+ */
+int shard_merge(const char *manifest, int out_fd);
+
+#endif
@@ -0,0 +1,1522 @@
+/**
+ * @file stream.c
+ * @brief Batch conversion of float streams between input and output formats.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "stream.h"
+
+#include "bit_text.h"
+#include "columns.h"
+#include "explain.h"
+#include "file_input.h"
+#include "float_word.h"
+#include "latency.h"
+#include "metrics.h"
+#include "parallel.h"
+#include "probes.h"
+#include "template.h"
+#include "tuning.h"
+#include "xor_stream.h"
+#include "xxh3.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DECIMAL_CHARS 32    // Longest "%.17g" value plus newline
+#define MIN_READ_BYTES 4096 // Smallest read, so any record fits in one
+#define SPLIT_MAX_CHUNKS 64 // Most ranges a block is split into
+#define REJECT_BATCH 256    // Rejected records reported per write
+#define REJECT_CHARS 64     // Longest line of the reject report
+#define VERIFY_SEED 0x5eed  // Start of the sampling sequence
+
+#define FILL_EOF 0
+#define FILL_ERROR -1
+#define FILL_TIMEOUT -2
+
+/**
+ * @brief Why a record was rejected, as named in the reject report.
+ */
+enum reject_reason {
+  REJECT_LENGTH,  // Line of the wrong length
+  REJECT_DIGIT,   // Character other than '0' or '1'
+  REJECT_PARTIAL, // Raw record cut short by the end of the input
+};
+
+static const char *const reject_names[] = {"length", "digit", "partial"};
+
+/**
+ * @brief A rejected record waiting to be reported.
+ */
+struct rejection {
+  uint64_t offset; // Byte offset of the record in the input read
+  uint64_t record; // Line number, or raw record index from 1
+  enum reject_reason reason;
+};
+
+/**
+ * @brief Buffers, compiled formats and counters reused across conversions.
+ */
+struct bf2d_ctx {
+  struct stream_options options; // `template_spec` points at `template_text`
+  char *template_text;           // Owned copy of the template
+  int prepared_width;            // Width the output state was built for, or 0
+  const struct tuning *tuning;   // Execution strategy
+  size_t split_values;           // Smallest block worth splitting, or 0
+  size_t record_bytes;           // Longest output of one record
+  const struct float_layout *layout;
+  enum stream_format input;
+  enum stream_format output;
+  FILE *in;
+  FILE *out;
+  size_t line_number;     // Lines consumed so far, for error messages
+  int in_fd;              // Descriptor of `in`, or -1 to read through stdio
+  struct file_input file; // How `in_fd` is read
+  size_t read_bytes;      // Most bytes per read
+  char *ahead;            // Text or raw input read ahead of parsing
+  size_t ahead_capacity;  // Size of `ahead` in bytes
+  size_t ahead_start;     // First unconsumed byte of `ahead`
+  size_t ahead_end;       // End of the bytes read into `ahead`
+  uint64_t input_left;    // Bytes the input limit still allows
+  uint64_t reads;         // Reads so far
+  uint64_t read_ns;       // Time spent in them
+  int input_eof;          // No more input will arrive
+  uint64_t budget_ns;     // Longest wait for a partial block, 0 for no limit
+  uint64_t deadline;      // When the block being read must be converted
+  size_t block_values;          // Most text, raw or generated values
+  size_t block_capacity;        // Values the block buffers below hold
+  char *records;                // Bit strings of one block, `width` apiece
+  size_t *record_lines;         // Line number of every record in `records`
+  uint64_t *record_offsets;     // Input offset of every record in `records`
+  char placeholder[64];         // Bit string converted for rejected lines
+  struct rejection *rejections; // Rejections not yet reported
+  size_t rejection_count;       // Entries in `rejections`
+  size_t rejection_capacity;    // Entries `rejections` has room for
+  uint64_t rejected;            // Records rejected so far
+  int verifying;                // Reparse samples of decimal output
+  uint64_t verify_random;       // State of the sampling generator
+  uint64_t verify_gap;          // Records to pass before the next sample
+  uint64_t verified;            // Records reparsed so far
+  uint64_t mismatches;          // Of those, records that did not match
+  struct xor_reader xor_in;
+  struct output_template template;
+  struct explain_format explain;
+  struct bit_picture picture;
+  struct corpus corpus;
+  uint64_t words[XOR_BLOCK_VALUES]; // Sized for a whole XOR block
+  char *text;                       // Formatted output of one block
+  size_t text_capacity;             // Size of `text` in bytes
+  unsigned char *raw;               // Raw input of one block
+  uint64_t blocks;                  // Blocks written so far
+  uint64_t values;                  // Values written so far
+  uint64_t bytes_in;                // Input bytes consumed so far
+  uint64_t bytes_out;               // Output bytes written so far
+  struct xxh3_state hash;           // Output written so far, if checksummed
+  int timed;                        // Record stage latencies
+  int counted;                      // Update the process metrics
+  struct bf2d_stats stats;          // Totals over every conversion
+  char error[STREAM_ERROR_BYTES];   // Why the last conversion failed
+};
+
+/**
+ * @brief Looks up a record format by name.
+ *
+ * @param name Format name: "bits", "decimal", "xor", "explain" or "raw".
+ * @param format Receives the format.
+ * @return int 0 on success, -1 if the name is unknown.
+ */
+int stream_format_from_name(const char *name, enum stream_format *format) {
+  if (strcmp(name, "bits") == 0) {
+    *format = STREAM_BITS;
+  } else if (strcmp(name, "decimal") == 0) {
+    *format = STREAM_DECIMAL;
+  } else if (strcmp(name, "xor") == 0) {
+    *format = STREAM_XOR;
+  } else if (strcmp(name, "explain") == 0) {
+    *format = STREAM_EXPLAIN;
+  } else if (strcmp(name, "raw") == 0) {
+    *format = STREAM_RAW;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Looks up an input read mode by name.
+ *
+ * @param name Mode name: "buffered", "sequential" or "direct".
+ * @param mode Receives the mode.
+ * @return int 0 on success, -1 if the name is unknown.
+ */
+int stream_read_from_name(const char *name, enum stream_read *mode) {
+  if (strcmp(name, "buffered") == 0) {
+    *mode = STREAM_READ_BUFFERED;
+  } else if (strcmp(name, "sequential") == 0) {
+    *mode = STREAM_READ_SEQUENTIAL;
+  } else if (strcmp(name, "direct") == 0) {
+    *mode = STREAM_READ_DIRECT;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Looks up a malformed-record policy by name.
+ *
+ * @param name Policy name: "fail", "skip" or "nan".
+ * @param policy Receives the policy.
+ * @return int 0 on success, -1 if the name is unknown.
+ */
+int stream_rejects_from_name(const char *name, enum stream_rejects *policy) {
+  if (strcmp(name, "fail") == 0) {
+    *policy = STREAM_REJECT_FAIL;
+  } else if (strcmp(name, "skip") == 0) {
+    *policy = STREAM_REJECT_SKIP;
+  } else if (strcmp(name, "nan") == 0) {
+    *policy = STREAM_REJECT_NAN;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Records why the conversion failed, for `bf2d_ctx_error`.
+ */
+static void set_error(struct bf2d_ctx *s, const char *format, ...) {
+  va_list args;
+
+  va_start(args, format);
+  vsnprintf(s->error, sizeof(s->error), format, args);
+  va_end(args);
+}
+
+/**
+ * @brief Records a failed system call together with the reason from `errno`.
+ */
+static void set_system_error(struct bf2d_ctx *s, const char *what) {
+  char reason[128];
+
+  if (strerror_r(errno, reason, sizeof(reason))) {
+    snprintf(reason, sizeof(reason), "error %d", errno);
+  }
+  set_error(s, "%s: %s", what, reason);
+}
+
+/**
+ * @brief Reads more input into `s->ahead` after the unconsumed bytes.
+ *
+ * @param deadline Monotonic time after which to stop waiting, or 0 to wait
+ *                 for as long as the input stays open.
+ * @return ssize_t Bytes added, `FILL_EOF`, `FILL_ERROR` or `FILL_TIMEOUT`.
+ */
+static ssize_t fill_input(struct bf2d_ctx *s, uint64_t deadline) {
+  size_t pending = s->ahead_end - s->ahead_start;
+  size_t first = pending; // Where the new bytes go
+  size_t room;
+  uint64_t start;
+  ssize_t got;
+
+  if (!s->input_left) {
+    return FILL_EOF;
+  }
+  if (s->file.mode == STREAM_READ_DIRECT) {
+    // Direct reads land on an aligned offset right after the pending bytes
+    first = (pending + FILE_INPUT_ALIGNMENT - 1) &
+            ~(size_t)(FILE_INPUT_ALIGNMENT - 1);
+  }
+  memmove(s->ahead + first - pending, s->ahead + s->ahead_start, pending);
+  s->ahead_start = first - pending;
+  s->ahead_end = first;
+  room = s->ahead_capacity - first;
+  if (room > s->read_bytes) {
+    room = s->read_bytes;
+  }
+  if (s->file.mode == STREAM_READ_DIRECT) {
+    room &= ~(size_t)(FILE_INPUT_ALIGNMENT - 1);
+  } else if (room > s->input_left) {
+    room = (size_t)s->input_left; // Direct reads are cut short below
+  }
+
+  if (s->in_fd < 0) {
+    start = latency_now();
+    got = (ssize_t)fread(s->ahead + first, 1, room, s->in);
+    s->reads++;
+    s->read_ns += latency_now() - start;
+    if (ferror(s->in)) {
+      set_system_error(s, "Read error");
+      return FILL_ERROR;
+    }
+  } else {
+    for (;;) {
+      if (deadline) {
+        uint64_t now = latency_now();
+        if (now >= deadline) {
+          return FILL_TIMEOUT;
+        }
+
+        fd_set readable;
+        struct timespec wait = {(time_t)((deadline - now) / 1000000000u),
+                                (long)((deadline - now) % 1000000000u)};
+        FD_ZERO(&readable);
+        FD_SET(s->in_fd, &readable);
+        int ready = pselect(s->in_fd + 1, &readable, NULL, NULL, &wait, NULL);
+        if (ready < 0 && errno != EINTR) {
+          set_system_error(s, "Read error");
+          return FILL_ERROR;
+        } else if (ready <= 0) {
+          continue; // Re-check the deadline
+        }
+      }
+
+      start = latency_now();
+      got = file_input_read(&s->file, s->ahead + first, room);
+      s->reads++;
+      s->read_ns += latency_now() - start;
+      if (got >= 0) {
+        break;
+      } else if (errno != EINTR) {
+        set_system_error(s, "Read error");
+        return FILL_ERROR;
+      }
+    }
+  }
+
+  if ((uint64_t)got > s->input_left) {
+    got = (ssize_t)s->input_left;
+  }
+  s->input_left -= (uint64_t)got;
+  s->ahead_end += (size_t)got;
+  s->bytes_in += (uint64_t)got;
+  return got;
+}
+
+static int compare_rejections(const void *a, const void *b) {
+  uint64_t x = ((const struct rejection *)a)->offset;
+  uint64_t y = ((const struct rejection *)b)->offset;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief Writes the pending rejections to the reject report in input order.
+ *
+ * Length errors are found while a block is read and digit errors once it
+ * is packed, so the entries of a block are sorted by offset first.
+ *
+ * @return int 0 on success, -1 if the report could not be written, with
+ *         `errno` set.
+ */
+static int report_rejections(struct bf2d_ctx *s) {
+  char text[REJECT_BATCH * REJECT_CHARS];
+  size_t count = s->rejection_count;
+
+  qsort(s->rejections, count, sizeof(*s->rejections), compare_rejections);
+  s->rejection_count = 0;
+  for (size_t first = 0; first < count; first += REJECT_BATCH) {
+    size_t length = 0;
+    for (size_t i = first; i < count && i < first + REJECT_BATCH; i++) {
+      const struct rejection *r = &s->rejections[i];
+      length += (size_t)snprintf(text + length, REJECT_CHARS,
+                                 "%llu,%llu,%s\n",
+                                 (unsigned long long)r->offset,
+                                 (unsigned long long)r->record,
+                                 reject_names[r->reason]);
+    }
+    if (fwrite(text, 1, length, s->options.reject_report) != length) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Applies the reject policy to a malformed record.
+ *
+ * @param offset Byte offset of the record in the input read.
+ * @param record Line number, or raw record index from 1.
+ * @return int 0 if the record is to be skipped or replaced, -1 if the
+ *         conversion fails, with the reason recorded.
+ */
+static int reject_record(struct bf2d_ctx *s, uint64_t offset, uint64_t record,
+                         enum reject_reason reason) {
+  size_t width = (size_t)s->layout->width;
+
+  if (s->options.rejects == STREAM_REJECT_FAIL) {
+    if (reason == REJECT_PARTIAL) {
+      set_error(s, "Input ends with a partial %zu-byte record", width / 8);
+    } else {
+      set_error(s, "Line %llu: expected %zu binary digits",
+                (unsigned long long)record, width);
+    }
+    return -1;
+  }
+  s->rejected++;
+  if (!s->options.reject_report) {
+    return 0;
+  }
+  // Reported once the block is packed, see `convert_block`
+  if (s->rejection_count == s->rejection_capacity) {
+    size_t capacity = s->rejection_capacity ? 2 * s->rejection_capacity
+                                            : REJECT_BATCH;
+    struct rejection *grown = (struct rejection *)realloc(
+        s->rejections, capacity * sizeof(*s->rejections));
+    if (!grown) {
+      set_error(s, "Memory allocation error.");
+      return -1;
+    }
+    s->rejections = grown;
+    s->rejection_capacity = capacity;
+  }
+  s->rejections[s->rejection_count++] =
+      (struct rejection){offset, record, reason};
+  return 0;
+}
+
+/**
+ * @brief Quiet NaN converted in place of a rejected record.
+ */
+static uint64_t placeholder_word(const struct float_layout *layout) {
+  uint64_t exponent = (UINT64_C(1) << layout->exponent_bits) - 1;
+  return exponent << layout->fraction_bits |
+         UINT64_C(1) << (layout->fraction_bits - 1);
+}
+
+/**
+ * @brief Applies the reject policy to a line of the wrong length.
+ *
+ * @param offset Byte offset of the line in the input read.
+ * @param cut The line filled the read-ahead buffer without ending; the rest
+ *            of it, up to the next newline, is dropped as part of the same
+ *            record.
+ * @return int 0 to go on, -1 if the conversion fails.
+ */
+static int reject_line(struct bf2d_ctx *s, uint64_t offset, int cut) {
+  if (reject_record(s, offset, s->line_number, REJECT_LENGTH)) {
+    return -1;
+  }
+  while (cut) {
+    char *line = s->ahead + s->ahead_start;
+    char *newline =
+        (char *)memchr(line, '\n', s->ahead_end - s->ahead_start);
+    if (newline) {
+      s->ahead_start += (size_t)(newline - line) + 1;
+      break;
+    }
+    s->ahead_start = s->ahead_end;
+    ssize_t got = fill_input(s, 0);
+    if (got == FILL_ERROR) {
+      return -1;
+    } else if (got == FILL_EOF) {
+      s->input_eof = 1;
+      break;
+    }
+  }
+  if (s->options.rejects == STREAM_REJECT_NAN) {
+    uint64_t word = placeholder_word(s->layout);
+    int width = s->layout->width;
+    for (int i = 0; i < width; i++) {
+      s->placeholder[i] = (char)('0' + ((word >> (width - 1 - i)) & 1));
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Starts the latency budget of a block at its first record.
+ */
+static void start_budget(struct bf2d_ctx *s) {
+  s->deadline = s->budget_ns ? latency_now() + s->budget_ns : 0;
+}
+
+static long read_bits(struct bf2d_ctx *s, size_t max) {
+  size_t count = 0;
+  size_t width = (size_t)s->layout->width;
+
+  while (count < max) {
+    char *line = s->ahead + s->ahead_start;
+    size_t available = s->ahead_end - s->ahead_start;
+    char *newline = (char *)memchr(line, '\n', available);
+    size_t length;
+
+    if (newline) {
+      length = (size_t)(newline - line);
+      s->ahead_start += length + 1;
+    } else if (s->input_eof || available >= s->read_bytes) {
+      if (!available) {
+        break;
+      }
+      length = available; // Last line without a newline, or far too long
+      s->ahead_start += length;
+    } else {
+      ssize_t got = fill_input(s, count ? s->deadline : 0);
+      if (got == FILL_TIMEOUT) {
+        break; // Budget spent: convert what has arrived
+      } else if (got == FILL_ERROR) {
+        return -1;
+      } else if (got == FILL_EOF) {
+        s->input_eof = 1;
+      }
+      continue;
+    }
+
+    s->line_number++;
+    if (length > 0 && line[length - 1] == '\r') {
+      length--;
+    }
+    if (length == 0) {
+      continue; // Blank lines carry no record
+    }
+
+    uint64_t offset = s->bytes_in - (s->ahead_end - (size_t)(line - s->ahead));
+    if (length != width) {
+      if (reject_line(s, offset, !newline && !s->input_eof)) {
+        return -1;
+      } else if (s->options.rejects == STREAM_REJECT_SKIP) {
+        continue;
+      }
+      line = s->placeholder;
+    }
+    if (!count) {
+      start_budget(s);
+    }
+    memcpy(s->records + count * width, line, width);
+    s->record_offsets[count] = offset;
+    s->record_lines[count++] = s->line_number;
+  }
+
+  return (long)count;
+}
+
+static long read_raw(struct bf2d_ctx *s, size_t max) {
+  size_t size = (size_t)s->layout->width / 8;
+  size_t count = 0;
+
+  while (count < max) {
+    size_t available = (s->ahead_end - s->ahead_start) / size;
+    size_t take = available < max - count ? available : max - count;
+
+    if (take) {
+      if (!count) {
+        start_budget(s);
+      }
+      memcpy(s->raw + count * size, s->ahead + s->ahead_start, take * size);
+      s->ahead_start += take * size;
+      count += take;
+      continue;
+    } else if (s->input_eof) {
+      if (s->ahead_end > s->ahead_start) {
+        uint64_t offset = s->bytes_in - (s->ahead_end - s->ahead_start);
+        if (reject_record(s, offset, offset / size + 1, REJECT_PARTIAL)) {
+          return -1;
+        }
+        s->ahead_start = s->ahead_end;
+        if (s->options.rejects == STREAM_REJECT_NAN) {
+          uint64_t word = placeholder_word(s->layout);
+          uint32_t narrow = (uint32_t)word;
+          memcpy(s->raw + count * size, size == 4 ? (void *)&narrow : &word,
+                 size);
+          if (!count) {
+            start_budget(s);
+          }
+          count++;
+        }
+      }
+      break;
+    }
+
+    ssize_t got = fill_input(s, count ? s->deadline : 0);
+    if (got == FILL_TIMEOUT) {
+      break;
+    } else if (got == FILL_ERROR) {
+      return -1;
+    } else if (got == FILL_EOF) {
+      s->input_eof = 1;
+    }
+  }
+
+  return (long)count;
+}
+
+/**
+ * @brief Read stage: fetches the next block of records without decoding it.
+ */
+static long read_block(struct bf2d_ctx *s) {
+  if (s->input == STREAM_XOR) {
+    long count = xor_reader_load(&s->xor_in);
+    if (count < 0) {
+      set_error(s, "Corrupt XOR stream");
+    } else if (count > 0) {
+      s->bytes_in += 8 + s->xor_in.length;
+    }
+    return count;
+  } else if (s->input == STREAM_RAW) {
+    return read_raw(s, s->block_values);
+  } else if (s->input == STREAM_GEN) {
+    // Generated words need no conversion, so the corpus counts as read
+    return (long)corpus_fill(&s->corpus, s->words, s->block_values);
+  }
+  return read_bits(s, s->block_values);
+}
+
+/**
+ * @brief Packs the rest of a block from its first malformed record on,
+ *        applying the reject policy.
+ *
+ * @param first Record that failed to pack.
+ * @return long Words kept, or -1 if the conversion fails.
+ */
+static long reject_digits(struct bf2d_ctx *s, size_t first, size_t count) {
+  size_t width = (size_t)s->layout->width;
+  size_t kept = first;
+
+  for (size_t i = first; i < count; i++) {
+    uint64_t word;
+    if (!pack_binary_float(s->records + i * width, width, &word)) {
+      s->words[kept++] = word;
+    } else if (reject_record(s, s->record_offsets[i], s->record_lines[i],
+                             REJECT_DIGIT)) {
+      return -1;
+    } else if (s->options.rejects == STREAM_REJECT_NAN) {
+      s->words[kept++] = placeholder_word(s->layout);
+    }
+  }
+  return (long)kept;
+}
+
+/**
+ * @brief Convert stage: turns the records of a block into packed words.
+ *
+ * @return long Words packed, fewer than `count` once skipped records are
+ *         left out, or -1 on failure.
+ */
+static long convert_block(struct bf2d_ctx *s, size_t count) {
+  size_t width = (size_t)s->layout->width;
+  long kept = (long)count;
+
+  switch (s->input) {
+  case STREAM_XOR:
+    if (xor_reader_decode(&s->xor_in, s->words)) {
+      set_error(s, "Corrupt XOR stream");
+      return -1;
+    }
+    break;
+  case STREAM_RAW:
+    if (width == 32) {
+      for (size_t i = 0; i < count; i++) {
+        uint32_t word;
+        memcpy(&word, s->raw + 4 * i, 4);
+        s->words[i] = word;
+      }
+    } else {
+      memcpy(s->words, s->raw, 8 * count);
+    }
+    break;
+  case STREAM_GEN:
+    break;
+  default:
+    for (size_t i = 0; i < count; i++) {
+      if (pack_binary_float(s->records + i * width, width, &s->words[i])) {
+        kept = reject_digits(s, i, count);
+        break;
+      }
+    }
+    break;
+  }
+  // Every rejection of the block is known now, so they can go in order
+  if (kept >= 0 && s->rejection_count >= REJECT_BATCH &&
+      report_rejections(s)) {
+    set_system_error(s, "Reject report write error");
+    return -1;
+  }
+  return kept;
+}
+
+static size_t format_raw(const struct bf2d_ctx *s, size_t count) {
+  if (s->layout->width == 32) {
+    for (size_t i = 0; i < count; i++) {
+      uint32_t word = (uint32_t)s->words[i];
+      memcpy(s->text + 4 * i, &word, 4);
+    }
+    return 4 * count;
+  }
+  memcpy(s->text, s->words, 8 * count);
+  return 8 * count;
+}
+
+static size_t format_bits(const struct bf2d_ctx *s, const uint64_t *words,
+                          size_t count, char *text) {
+  char *out = text;
+
+  for (size_t i = 0; i < count; i++) {
+    out = bit_picture_render(&s->picture, words[i], out);
+    *out++ = '\n';
+  }
+
+  return (size_t)(out - text);
+}
+
+static size_t format_decimal(const struct bf2d_ctx *s, const uint64_t *words,
+                             size_t count, char *text) {
+  // 9 and 17 significant digits round-trip binary32 and binary64 values
+  int precision = s->layout->width == 32 ? 9 : 17;
+  char *out = text;
+
+  for (size_t i = 0; i < count; i++) {
+    double value = decode_float_word(words[i], s->layout);
+    out += snprintf(out, DECIMAL_CHARS, "%.*g\n", precision, value);
+  }
+
+  return (size_t)(out - text);
+}
+
+/**
+ * @brief Renders words in a line format, which splits at any record.
+ */
+static size_t format_lines(const struct bf2d_ctx *s, const uint64_t *words,
+                           size_t count, char *text) {
+  switch (s->output) {
+  case STREAM_BITS:
+    return format_bits(s, words, count, text);
+  case STREAM_TEMPLATE:
+    return template_emit(&s->template, words, count, text);
+  case STREAM_EXPLAIN:
+    return explain_emit(&s->explain, words, count, text);
+  default:
+    return format_decimal(s, words, count, text);
+  }
+}
+
+/**
+ * @brief A block whose format stage is shared by several threads.
+ */
+struct format_split {
+  const struct bf2d_ctx *s;
+  size_t count;                     // Values in the block
+  size_t chunks;                    // Ranges the block is cut into
+  size_t lengths[SPLIT_MAX_CHUNKS]; // Bytes rendered per range
+};
+
+/**
+ * @brief Start of a range's output, leaving every record its worst case and
+ *        every range the slack its renderer may overwrite.
+ */
+static char *chunk_text(const struct bf2d_ctx *s, size_t first,
+                        size_t chunk) {
+  return s->text + first * s->record_bytes + chunk * BIT_PICTURE_SLACK;
+}
+
+static void format_chunk(void *argument, size_t chunk) {
+  struct format_split *split = (struct format_split *)argument;
+  size_t first = chunk * split->count / split->chunks;
+  size_t end = (chunk + 1) * split->count / split->chunks;
+
+  split->lengths[chunk] =
+      format_lines(split->s, split->s->words + first, end - first,
+                   chunk_text(split->s, first, chunk));
+}
+
+/**
+ * @brief Formats a block on the helper threads and joins the ranges.
+ */
+static size_t format_parallel(struct bf2d_ctx *s, size_t count) {
+  struct format_split split = {s, count, s->tuning->threads, {0}};
+  size_t length;
+
+  if (split.chunks > SPLIT_MAX_CHUNKS) {
+    split.chunks = SPLIT_MAX_CHUNKS;
+  }
+  parallel_run(format_chunk, &split, split.chunks, split.chunks);
+
+  // Every range starts at or after the end of the joined ones before it
+  length = split.lengths[0];
+  for (size_t chunk = 1; chunk < split.chunks; chunk++) {
+    size_t first = chunk * count / split.chunks;
+    memmove(s->text + length, chunk_text(s, first, chunk),
+            split.lengths[chunk]);
+    length += split.lengths[chunk];
+  }
+  return length;
+}
+
+/**
+ * @brief Format stage: renders the words of a block into `s->text`.
+ *
+ * Line formats of large enough blocks are split across threads, at the
+ * block size the tuning found to outweigh waking them.
+ */
+static size_t format_block(struct bf2d_ctx *s, size_t count) {
+  switch (s->output) {
+  case STREAM_XOR:
+    return xor_frame_block(s->words, count, s->layout->width,
+                           (unsigned char *)s->text);
+  case STREAM_RAW:
+    return format_raw(s, count);
+  default:
+    if (s->split_values && count >= s->split_values) {
+      return format_parallel(s, count);
+    }
+    return format_lines(s, s->words, count, s->text);
+  }
+}
+
+/**
+ * @brief Draws how many records to pass before the next verified one.
+ *
+ * Gaps are geometric, so every record is sampled with the verify rate
+ * without a random draw per record.
+ */
+static uint64_t verify_gap(struct bf2d_ctx *s) {
+  double rate = s->options.verify_rate;
+  uint64_t x = (s->verify_random += 0x9E3779B97F4A7C15u); // splitmix64
+  double u, gap;
+
+  if (rate >= 1) {
+    return 0;
+  }
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9u;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBu;
+  u = (double)(((x ^ (x >> 31)) >> 11) + 1) * 0x1.0p-53; // (0, 1]
+  gap = log(u) / log1p(-rate);
+  return gap < 0x1.0p63 ? (uint64_t)gap : UINT64_MAX;
+}
+
+/**
+ * @brief Reparses one decimal line and compares it with its word.
+ *
+ * @param record Index of the record in the block.
+ */
+static void verify_record(struct bf2d_ctx *s, const char *line,
+                          size_t record) {
+  uint64_t word = s->words[record];
+  uint64_t parsed;
+  int hex = s->layout->width / 4;
+
+  if (s->layout->width == 32) {
+    float value = strtof(line, NULL);
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    parsed = bits;
+  } else {
+    double value = strtod(line, NULL);
+    memcpy(&parsed, &value, sizeof(parsed));
+  }
+  s->verified++;
+  // The decimal text of a NaN keeps neither its payload nor its quietness
+  if (parsed == word || (isnan(decode_float_word(word, s->layout)) &&
+                         isnan(decode_float_word(parsed, s->layout)))) {
+    return;
+  }
+  s->mismatches++;
+  if (s->options.verify_log) {
+    fprintf(s->options.verify_log,
+            "Output record %llu: %0*llx was written as %.*s, which reparses "
+            "to %0*llx\n",
+            (unsigned long long)(s->values + record + 1), hex,
+            (unsigned long long)word, (int)strcspn(line, "\n"), line, hex,
+            (unsigned long long)parsed);
+  }
+}
+
+/**
+ * @brief Verify stage: reparses sampled lines of a decimal block.
+ *
+ * Sampling carries across blocks, so the rate holds whatever the block
+ * size.
+ */
+static void verify_block(struct bf2d_ctx *s, size_t count, size_t length) {
+  const char *line = s->text;
+  const char *end = s->text + length;
+  size_t at = 0; // Record `line` belongs to
+  uint64_t next = s->verify_gap;
+  uint64_t gap;
+
+  if (next >= count) {
+    s->verify_gap = next - count;
+    return;
+  }
+  for (;;) {
+    for (; at < next; at++) {
+      line = (const char *)memchr(line, '\n', (size_t)(end - line)) + 1;
+    }
+    verify_record(s, line, at);
+
+    // A gap can be as large as UINT64_MAX at tiny rates, so it is compared
+    // with the records left rather than added to `next`
+    gap = verify_gap(s);
+    if (gap >= count - next - 1) {
+      s->verify_gap = gap - (count - next - 1);
+      return;
+    }
+    next += 1 + gap;
+  }
+}
+
+/**
+ * @brief Write stage: hands a formatted block to the output stream.
+ */
+static int write_block_bytes(struct bf2d_ctx *s, const void *data,
+                             size_t length) {
+  // Under a latency budget, blocks must not linger in the stdio buffer
+  if (fwrite(data, 1, length, s->out) != length ||
+      (s->budget_ns && fflush(s->out))) {
+    set_system_error(s, "Write error");
+    return -1;
+  }
+  if (s->options.checksum) {
+    xxh3_update(&s->hash, data, length);
+  }
+  s->bytes_out += length;
+  return 0;
+}
+
+/**
+ * @brief Records the time since `start` as a stage latency when timing.
+ *
+ * @return uint64_t Current time, the start of the next stage; 0 when latency
+ *         recording is off, so untimed runs never read the clock.
+ */
+static uint64_t stage_done(const struct bf2d_ctx *s, enum latency_metric metric,
+                           uint64_t start) {
+  if (!s->timed) {
+    return 0;
+  }
+  uint64_t now = latency_now();
+  latency_record(metric, now - start);
+  return now;
+}
+
+/**
+ * @brief Moves one block through the read, convert, format and write stages.
+ *
+ * @return long Number of records read, 0 at end of input, -1 on error.
+ */
+static long run_block(struct bf2d_ctx *s) {
+  uint64_t block = s->blocks;
+  uint64_t bytes_in = s->bytes_in;
+  uint64_t start = s->timed ? latency_now() : 0;
+  uint64_t mark;
+  size_t length;
+  long count, read;
+
+  BF2D_PROBE1(block__read__start, block);
+  count = read_block(s);
+  BF2D_PROBE3(block__read__done, block, count, s->bytes_in - bytes_in);
+  if (count <= 0) {
+    if (count < 0 && s->counted) {
+      metrics_add(METRIC_INPUT_ERRORS, 1);
+    }
+    return count;
+  }
+  mark = stage_done(s, LATENCY_READ, start);
+
+  BF2D_PROBE2(block__convert__start, block, count);
+  read = count;
+  if ((count = convert_block(s, (size_t)count)) < 0) {
+    if (s->counted) {
+      metrics_add(METRIC_INPUT_ERRORS, 1);
+    }
+    return -1;
+  } else if (count == 0) {
+    return read; // Every record of the block was skipped
+  }
+  BF2D_PROBE2(block__convert__done, block, count);
+  mark = stage_done(s, LATENCY_CONVERT, mark);
+
+  BF2D_PROBE2(block__format__start, block, count);
+  length = format_block(s, (size_t)count);
+  if (s->verifying) {
+    verify_block(s, (size_t)count, length);
+  }
+  BF2D_PROBE2(block__format__done, block, length);
+  mark = stage_done(s, LATENCY_FORMAT, mark);
+
+  BF2D_PROBE2(block__write__start, block, length);
+  if (write_block_bytes(s, s->text, length)) {
+    if (s->counted) {
+      metrics_add(METRIC_OUTPUT_ERRORS, 1);
+    }
+    return -1;
+  }
+  BF2D_PROBE2(block__write__done, block, length);
+  if (s->timed) {
+    latency_record(LATENCY_BLOCK,
+                   stage_done(s, LATENCY_WRITE, mark) - start);
+    latency_poll();
+  }
+  if (s->counted) {
+    metrics_count_classes(s->words, (size_t)count, s->layout);
+    metrics_add(METRIC_VALUES, (uint64_t)count);
+    metrics_add(METRIC_BLOCKS, 1);
+    metrics_add(METRIC_BYTES_IN, s->bytes_in - bytes_in);
+    metrics_add(METRIC_BYTES_OUT, length);
+  }
+
+  s->blocks++;
+  s->values += (uint64_t)count;
+  return read;
+}
+
+/**
+ * @brief Tells whether two option sets format their output identically.
+ */
+static int same_output(const struct stream_options *a,
+                       const struct stream_options *b) {
+  if (a->output != b->output || a->separator != b->separator ||
+      a->tuning != b->tuning) {
+    return 0;
+  }
+  return a->output != STREAM_TEMPLATE ||
+         (a->template_spec && b->template_spec &&
+          strcmp(a->template_spec, b->template_spec) == 0);
+}
+
+/**
+ * @brief Values per block under `options`; XOR input keeps the blocks of
+ *        its stream, which hold up to `STREAM_BLOCK_VALUES`.
+ */
+static size_t block_values_for(const struct stream_options *options) {
+  if (options->input == STREAM_XOR || !options->block_values ||
+      options->block_values > STREAM_BLOCK_VALUES) {
+    return STREAM_BLOCK_VALUES;
+  }
+  return options->block_values;
+}
+
+/**
+ * @brief Bytes the output of a block of `values` records may take.
+ */
+static size_t block_text_bytes(enum stream_format output, size_t values,
+                               size_t record_bytes) {
+  // Split blocks leave renderer slack after each of their ranges
+  return output == STREAM_XOR
+             ? XOR_FRAME_BYTES(values)
+             : values * record_bytes + SPLIT_MAX_CHUNKS * BIT_PICTURE_SLACK;
+}
+
+/**
+ * @brief Grows the output buffer to hold a whole block.
+ *
+ * @return int 0 on success, -1 if memory ran out.
+ */
+static int reserve_text(struct bf2d_ctx *s) {
+  size_t text_bytes =
+      block_text_bytes(s->output, s->block_values, s->record_bytes);
+
+  if (text_bytes > s->text_capacity) {
+    free(s->text);
+    s->text_capacity = 0;
+    if (!(s->text = (char *)malloc(text_bytes))) {
+      set_error(s, "Memory allocation error.");
+      return -1;
+    }
+    s->text_capacity = text_bytes;
+  }
+  return 0;
+}
+
+/**
+ * @brief Builds the output state for `width` unless it is already cached.
+ *
+ * @return int 0 on success, -1 if the template is malformed or memory ran
+ *         out.
+ */
+static int prepare_output(struct bf2d_ctx *s, int width) {
+  size_t record_bytes = DECIMAL_CHARS;
+
+  s->layout = float_layout_for(width);
+  if (s->prepared_width == width) {
+    s->stats.format_hits++;
+    if (s->counted) {
+      metrics_add(METRIC_FORMAT_HITS, 1);
+    }
+    return reserve_text(s);
+  }
+  s->stats.format_misses++;
+  if (s->counted) {
+    metrics_add(METRIC_FORMAT_MISSES, 1);
+  }
+
+  if (s->output == STREAM_BITS) {
+    bit_picture_init(&s->picture, s->layout, s->options.separator);
+    if (!s->tuning->simd) {
+      bit_picture_portable(&s->picture);
+    }
+    record_bytes = s->picture.length + 1;
+  } else if (s->output == STREAM_TEMPLATE) {
+    // Compiled once, so records never re-read the template text
+    if (template_compile(&s->template, s->options.template_spec, s->layout)) {
+      set_error(s, "%s", s->template.error);
+      return -1;
+    }
+    record_bytes = s->template.record_bytes;
+  } else if (s->output == STREAM_EXPLAIN) {
+    explain_init(&s->explain, s->layout);
+    if (!s->tuning->simd) {
+      bit_picture_portable(&s->explain.picture);
+    }
+    record_bytes = s->explain.record_bytes;
+  } else if (s->output == STREAM_RAW) {
+    record_bytes = sizeof(uint64_t);
+  }
+
+  s->record_bytes = record_bytes;
+  s->prepared_width = width;
+  return reserve_text(s);
+}
+
+/**
+ * @brief Allocates the input buffers of the current input format, keeping
+ *        them while they hold a whole block.
+ *
+ * @return int 0 on success, -1 if memory ran out.
+ */
+static int prepare_input(struct bf2d_ctx *s) {
+  if (s->input != STREAM_RAW && s->input != STREAM_BITS) {
+    return 0;
+  }
+  // Direct reads need aligned room after up to an aligned page of slack
+  size_t capacity = s->read_bytes + 2 * FILE_INPUT_ALIGNMENT;
+  if (s->ahead_capacity < capacity) {
+    void *ahead;
+    if (posix_memalign(&ahead, FILE_INPUT_ALIGNMENT, capacity)) {
+      goto fail;
+    }
+    free(s->ahead);
+    s->ahead = (char *)ahead;
+    s->ahead_capacity = capacity;
+  }
+  if (s->block_capacity < s->block_values) {
+    free(s->raw);
+    free(s->records);
+    free(s->record_lines);
+    free(s->record_offsets);
+    s->raw = NULL;
+    s->records = NULL;
+    s->record_lines = NULL;
+    s->record_offsets = NULL;
+    s->block_capacity = s->block_values;
+  }
+  if (s->input == STREAM_RAW) {
+    if (!s->raw && !(s->raw = (unsigned char *)malloc(s->block_capacity *
+                                                      sizeof(uint64_t)))) {
+      goto fail;
+    }
+    return 0;
+  }
+  // Sized for the widest records, so a width change never reallocates
+  if (!s->records &&
+      !(s->records = (char *)malloc(s->block_capacity * 64))) {
+    goto fail;
+  }
+  if (!s->record_lines && !(s->record_lines = (size_t *)malloc(
+                                s->block_capacity * sizeof(size_t)))) {
+    goto fail;
+  }
+  if (!s->record_offsets && !(s->record_offsets = (uint64_t *)malloc(
+                                  s->block_capacity * sizeof(uint64_t)))) {
+    goto fail;
+  }
+  return 0;
+
+fail:
+  set_error(s, "Memory allocation error.");
+  return -1;
+}
+
+/**
+ * @brief Longest output of one record, as `prepare_output` finds it; a
+ *        template that does not compile counts as empty.
+ */
+static size_t worst_record_bytes(const struct stream_options *options,
+                                 const struct float_layout *layout) {
+  switch (options->output) {
+  case STREAM_BITS: {
+    struct bit_picture picture;
+    bit_picture_init(&picture, layout, options->separator);
+    return picture.length + 1;
+  }
+  case STREAM_TEMPLATE: {
+    struct output_template template;
+    return template_compile(&template, options->template_spec, layout)
+               ? 0
+               : template.record_bytes;
+  }
+  case STREAM_EXPLAIN: {
+    struct explain_format explain;
+    explain_init(&explain, layout);
+    return explain.record_bytes;
+  }
+  case STREAM_RAW:
+    return sizeof(uint64_t);
+  default:
+    return DECIMAL_CHARS;
+  }
+}
+
+/**
+ * @brief Estimates the bytes a context holds while converting with `options`.
+ *
+ * Counts the context and its block, read-ahead and output buffers, which
+ * scale with `block_values` and `read_bytes`; the stdio buffers of the
+ * streams are not included.
+ *
+ * @param options Conversion options.
+ * @return size_t Bytes held at most.
+ */
+size_t stream_memory_bytes(const struct stream_options *options) {
+  // XOR input takes its width from the stream, so assume the wider one
+  const struct float_layout *layout =
+      float_layout_for(options->input == STREAM_XOR ? 64 : options->width);
+  size_t values = block_values_for(options);
+  size_t read_bytes = options->read_bytes ? options->read_bytes
+                                          : STREAM_READ_BYTES;
+  size_t bytes = sizeof(struct bf2d_ctx);
+
+  if (!layout) {
+    layout = float_layout_for(64);
+  }
+  bytes += block_text_bytes(options->output, values,
+                            worst_record_bytes(options, layout));
+  if (options->input == STREAM_RAW || options->input == STREAM_BITS) {
+    bytes += (read_bytes < MIN_READ_BYTES ? MIN_READ_BYTES : read_bytes) +
+             2 * FILE_INPUT_ALIGNMENT;
+    bytes += options->input == STREAM_RAW
+                 ? values * sizeof(uint64_t)
+                 : values * (64 + sizeof(size_t) + sizeof(uint64_t));
+  } else if (options->input == STREAM_XOR) {
+    bytes += XOR_FRAME_BYTES(values); // Payload of the block being decoded
+  }
+  return bytes;
+}
+
+/**
+ * @brief Creates a conversion context.
+ *
+ * A context owns every buffer and compiled format a conversion needs and
+ * keeps them between calls, so repeated conversions allocate nothing once
+ * the buffers have grown to fit. Contexts share no state, and each one may
+ * be used by one thread at a time; threads that convert concurrently each
+ * own a context.
+ *
+ * @param options Initial conversion options, copied into the context.
+ * @return struct bf2d_ctx* The context, or NULL if memory ran out.
+ */
+struct bf2d_ctx *bf2d_ctx_create(const struct stream_options *options) {
+  struct bf2d_ctx *s = (struct bf2d_ctx *)calloc(1, sizeof(*s));
+
+  if (!s) {
+    return NULL;
+  }
+  if (bf2d_ctx_set_options(s, options)) {
+    free(s);
+    return NULL;
+  }
+  return s;
+}
+
+/**
+ * @brief Replaces the options of a context.
+ *
+ * Compiled output formats are kept when the output format, separator and
+ * template text are unchanged.
+ *
+ * @param s Context to update.
+ * @param options New options, copied; the template text is copied too.
+ * @return int 0 on success, -1 if memory ran out.
+ */
+int bf2d_ctx_set_options(struct bf2d_ctx *s,
+                         const struct stream_options *options) {
+  if (!same_output(&s->options, options)) {
+    s->prepared_width = 0;
+  }
+  if (options->template_spec &&
+      (!s->template_text ||
+       strcmp(s->template_text, options->template_spec) != 0)) {
+    char *text = strdup(options->template_spec);
+    if (!text) {
+      set_error(s, "Memory allocation error.");
+      return -1;
+    }
+    free(s->template_text);
+    s->template_text = text;
+  }
+
+  s->options = *options;
+  s->options.template_spec = options->template_spec ? s->template_text : NULL;
+  s->input = options->input;
+  s->output = options->output;
+  s->budget_ns = options->latency_budget_us * 1000u;
+  s->read_bytes = options->read_bytes ? options->read_bytes : STREAM_READ_BYTES;
+  if (s->read_bytes < MIN_READ_BYTES) {
+    s->read_bytes = MIN_READ_BYTES;
+  }
+  s->block_values = block_values_for(options);
+  s->tuning = options->tuning ? options->tuning : tuning_get();
+  s->split_values =
+      s->tuning->threads > 1 ? s->tuning->split_values[s->output] : 0;
+  s->verifying = s->output == STREAM_DECIMAL && options->verify_rate > 0;
+  return 0;
+}
+
+/**
+ * @brief Tells whether the caller asked to stop, recording why if so.
+ */
+static int cancelled(struct bf2d_ctx *s) {
+  if (s->options.cancel &&
+      atomic_load_explicit(s->options.cancel, memory_order_relaxed)) {
+    set_error(s, "Conversion cancelled");
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Resets the per-conversion state, reads the input header and
+ *        allocates the input buffers.
+ *
+ * @return int Width of the input words, or -1 on failure.
+ */
+static int start_input(struct bf2d_ctx *s, FILE *in) {
+  int width = s->options.width;
+
+  s->in = in;
+  s->in_fd = in ? fileno(in) : -1; // Generated input has no stream
+  file_input_open(&s->file, s->in_fd,
+                  s->input == STREAM_BITS || s->input == STREAM_RAW
+                      ? s->options.read_mode
+                      : STREAM_READ_BUFFERED);
+  s->line_number = 0;
+  s->ahead_start = s->ahead_end = 0;
+  s->input_eof = 0;
+  s->blocks = s->values = s->bytes_in = s->bytes_out = 0;
+  s->reads = s->read_ns = 0;
+  s->rejected = 0;
+  s->rejection_count = 0;
+  s->verified = s->mismatches = 0;
+  s->verify_random = VERIFY_SEED;
+  s->verify_gap = s->verifying ? verify_gap(s) : 0;
+  s->input_left = s->options.input_limit ? s->options.input_limit : UINT64_MAX;
+  s->timed = latency_enabled();
+  s->counted = metrics_enabled();
+  s->error[0] = '\0';
+  s->stats.conversions++;
+
+  if (s->input == STREAM_XOR) {
+    errno = 0;
+    if (xor_reader_open(&s->xor_in, in)) {
+      set_error(s, errno == ENOMEM ? "Memory allocation error."
+                                   : "Input is not an XOR stream");
+      return -1;
+    }
+    width = s->xor_in.width;
+  }
+  s->layout = float_layout_for(width);
+  if (prepare_input(s)) {
+    return -1;
+  }
+  if (s->input == STREAM_GEN) {
+    corpus_init(&s->corpus, &s->options.corpus, s->layout);
+  }
+  return width;
+}
+
+/**
+ * @brief Reports the last rejections, restores the input descriptor and
+ *        adds the totals of the finished conversion to the context's.
+ *
+ * @param count 0 if the conversion reached the end of its input.
+ * @return int 0 on success, -1 if the conversion failed.
+ */
+static int finish_conversion(struct bf2d_ctx *s, long count) {
+  file_input_close(&s->file);
+  // The rejections before a failure are reported too
+  if (s->rejection_count && report_rejections(s) && count == 0) {
+    set_system_error(s, "Reject report write error");
+    count = -1;
+  }
+  s->stats.rejected += s->rejected;
+  s->stats.verified += s->verified;
+  s->stats.mismatches += s->mismatches;
+  if (s->counted && s->rejected) {
+    metrics_add(METRIC_REJECTED_RECORDS, s->rejected);
+  }
+  if (s->counted && s->verified) {
+    metrics_add(METRIC_VERIFIED_VALUES, s->verified);
+    metrics_add(METRIC_VERIFY_MISMATCHES, s->mismatches);
+  }
+  s->stats.reads += s->reads;
+  s->stats.read_ns += s->read_ns;
+  s->stats.blocks += s->blocks;
+  s->stats.values += s->values;
+  s->stats.bytes_in += s->bytes_in;
+  s->stats.bytes_out += s->bytes_out;
+  if (count == 0) {
+    return 0;
+  }
+  s->stats.failures++;
+  return -1;
+}
+
+/**
+ * @brief Converts every record of `in` and writes the result to `out`.
+ *
+ * @param s Context holding the options and buffers.
+ * @param in Source stream, or NULL for `STREAM_GEN` input.
+ * @param out Destination stream.
+ * @return int 0 on success, -1 if the input is malformed or an I/O error
+ *         occurred. The reason is kept for `bf2d_ctx_error`.
+ */
+int bf2d_ctx_convert(struct bf2d_ctx *s, FILE *in, FILE *out) {
+  int width = start_input(s, in);
+  long count;
+
+  s->out = out;
+  xxh3_reset(&s->hash);
+  if (width < 0 || prepare_output(s, width)) {
+    return finish_conversion(s, -1);
+  }
+  if (s->output == STREAM_XOR && !s->options.omit_header) {
+    unsigned char header[XOR_STREAM_HEADER_BYTES];
+    xor_stream_header(header, width);
+    if (write_block_bytes(s, header, sizeof(header))) {
+      return finish_conversion(s, -1);
+    }
+  }
+
+  do {
+    count = cancelled(s) ? -1 : run_block(s);
+  } while (count > 0);
+  BF2D_PROBE4(batch, s->blocks, s->values, s->bytes_in, s->bytes_out);
+  return finish_conversion(s, count);
+}
+
+/**
+ * @brief Decodes every record of `in` into sign, exponent, significand and
+ *        class columns.
+ *
+ * The records are read and packed as by `bf2d_ctx_convert`; the output
+ * options of the context are ignored.
+ *
+ * @param s Context holding the options and buffers.
+ * @param in Source stream, or NULL for `STREAM_GEN` input.
+ * @param columns Receives one row per record after its filled rows, and is
+ *                grown as needed.
+ * @return int 0 on success, -1 if the input is malformed, an I/O error
+ *         occurred or memory ran out. The rows decoded before the failure
+ *         are kept.
+ */
+int bf2d_ctx_decode(struct bf2d_ctx *s, FILE *in,
+                    struct float_columns *columns) {
+  long count;
+
+  s->out = NULL;
+  if (start_input(s, in) < 0) {
+    return finish_conversion(s, -1);
+  }
+
+  do {
+    long kept = 0;
+    if (cancelled(s) || (count = read_block(s)) < 0 ||
+        (count > 0 && (kept = convert_block(s, (size_t)count)) < 0)) {
+      count = -1;
+    } else if (kept > 0) {
+      if (float_columns_append(columns, s->words, (size_t)kept, s->layout)) {
+        set_error(s, "Memory allocation error.");
+        count = -1;
+      } else {
+        s->blocks++;
+        s->values += (uint64_t)kept;
+      }
+    }
+  } while (count > 0);
+  return finish_conversion(s, count);
+}
+
+/**
+ * @brief Returns why the last conversion of a context failed.
+ *
+ * @param s Context to query.
+ * @return const char* Message without a trailing newline, empty after a
+ *         successful conversion.
+ */
+const char *bf2d_ctx_error(const struct bf2d_ctx *s) { return s->error; }
+
+/**
+ * @brief Returns the totals of every conversion run in a context.
+ *
+ * @param s Context to query.
+ * @return const struct bf2d_stats* Counters owned by the context.
+ */
+const struct bf2d_stats *bf2d_ctx_stats(const struct bf2d_ctx *s) {
+  return &s->stats;
+}
+
+/**
+ * @brief Returns the checksum of the output of the last conversion.
+ *
+ * @param s Context whose options enable `checksum`.
+ * @return uint64_t XXH3-64 of the output written so far by the last
+ *         conversion.
+ */
+uint64_t bf2d_ctx_checksum(const struct bf2d_ctx *s) {
+  return xxh3_digest(&s->hash);
+}
+
+/**
+ * @brief Releases a context and all of its buffers.
+ *
+ * @param s Context to destroy, or NULL.
+ */
+void bf2d_ctx_destroy(struct bf2d_ctx *s) {
+  if (!s) {
+    return;
+  }
+  xor_reader_close(&s->xor_in);
+  free(s->template_text);
+  free(s->ahead);
+  free(s->records);
+  free(s->record_lines);
+  free(s->record_offsets);
+  free(s->rejections);
+  free(s->text);
+  free(s->raw);
+  free(s);
+}
+
+/**
+ * @brief Converts every record of `in` and writes the result to `out`.
+ *
+ * Runs a conversion in a context of its own. Callers that convert many
+ * streams should keep a context from `bf2d_ctx_create` instead.
+ *
+ * @param options Conversion options. For XOR input the width is taken from the
+ *                stream header instead of `options->width`.
+ * @param in Source stream, or NULL for `STREAM_GEN` input.
+ * @param out Destination stream.
+ * @return int 0 on success, -1 if the input is malformed or an I/O error
+ *         occurred. A message is printed to stderr in the latter case.
+ */
+int run_stream(const struct stream_options *options, FILE *in, FILE *out) {
+  struct bf2d_ctx *s = bf2d_ctx_create(options);
+  int status;
+
+  if (!s) {
+    return -1;
+  }
+  status = bf2d_ctx_convert(s, in, out);
+  if (status) {
+    fprintf(stderr, "%s\n", s->error);
+  }
+  bf2d_ctx_destroy(s);
+  return status;
+}
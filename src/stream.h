@@ -0,0 +1,297 @@
+/**
+ * @file stream.h
+ * @brief Batch conversion of float streams between input and output formats.
+ *
+ * The batch pipeline reads records in blocks, packs them into IEEE 754 words
+ * and writes every block in the requested output format, so large inputs are
+ * converted without per-value prompts or prints.
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "corpus.h"
+
+struct float_columns;
+struct tuning;
+
+/** @brief Number of values converted per block. */
+#define STREAM_BLOCK_VALUES 4096
+
+/** @brief Default size of every read from text and raw input. */
+#define STREAM_READ_BYTES 65536
+
+/** @brief Longest error message kept by a context, with its terminator. */
+#define STREAM_ERROR_BYTES 256
+
+/**
+ * @brief Record formats understood by the batch pipeline.
+ */
+enum stream_format {
+  STREAM_BITS,     /**< One string of '0's and '1's per line. */
+  STREAM_DECIMAL,  /**< One decimal value per line (output only). */
+  STREAM_XOR,      /**< Gorilla-style XOR-delta stream, see xor_stream.h. */
+  STREAM_TEMPLATE, /**< User-defined line format, see template.h. */
+  STREAM_EXPLAIN,  /**< Fixed-width field breakdown, see explain.h. */
+  STREAM_RAW,      /**< Native binary32 or binary64 array. */
+  STREAM_GEN,      /**< Synthetic corpus (input only), see corpus.h. */
+};
+
+/**
+ * @brief How text and raw input is read from a regular file.
+ *
+ * Pipes, sockets and XOR input are always read as `STREAM_READ_BUFFERED`.
+ */
+enum stream_read {
+  STREAM_READ_BUFFERED,   /**< Plain reads through the page cache. */
+  STREAM_READ_SEQUENTIAL, /**< Reads with a widened readahead window; pages
+                               already read are dropped from the cache. */
+  STREAM_READ_DIRECT,     /**< `O_DIRECT` reads that bypass the cache,
+                               or `STREAM_READ_SEQUENTIAL` where the file
+                               system does not support them. */
+};
+
+/**
+ * @brief What becomes of a malformed text or raw record.
+ *
+ * A corrupt XOR stream cannot be resynchronized and always fails.
+ */
+enum stream_rejects {
+  STREAM_REJECT_FAIL, /**< Stop the conversion with an error. */
+  STREAM_REJECT_SKIP, /**< Leave the record out of the output. */
+  STREAM_REJECT_NAN,  /**< Convert a quiet NaN in its place, so the output
+                           keeps one record per input record. */
+};
+
+/**
+ * @brief Options for a batch conversion.
+ */
+struct stream_options {
+  int width;                    /**< Word width in bits (32 or 64). */
+  enum stream_format input;     /**< Format of the input records. */
+  enum stream_format output;    /**< Format of the output records. */
+  const char *template_spec;    /**< Line format for `STREAM_TEMPLATE`. */
+  char separator;               /**< Field separator in `STREAM_BITS`. */
+  struct corpus_options corpus; /**< Corpus for `STREAM_GEN` input. */
+  uint64_t latency_budget_us;   /**< Longest wait to fill a text or raw
+                                     block before converting what has
+                                     arrived, 0 to always fill blocks. */
+  const atomic_int *cancel;     /**< Checked before every block; once it is
+                                     non-zero the conversion stops and
+                                     fails. NULL if it cannot be cancelled. */
+  const struct tuning *tuning;  /**< Execution strategy, see tuning.h, or
+                                     NULL for this machine's calibration. */
+  enum stream_read read_mode;   /**< How input files are read. */
+  size_t read_bytes;            /**< Bytes per read of text or raw input,
+                                     at least 4096; 0 for
+                                     `STREAM_READ_BYTES`. */
+  uint64_t input_limit;         /**< Most bytes of text or raw input to
+                                     read, 0 to read to the end. */
+  int omit_header;              /**< Leave out the `STREAM_XOR` header, for
+                                     output appended to another stream. */
+  size_t block_values;          /**< Most text, raw or generated values per
+                                     block, 0 for `STREAM_BLOCK_VALUES`;
+                                     XOR input keeps its own blocks. */
+  enum stream_rejects rejects;  /**< Policy for malformed records. */
+  FILE *reject_report;          /**< Receives `offset,record,reason` for
+                                     every rejected record, or NULL; see
+                                     `bf2d_ctx_convert`. */
+  int checksum;                 /**< Hash the output as it is written, see
+                                     `bf2d_ctx_checksum`. */
+  double verify_rate;           /**< Fraction of `STREAM_DECIMAL` records
+                                     reparsed and compared with the word
+                                     they were formatted from, from 0
+                                     (none) to 1 (all). */
+  FILE *verify_log;             /**< Receives a line for every record that
+                                     reparses to another word, or NULL. */
+};
+
+/**
+ * @brief Totals over every conversion run in one context.
+ */
+struct bf2d_stats {
+  uint64_t conversions;   /**< Calls of `bf2d_ctx_convert` and
+                               `bf2d_ctx_decode`. */
+  uint64_t failures;      /**< Conversions that failed or were cancelled. */
+  uint64_t blocks;        /**< Blocks written. */
+  uint64_t values;        /**< Values written. */
+  uint64_t bytes_in;      /**< Input bytes consumed. */
+  uint64_t bytes_out;     /**< Output bytes written. */
+  uint64_t reads;         /**< Reads of text or raw input. */
+  uint64_t read_ns;       /**< Time spent in those reads. */
+  uint64_t rejected;      /**< Malformed records skipped or replaced. */
+  uint64_t verified;      /**< Decimal records reparsed to check them. */
+  uint64_t mismatches;    /**< Of those, records that reparsed to another
+                               word. */
+  uint64_t format_hits;   /**< Conversions that reused the compiled output
+                               format of the one before. */
+  uint64_t format_misses; /**< Conversions that had to build it. */
+};
+
+/**
+ * @brief Conversion context: options, scratch buffers, compiled output
+ *        formats and counters, reused by every conversion run in it.
+ */
+struct bf2d_ctx;
+
+/**
+ * @brief Looks up a record format by name.
+ *
+ * @param name Format name: "bits", "decimal", "xor", "explain" or "raw".
+ * @param format Receives the format.
+ * @return int 0 on success, -1 if the name is unknown.
+ */
+int stream_format_from_name(const char *name, enum stream_format *format);
+
+/**
+ * @brief Looks up an input read mode by name.
+ *
+ * @param name Mode name: "buffered", "sequential" or "direct".
+ * @param mode Receives the mode.
+ * @return int 0 on success, -1 if the name is unknown.
+ */
+int stream_read_from_name(const char *name, enum stream_read *mode);
+
+/**
+ * @brief Looks up a malformed-record policy by name.
+ *
+ * @param name Policy name: "fail", "skip" or "nan".
+ * @param policy Receives the policy.
+ * @return int 0 on success, -1 if the name is unknown.
+ */
+int stream_rejects_from_name(const char *name, enum stream_rejects *policy);
+
+/**
+ * @brief Estimates the bytes a context holds while converting with `options`.
+ *
+ * Counts the context and its block, read-ahead and output buffers, which
+ * scale with `block_values` and `read_bytes`; the stdio buffers of the
+ * streams are not included.
+ *
+ * @param options Conversion options.
+ * @return size_t Bytes held at most.
+ */
+size_t stream_memory_bytes(const struct stream_options *options);
+
+/**
+ * @brief Creates a conversion context.
+ *
+ * A context owns every buffer and compiled format a conversion needs and
+ * keeps them between calls, so repeated conversions allocate nothing once
+ * the buffers have grown to fit. Contexts share no state, and each one may
+ * be used by one thread at a time; threads that convert concurrently each
+ * own a context.
+ *
+ * @param options Initial conversion options, copied into the context.
+ * @return struct bf2d_ctx* The context, or NULL if memory ran out.
+ */
+struct bf2d_ctx *bf2d_ctx_create(const struct stream_options *options);
+
+/**
+ * @brief Replaces the options of a context.
+ *
+ * Compiled output formats are kept when the output format, separator and
+ * template text are unchanged.
+ *
+ * @param s Context to update.
+ * @param options New options, copied; the template text is copied too.
+ * @return int 0 on success, -1 if memory ran out.
+ */
+int bf2d_ctx_set_options(struct bf2d_ctx *s,
+                         const struct stream_options *options);
+
+/**
+ * @brief Converts every record of `in` and writes the result to `out`.
+ *
+ * Unless the policy is `STREAM_REJECT_FAIL`, malformed records are skipped
+ * or replaced and reported to `reject_report` in batches, one CSV line each
+ * without a header: the byte offset of the record in the input read, its
+ * line number (text) or index from 1 (raw), and `length` for a line of the
+ * wrong length, `digit` for a character other than '0' or '1', or
+ * `partial` for a raw record cut short by the end of the input. Lines come
+ * in input order.
+ *
+ * @param s Context holding the options and buffers.
+ * @param in Source stream, or NULL for `STREAM_GEN` input.
+ * @param out Destination stream.
+ * @return int 0 on success, -1 if the input is malformed or an I/O error
+ *         occurred. The reason is kept for `bf2d_ctx_error`.
+ */
+int bf2d_ctx_convert(struct bf2d_ctx *s, FILE *in, FILE *out);
+
+/**
+ * @brief Decodes every record of `in` into sign, exponent, significand and
+ *        class columns.
+ *
+ * The records are read and packed as by `bf2d_ctx_convert`; the output
+ * options of the context are ignored.
+ *
+ * @param s Context holding the options and buffers.
+ * @param in Source stream, or NULL for `STREAM_GEN` input.
+ * @param columns Receives one row per record after its filled rows, and is
+ *                grown as needed.
+ * @return int 0 on success, -1 if the input is malformed, an I/O error
+ *         occurred or memory ran out. The rows decoded before the failure
+ *         are kept.
+ */
+int bf2d_ctx_decode(struct bf2d_ctx *s, FILE *in,
+                    struct float_columns *columns);
+
+/**
+ * @brief Returns why the last conversion of a context failed.
+ *
+ * @param s Context to query.
+ * @return const char* Message without a trailing newline, empty after a
+ *         successful conversion.
+ */
+const char *bf2d_ctx_error(const struct bf2d_ctx *s);
+
+/**
+ * @brief Returns the totals of every conversion run in a context.
+ *
+ * @param s Context to query.
+ * @return const struct bf2d_stats* Counters owned by the context.
+ */
+const struct bf2d_stats *bf2d_ctx_stats(const struct bf2d_ctx *s);
+
+/**
+ * @brief Returns the checksum of the output of the last conversion.
+ *
+ * Every byte `bf2d_ctx_convert` writes is hashed right after it is written,
+ * while it is still in cache, so no second pass over the output is needed.
+ * The hash covers the whole output in order, whatever its blocks or the
+ * threads that formatted them, and equals `xxhsum -H3` of it.
+ *
+ * @param s Context whose options enable `checksum`.
+ * @return uint64_t XXH3-64 of the output written so far by the last
+ *         conversion.
+ */
+uint64_t bf2d_ctx_checksum(const struct bf2d_ctx *s);
+
+/**
+ * @brief Releases a context and all of its buffers.
+ *
+ * @param s Context to destroy, or NULL.
+ */
+void bf2d_ctx_destroy(struct bf2d_ctx *s);
+
+/**
+ * @brief Converts every record of `in` and writes the result to `out`.
+ *
+ * Runs a conversion in a context of its own. Callers that convert many
+ * streams should keep a context from `bf2d_ctx_create` instead.
+ *
+ * @param options Conversion options. For XOR input the width is taken from the
+ *                stream header instead of `options->width`.
+ * @param in Source stream, or NULL for `STREAM_GEN` input.
+ * @param out Destination stream.
+ * @return int 0 on success, -1 if the input is malformed or an I/O error
+ *         occurred. A message is printed to stderr in the latter case.
+ */
+int run_stream(const struct stream_options *options, FILE *in, FILE *out);
+
+#endif
@@ -0,0 +1,273 @@
+/**
+ * @file template.c
+ * @brief User-defined output line formats compiled into emit operations.
+ */
+
+#include "template.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#define EXPONENT_CHARS 5 // "-1022" is the widest unbiased exponent
+#define CLASS_CHARS 9    // "subnormal"
+#define VALUE_CHARS 32   // Longest "%.17g" or "%.16e" value
+#define FIXED_CHARS 320  // "%f" of the largest binary64 value
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static void fail(struct output_template *tpl, const char *format, ...) {
+  va_list args;
+
+  va_start(args, format);
+  vsnprintf(tpl->error, sizeof(tpl->error), format, args);
+  va_end(args);
+}
+
+static struct template_op *add_op(struct output_template *tpl,
+                                  enum template_opcode opcode) {
+  if (tpl->op_count == TEMPLATE_MAX_OPS) {
+    fail(tpl, "Template has more than %d fields", TEMPLATE_MAX_OPS);
+    return NULL;
+  }
+
+  struct template_op *op = &tpl->ops[tpl->op_count++];
+  memset(op, 0, sizeof(*op));
+  op->opcode = opcode;
+  return op;
+}
+
+static int add_literal(struct output_template *tpl, const char *text,
+                       size_t length) {
+  struct template_op *last = tpl->op_count ? &tpl->ops[tpl->op_count - 1]
+                                           : NULL;
+
+  if (tpl->literal_count + length > TEMPLATE_MAX_LITERALS) {
+    fail(tpl, "Template has more than %d literal characters",
+         TEMPLATE_MAX_LITERALS);
+    return -1;
+  }
+  memcpy(tpl->literals + tpl->literal_count, text, length);
+
+  // Adjacent literals are copied by a single operation
+  if (!last || last->opcode != TEMPLATE_LITERAL) {
+    if (!(last = add_op(tpl, TEMPLATE_LITERAL))) {
+      return -1;
+    }
+    last->offset = tpl->literal_count;
+  }
+  last->length += length;
+  tpl->literal_count += length;
+  tpl->record_bytes += length;
+  return 0;
+}
+
+static int add_bits(struct output_template *tpl, int shift, int count) {
+  struct template_op *op = add_op(tpl, TEMPLATE_BITS);
+  if (!op) {
+    return -1;
+  }
+  op->shift = shift;
+  op->count = count;
+  tpl->record_bytes += (size_t)count;
+  return 0;
+}
+
+static int add_value(struct output_template *tpl, const char *style,
+                     size_t style_length) {
+  int width = tpl->layout->width;
+  struct template_op *op = add_op(tpl, TEMPLATE_VALUE);
+  if (!op) {
+    return -1;
+  }
+
+  if (!style || (style_length == 8 && !memcmp(style, "shortest", 8))) {
+    op->format = "%.*g";
+    op->count = width == 32 ? 9 : 17; // Significant digits to round-trip
+    tpl->record_bytes += VALUE_CHARS;
+  } else if (style_length == 3 && !memcmp(style, "sci", 3)) {
+    op->format = "%.*e";
+    op->count = width == 32 ? 8 : 16; // Plus the digit before the point
+    tpl->record_bytes += VALUE_CHARS;
+  } else if (style_length == 5 && !memcmp(style, "fixed", 5)) {
+    op->format = "%.*f";
+    op->count = 6;
+    tpl->record_bytes += FIXED_CHARS;
+  } else {
+    fail(tpl, "Unknown value style: %.*s", (int)style_length, style);
+    return -1;
+  }
+  return 0;
+}
+
+static int add_field(struct output_template *tpl, const char *name,
+                     size_t length) {
+  const struct float_layout *layout = tpl->layout;
+  const char *style = memchr(name, ':', length);
+  size_t name_length = style ? (size_t)(style - name) : length;
+  struct template_op *op;
+
+#define FIELD_IS(literal)                                                      \
+  (name_length == sizeof(literal) - 1 && !memcmp(name, literal, name_length))
+
+  if (style && !FIELD_IS("value")) {
+    fail(tpl, "Only {value} takes a style");
+    return -1;
+  }
+
+  if (FIELD_IS("bits")) {
+    return add_bits(tpl, 0, layout->width);
+  } else if (FIELD_IS("sign")) {
+    return add_bits(tpl, layout->width - 1, 1);
+  } else if (FIELD_IS("exponent_bits")) {
+    return add_bits(tpl, layout->fraction_bits, layout->exponent_bits);
+  } else if (FIELD_IS("fraction_bits")) {
+    return add_bits(tpl, 0, layout->fraction_bits);
+  } else if (FIELD_IS("hex")) {
+    if (!(op = add_op(tpl, TEMPLATE_HEX))) {
+      return -1;
+    }
+    op->count = layout->width / 4;
+    tpl->record_bytes += (size_t)op->count;
+  } else if (FIELD_IS("exponent")) {
+    if (!add_op(tpl, TEMPLATE_EXPONENT)) {
+      return -1;
+    }
+    tpl->record_bytes += EXPONENT_CHARS;
+  } else if (FIELD_IS("class")) {
+    if (!add_op(tpl, TEMPLATE_CLASS)) {
+      return -1;
+    }
+    tpl->record_bytes += CLASS_CHARS;
+  } else if (FIELD_IS("value")) {
+    return style ? add_value(tpl, style + 1, length - name_length - 1)
+                 : add_value(tpl, NULL, 0);
+  } else {
+    fail(tpl, "Unknown template field: {%.*s}", (int)length, name);
+    return -1;
+  }
+
+#undef FIELD_IS
+  return 0;
+}
+
+/**
+ * @brief Parses a template into emit operations.
+ *
+ * @param tpl Receives the compiled template.
+ * @param spec Template text, see the file description for placeholders.
+ * @param layout Layout of the words the template will format.
+ * @return int 0 on success, -1 if the template is malformed. The reason is
+ *         left in `tpl->error`.
+ */
+int template_compile(struct output_template *tpl, const char *spec,
+                     const struct float_layout *layout) {
+  memset(tpl, 0, sizeof(*tpl));
+  tpl->layout = layout;
+
+  while (*spec) {
+    if ((spec[0] == '{' && spec[1] == '{') ||
+        (spec[0] == '}' && spec[1] == '}')) {
+      if (add_literal(tpl, spec, 1)) {
+        return -1;
+      }
+      spec += 2;
+    } else if (*spec == '{') {
+      const char *end = strchr(spec, '}');
+      if (!end) {
+        fail(tpl, "Unterminated template field: %s", spec);
+        return -1;
+      }
+      if (add_field(tpl, spec + 1, (size_t)(end - spec - 1))) {
+        return -1;
+      }
+      spec = end + 1;
+    } else if (*spec == '}') {
+      fail(tpl, "Unmatched '}' in template");
+      return -1;
+    } else {
+      size_t length = strcspn(spec, "{}");
+      if (add_literal(tpl, spec, length)) {
+        return -1;
+      }
+      spec += length;
+    }
+  }
+
+  return add_literal(tpl, "\n", 1);
+}
+
+static char *emit_exponent(char *out, uint64_t word,
+                           const struct float_layout *layout) {
+  int exponent = float_word_exponent(word, layout);
+  char digits[EXPONENT_CHARS];
+  int length = 0;
+
+  if (exponent < 0) {
+    *out++ = '-';
+    exponent = -exponent;
+  }
+  do {
+    digits[length++] = (char)('0' + exponent % 10);
+    exponent /= 10;
+  } while (exponent);
+  while (length) {
+    *out++ = digits[--length];
+  }
+  return out;
+}
+
+/**
+ * @brief Formats a block of words with a compiled template.
+ *
+ * @param tpl Compiled template.
+ * @param words Words to format.
+ * @param count Number of words.
+ * @param out Output buffer of at least `count * tpl->record_bytes` bytes.
+ * @return size_t Number of bytes written.
+ */
+size_t template_emit(const struct output_template *tpl, const uint64_t *words,
+                     size_t count, char *out) {
+  const struct template_op *end = tpl->ops + tpl->op_count;
+  char *start = out;
+
+  for (size_t i = 0; i < count; i++) {
+    uint64_t word = words[i];
+
+    for (const struct template_op *op = tpl->ops; op < end; op++) {
+      switch (op->opcode) {
+      case TEMPLATE_LITERAL:
+        memcpy(out, tpl->literals + op->offset, op->length);
+        out += op->length;
+        break;
+      case TEMPLATE_BITS:
+        for (int bit = op->shift + op->count - 1; bit >= op->shift; bit--) {
+          *out++ = (char)('0' + ((word >> bit) & 1));
+        }
+        break;
+      case TEMPLATE_HEX:
+        for (int digit = op->count - 1; digit >= 0; digit--) {
+          *out++ = hex_digits[(word >> (4 * digit)) & 0xf];
+        }
+        break;
+      case TEMPLATE_EXPONENT:
+        out = emit_exponent(out, word, tpl->layout);
+        break;
+      case TEMPLATE_VALUE:
+        out += sprintf(out, op->format, op->count,
+                       decode_float_word(word, tpl->layout));
+        break;
+      case TEMPLATE_CLASS: {
+        const char *name =
+            float_class_name(classify_float_word(word, tpl->layout));
+        size_t length = strlen(name);
+        memcpy(out, name, length);
+        out += length;
+        break;
+      }
+      }
+    }
+  }
+
+  return (size_t)(out - start);
+}
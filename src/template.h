@@ -0,0 +1,103 @@
+/**
+ * @file template.h
+ * @brief User-defined output line formats compiled into emit operations.
+ *
+ * A template such as `{bits},{value},{exponent},{class}` is parsed once into
+ * a short list of operations with every field offset and literal resolved, so
+ * formatting a record only walks that list. Placeholders:
+ *
+ * | Placeholder       | Output                                           |
+ * |-------------------|--------------------------------------------------|
+ * | `{bits}`          | the whole word as '0's and '1's                  |
+ * | `{hex}`           | the whole word as lowercase hex digits           |
+ * | `{sign}`          | the sign bit                                     |
+ * | `{exponent_bits}` | the biased exponent field as '0's and '1's       |
+ * | `{fraction_bits}` | the fraction field as '0's and '1's              |
+ * | `{exponent}`      | the unbiased exponent as a decimal integer       |
+ * | `{value}`         | the decimal value, `{value:STYLE}` picks a style |
+ * | `{class}`         | zero, subnormal, normal, infinite or nan         |
+ *
+ * Value styles are `shortest` (default, round-trippable `%g`), `sci`
+ * (round-trippable `%e`) and `fixed` (`%f`, as printed interactively). `{{`
+ * and `}}` produce literal braces, and every record ends with a newline.
+ */
+
+#ifndef TEMPLATE_H
+#define TEMPLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "float_word.h"
+
+/** @brief Maximum number of operations in a compiled template. */
+#define TEMPLATE_MAX_OPS 64
+
+/** @brief Maximum number of literal characters in a template. */
+#define TEMPLATE_MAX_LITERALS 256
+
+/** @brief Size of the compile error message, with its terminator. */
+#define TEMPLATE_ERROR_BYTES 128
+
+/**
+ * @brief Operations a template compiles to.
+ */
+enum template_opcode {
+  TEMPLATE_LITERAL,  /**< Copy `length` literal bytes from `offset`. */
+  TEMPLATE_BITS,     /**< Emit `count` bits starting at bit `shift`. */
+  TEMPLATE_HEX,      /**< Emit the word as `count` hex digits. */
+  TEMPLATE_EXPONENT, /**< Emit the unbiased exponent. */
+  TEMPLATE_VALUE,    /**< Emit the value with printf format `format`. */
+  TEMPLATE_CLASS,    /**< Emit the class name. */
+};
+
+/**
+ * @brief One step of a compiled template.
+ */
+struct template_op {
+  enum template_opcode opcode; /**< What to emit. */
+  int shift;                   /**< Lowest bit of a bit field. */
+  int count;                   /**< Bits, hex digits or printf precision. */
+  const char *format;          /**< printf format of a value. */
+  size_t offset;               /**< Start of literal text in `literals`. */
+  size_t length;               /**< Length of literal text. */
+};
+
+/**
+ * @brief A template compiled for one word layout.
+ */
+struct output_template {
+  const struct float_layout *layout;        /**< Layout of the words. */
+  struct template_op ops[TEMPLATE_MAX_OPS]; /**< Operations, in order. */
+  size_t op_count;                          /**< Number of operations. */
+  char literals[TEMPLATE_MAX_LITERALS];     /**< Storage for literal text. */
+  size_t literal_count;                     /**< Bytes used in `literals`. */
+  size_t record_bytes;                      /**< Upper bound on one record. */
+  char error[TEMPLATE_ERROR_BYTES];         /**< Why compiling failed. */
+};
+
+/**
+ * @brief Parses a template into emit operations.
+ *
+ * @param tpl Receives the compiled template.
+ * @param spec Template text, see the file description for placeholders.
+ * @param layout Layout of the words the template will format.
+ * @return int 0 on success, -1 if the template is malformed. The reason is
+ *         left in `tpl->error`.
+ */
+int template_compile(struct output_template *tpl, const char *spec,
+                     const struct float_layout *layout);
+
+/**
+ * @brief Formats a block of words with a compiled template.
+ *
+ * @param tpl Compiled template.
+ * @param words Words to format.
+ * @param count Number of words.
+ * @param out Output buffer of at least `count * tpl->record_bytes` bytes.
+ * @return size_t Number of bytes written.
+ */
+size_t template_emit(const struct output_template *tpl, const uint64_t *words,
+                     size_t count, char *out);
+
+#endif
@@ -0,0 +1,335 @@
+/**
+ * @file tuning.c
+ * @brief Execution strategy of the batch pipeline, calibrated per machine.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "tuning.h"
+
+#include "latency.h"
+#include "parallel.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define DEFAULT_THREADS 8       // Helpers rarely pay off beyond this
+#define CALIBRATE_VALUES 524288 // Values timed per measurement
+#define CALIBRATE_ROUNDS 3      // Measurements kept at their minimum
+
+static const char *const output_names[TUNING_OUTPUTS] = {
+    "bits", "decimal", "xor", "template", "explain", "raw"};
+
+static struct tuning current;
+static pthread_once_t loaded = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Fills in the strategy used without a calibration.
+ *
+ * @param tuning Receives the defaults.
+ */
+void tuning_defaults(struct tuning *tuning) {
+  memset(tuning, 0, sizeof(*tuning));
+  tuning->cpus = parallel_cpu_count();
+  tuning->threads =
+      tuning->cpus < DEFAULT_THREADS ? tuning->cpus : DEFAULT_THREADS;
+  tuning->simd = 1;
+  // Text rendering is too cheap to split; printf-based formats are not
+  tuning->split_values[STREAM_DECIMAL] = 1024;
+  tuning->split_values[STREAM_TEMPLATE] = 1024;
+}
+
+static void load_current(void) {
+  char path[4096];
+  struct tuning saved;
+
+  tuning_defaults(&current);
+  saved = current;
+  if (tuning_path(path, sizeof(path)) == 0 && tuning_load(path, &saved) == 0 &&
+      saved.cpus == current.cpus) {
+    current = saved;
+  }
+}
+
+/**
+ * @brief Returns the strategy of this process, loading it on first use.
+ *
+ * @return const struct tuning* The saved calibration, or the defaults when
+ *         there is none for this machine.
+ */
+const struct tuning *tuning_get(void) {
+  pthread_once(&loaded, load_current);
+  return &current;
+}
+
+/**
+ * @brief Finds the file the calibration is saved in.
+ *
+ * @param path Receives the path.
+ * @param size Size of `path` in bytes.
+ * @return int 0 on success, -1 if no location is configured or the path is
+ *         too long.
+ */
+int tuning_path(char *path, size_t size) {
+  const char *file = getenv("BF2D_TUNING");
+  const char *config = getenv("XDG_CONFIG_HOME");
+  const char *home = getenv("HOME");
+  int length;
+
+  if (file && *file) {
+    length = snprintf(path, size, "%s", file);
+  } else if (config && *config) {
+    length = snprintf(path, size, "%s/bf2d/tuning.conf", config);
+  } else if (home && *home) {
+    length = snprintf(path, size, "%s/.config/bf2d/tuning.conf", home);
+  } else {
+    return -1;
+  }
+  return length > 0 && (size_t)length < size ? 0 : -1;
+}
+
+/**
+ * @brief Reads a saved strategy.
+ *
+ * @param path File to read.
+ * @param tuning Receives the strategy; keys missing from the file keep their
+ *               value.
+ * @return int 0 on success, -1 if the file cannot be read or is malformed.
+ */
+int tuning_load(const char *path, struct tuning *tuning) {
+  FILE *in = fopen(path, "r");
+  char line[256];
+  int status = 0;
+
+  if (!in) {
+    return -1;
+  }
+  while (status == 0 && fgets(line, sizeof(line), in)) {
+    char *value = strchr(line, '=');
+    size_t number;
+
+    if (line[0] == '#' || line[0] == '\n') {
+      continue;
+    } else if (!value) {
+      status = -1;
+      break;
+    }
+    *value++ = '\0';
+    number = strtoull(value, NULL, 10);
+
+    if (strcmp(line, "cpus") == 0) {
+      tuning->cpus = number;
+    } else if (strcmp(line, "threads") == 0) {
+      tuning->threads = number ? number : 1;
+    } else if (strcmp(line, "simd") == 0) {
+      tuning->simd = number != 0;
+    } else if (strncmp(line, "split.", 6) == 0) {
+      status = -1;
+      for (int output = 0; output < TUNING_OUTPUTS; output++) {
+        if (strcmp(line + 6, output_names[output]) == 0) {
+          tuning->split_values[output] = number;
+          status = 0;
+        }
+      }
+    } else {
+      status = -1;
+    }
+  }
+  fclose(in);
+  return status;
+}
+
+/**
+ * @brief Creates the directories leading to `path`.
+ */
+static void make_parents(char *path) {
+  for (char *slash = strchr(path + 1, '/'); slash;
+       slash = strchr(slash + 1, '/')) {
+    *slash = '\0';
+    mkdir(path, 0755); // Existing directories are fine
+    *slash = '/';
+  }
+}
+
+static int save(const char *path, const struct tuning *tuning) {
+  char parents[4096];
+  FILE *out;
+
+  snprintf(parents, sizeof(parents), "%s", path);
+  make_parents(parents);
+  if (!(out = fopen(path, "w"))) {
+    perror(path);
+    return -1;
+  }
+
+  fprintf(out,
+          "# Written by BinaryFloatToDecimal --calibrate\n"
+          "cpus=%zu\nthreads=%zu\nsimd=%d\n",
+          tuning->cpus, tuning->threads, tuning->simd);
+  for (int output = 0; output < TUNING_OUTPUTS; output++) {
+    fprintf(out, "split.%s=%zu\n", output_names[output],
+            tuning->split_values[output]);
+  }
+  if (fclose(out)) {
+    perror(path);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Times generated blocks of `block` values through a context.
+ *
+ * @return double Nanoseconds per value.
+ */
+static double time_blocks(struct bf2d_ctx *ctx, struct stream_options *options,
+                          const struct tuning *tuning, size_t block,
+                          FILE *sink) {
+  size_t repeats = CALIBRATE_VALUES / block;
+  uint64_t start = latency_now();
+
+  options->input = STREAM_GEN;
+  options->corpus.distribution = CORPUS_NORMAL;
+  options->corpus.count = block;
+  options->tuning = tuning;
+  for (size_t i = 0; i < repeats; i++) {
+    options->corpus.seed = i + 1;
+    bf2d_ctx_set_options(ctx, options);
+    bf2d_ctx_convert(ctx, NULL, sink);
+  }
+  return (double)(latency_now() - start) / (double)(repeats * block);
+}
+
+/**
+ * @brief Times two strategies in alternating rounds, so that drifting clock
+ *        speeds and warm-up affect both alike.
+ *
+ * @param best Receives the fastest round of each strategy in ns per value.
+ */
+static void compare(struct bf2d_ctx *ctx, struct stream_options *options,
+                    const struct tuning *strategies[2], size_t block,
+                    FILE *sink, double best[2]) {
+  for (int round = 0; round < CALIBRATE_ROUNDS; round++) {
+    for (int i = 0; i < 2; i++) {
+      double time = time_blocks(ctx, options, strategies[i], block, sink);
+      if (round == 0 || time < best[i]) {
+        best[i] = time;
+      }
+    }
+  }
+}
+
+/**
+ * @brief Finds the smallest block size from which splitting keeps winning.
+ */
+static size_t calibrate_split(struct bf2d_ctx *ctx,
+                              struct stream_options *options,
+                              const struct tuning *tuning, FILE *sink,
+                              FILE *report) {
+  struct tuning serial = *tuning, split = *tuning;
+  const struct tuning *strategies[2] = {&serial, &split};
+  size_t threshold = 0;
+
+  serial.threads = 1;
+  for (int output = 0; output < TUNING_OUTPUTS; output++) {
+    split.split_values[output] = 1;
+  }
+
+  fprintf(report, "  %-8s", output_names[options->output]);
+  for (size_t block = STREAM_BLOCK_VALUES; block >= 64; block /= 2) {
+    double best[2];
+    compare(ctx, options, strategies, block, sink, best);
+    fprintf(report, " %zu:%.0f%%", block, 100.0 * best[1] / best[0]);
+    if (best[1] > 0.9 * best[0]) {
+      break; // Splitting must win clearly, and keep winning above
+    }
+    threshold = block;
+  }
+  fprintf(report, " -> %zu\n", threshold);
+  return threshold;
+}
+
+/**
+ * @brief Measures the best strategy for this machine and saves it.
+ *
+ * @param report Stream for a summary of the measurements.
+ * @return int 0 on success, -1 if the file could not be written.
+ */
+int tuning_calibrate(FILE *report) {
+  static const enum stream_format splittable[] = {
+      STREAM_BITS, STREAM_DECIMAL, STREAM_TEMPLATE, STREAM_EXPLAIN};
+  struct stream_options options = {.width = 64,
+                                   .template_spec = "{hex} {value}"};
+  struct tuning tuning, one, portable;
+  struct bf2d_ctx *ctx;
+  char path[4096];
+  FILE *sink;
+  int status;
+
+  if (tuning_path(path, sizeof(path))) {
+    fprintf(stderr, "Set HOME or BF2D_TUNING to save the calibration\n");
+    return -1;
+  }
+  tuning_defaults(&tuning);
+  tuning.threads = tuning.cpus;
+  memset(tuning.split_values, 0, sizeof(tuning.split_values));
+  if (!(sink = fopen("/dev/null", "w"))) {
+    perror("/dev/null");
+    return -1;
+  }
+  if (!(ctx = bf2d_ctx_create(&options))) {
+    fprintf(stderr, "Memory allocation error.\n");
+    fclose(sink);
+    return -1;
+  }
+
+  // The bit renderers on one thread, with and without field separators
+  one = tuning;
+  one.threads = 1;
+  portable = one;
+  portable.simd = 0;
+  const struct tuning *renderers[2] = {&one, &portable};
+  double simd = 0, scalar = 0;
+  options.output = STREAM_BITS;
+  for (options.separator = '\0';; options.separator = ' ') {
+    double best[2];
+    compare(ctx, &options, renderers, STREAM_BLOCK_VALUES, sink, best);
+    simd += best[0];
+    scalar += best[1];
+    if (options.separator) {
+      break;
+    }
+  }
+  options.separator = '\0';
+  tuning.simd = simd <= scalar;
+  fprintf(report, "bit renderers: %s (%.2f ns/value, portable %.2f)\n",
+          tuning.simd ? "cpu-specific" : "portable", simd / 2, scalar / 2);
+
+  if (tuning.threads > 1) {
+    fprintf(report, "split time vs one thread, by block size, %zu threads:\n",
+            tuning.threads);
+    for (size_t i = 0; i < sizeof(splittable) / sizeof(splittable[0]); i++) {
+      options.output = splittable[i];
+      tuning.split_values[splittable[i]] =
+          calibrate_split(ctx, &options, &tuning, sink, report);
+    }
+  }
+  bf2d_ctx_destroy(ctx);
+  fclose(sink);
+
+  if (tuning.threads > 1) {
+    // Without a format worth splitting, never wake the helpers
+    int useful = 0;
+    for (int output = 0; output < TUNING_OUTPUTS; output++) {
+      useful |= tuning.split_values[output] != 0;
+    }
+    tuning.threads = useful ? tuning.threads : 1;
+  }
+  status = save(path, &tuning);
+  if (status == 0) {
+    fprintf(report, "saved to %s\n", path);
+  }
+  return status;
+}
@@ -0,0 +1,86 @@
+/**
+ * @file tuning.h
+ * @brief Execution strategy of the batch pipeline, calibrated per machine.
+ *
+ * The pipeline picks, for every block, between converting on the calling
+ * thread and splitting the format stage across helper threads (see
+ * parallel.h), and between the CPU-specific and the portable bit renderers
+ * (see bit_text.h). Splitting only pays off once a block holds enough values
+ * to outweigh waking the helpers, and that break-even point depends on the
+ * output format and on the machine.
+ *
+ * `tuning_calibrate` measures the break-even points and the renderers once
+ * and saves them in a small key=value file, which every later run loads.
+ * Without the file, conservative defaults apply. The file is looked up at
+ * `$BF2D_TUNING`, then `$XDG_CONFIG_HOME/bf2d/tuning.conf`, then
+ * `~/.config/bf2d/tuning.conf`, and is ignored if it was calibrated on a
+ * machine with a different number of processors.
+ */
+
+#ifndef TUNING_H
+#define TUNING_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "stream.h"
+
+/** @brief Number of output formats, indexing `tuning.split_values`. */
+#define TUNING_OUTPUTS STREAM_GEN
+
+/**
+ * @brief Execution strategy of the batch pipeline.
+ */
+struct tuning {
+  size_t cpus;    /**< Processors of the machine it was calibrated on. */
+  size_t threads; /**< Threads that share a split block, 1 to never split. */
+  int simd;       /**< Use the CPU-specific bit renderers. */
+  size_t split_values[TUNING_OUTPUTS]; /**< Fewest values in a block worth
+                                            splitting, per output format;
+                                            0 to never split. */
+};
+
+/**
+ * @brief Returns the strategy of this process, loading it on first use.
+ *
+ * @return const struct tuning* The saved calibration, or the defaults when
+ *         there is none for this machine.
+ */
+const struct tuning *tuning_get(void);
+
+/**
+ * @brief Fills in the strategy used without a calibration.
+ *
+ * @param tuning Receives the defaults.
+ */
+void tuning_defaults(struct tuning *tuning);
+
+/**
+ * @brief Finds the file the calibration is saved in.
+ *
+ * @param path Receives the path.
+ * @param size Size of `path` in bytes.
+ * @return int 0 on success, -1 if no location is configured or the path is
+ *         too long.
+ */
+int tuning_path(char *path, size_t size);
+
+/**
+ * @brief Reads a saved strategy.
+ *
+ * @param path File to read.
+ * @param tuning Receives the strategy; keys missing from the file keep their
+ *               value.
+ * @return int 0 on success, -1 if the file cannot be read or is malformed.
+ */
+int tuning_load(const char *path, struct tuning *tuning);
+
+/**
+ * @brief Measures the best strategy for this machine and saves it.
+ *
+ * @param report Stream for a summary of the measurements.
+ * @return int 0 on success, -1 if the file could not be written.
+ */
+int tuning_calibrate(FILE *report);
+
+#endif
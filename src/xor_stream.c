@@ -0,0 +1,322 @@
+/**
+ * @file xor_stream.c
+ * @brief Gorilla-style XOR-delta compressed streams of IEEE 754 words.
+ */
+
+#include "xor_stream.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LEAD_BITS 5 // Leading zero count field, capped at 31
+
+/**
+ * @brief MSB-first bit packer over a byte buffer.
+ */
+struct bit_writer {
+  unsigned char *out;
+  size_t pos;
+  uint64_t acc; // Pending bits, right-aligned
+  int fill;     // Number of pending bits (always < 8 between calls)
+};
+
+/**
+ * @brief MSB-first bit reader over a byte buffer.
+ */
+struct bit_reader {
+  const unsigned char *in;
+  size_t length;
+  size_t pos;
+  uint64_t acc;
+  int fill;
+};
+
+static void put_bits(struct bit_writer *bw, uint64_t value, int count) {
+  if (count > 32) {
+    put_bits(bw, value >> 32, count - 32);
+    value &= 0xffffffffu;
+    count = 32;
+  }
+
+  bw->acc = (bw->acc << count) | value;
+  bw->fill += count;
+  while (bw->fill >= 8) {
+    bw->fill -= 8;
+    bw->out[bw->pos++] = (unsigned char)(bw->acc >> bw->fill);
+  }
+  bw->acc &= (UINT64_C(1) << bw->fill) - 1;
+}
+
+static size_t finish_bits(struct bit_writer *bw) {
+  if (bw->fill) {
+    bw->out[bw->pos++] = (unsigned char)(bw->acc << (8 - bw->fill));
+    bw->fill = 0;
+  }
+  return bw->pos;
+}
+
+static int get_bits(struct bit_reader *br, int count, uint64_t *value) {
+  if (count > 32) {
+    uint64_t high, low;
+    if (get_bits(br, count - 32, &high) || get_bits(br, 32, &low)) {
+      return -1;
+    }
+    *value = (high << 32) | low;
+    return 0;
+  }
+
+  while (br->fill < count) {
+    if (br->pos >= br->length) {
+      return -1;
+    }
+    br->acc = (br->acc << 8) | br->in[br->pos++];
+    br->fill += 8;
+  }
+  br->fill -= count;
+  *value = (br->acc >> br->fill) & ((UINT64_C(1) << count) - 1);
+  return 0;
+}
+
+static void store_u32(unsigned char *out, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    out[i] = (unsigned char)(value >> (8 * i));
+  }
+}
+
+static uint32_t load_u32(const unsigned char *in) {
+  return (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 |
+         (uint32_t)in[3] << 24;
+}
+
+/**
+ * @brief Encodes a block of words into a self-contained payload.
+ *
+ * @param words Words to encode.
+ * @param count Number of words (at least 1).
+ * @param width Word width in bits (32 or 64).
+ * @param payload Output buffer of at least `XOR_BLOCK_BYTES(count)` bytes.
+ * @return size_t Number of payload bytes written.
+ */
+size_t xor_encode_block(const uint64_t *words, size_t count, int width,
+                        unsigned char *payload) {
+  struct bit_writer bw = {payload, 0, 0, 0};
+  int length_bits = width == 64 ? 6 : 5;
+  int prev_lead = -1, prev_trail = 0; // No zero window yet
+
+  put_bits(&bw, words[0], width);
+
+  for (size_t i = 1; i < count; i++) {
+    uint64_t x = words[i] ^ words[i - 1];
+    if (!x) {
+      put_bits(&bw, 0, 1);
+      continue;
+    }
+
+    int lead = __builtin_clzll(x) - (64 - width);
+    int trail = __builtin_ctzll(x);
+    if (lead > 31) {
+      lead = 31;
+    }
+
+    if (prev_lead >= 0 && lead >= prev_lead && trail >= prev_trail) {
+      // Meaningful bits fit inside the previous window
+      put_bits(&bw, 2, 2);
+      put_bits(&bw, x >> prev_trail, width - prev_lead - prev_trail);
+    } else {
+      int meaningful = width - lead - trail;
+      put_bits(&bw, 3, 2);
+      put_bits(&bw, (uint64_t)lead, LEAD_BITS);
+      put_bits(&bw, (uint64_t)meaningful & ((1u << length_bits) - 1),
+               length_bits);
+      put_bits(&bw, x >> trail, meaningful);
+      prev_lead = lead;
+      prev_trail = trail;
+    }
+  }
+
+  return finish_bits(&bw);
+}
+
+/**
+ * @brief Decodes a payload produced by `xor_encode_block`.
+ *
+ * @param payload Encoded block.
+ * @param length Number of payload bytes.
+ * @param count Number of words stored in the block.
+ * @param width Word width in bits (32 or 64).
+ * @param words Receives `count` decoded words.
+ * @return int 0 on success, -1 if the payload is truncated.
+ */
+int xor_decode_block(const unsigned char *payload, size_t length, size_t count,
+                     int width, uint64_t *words) {
+  struct bit_reader br = {payload, length, 0, 0, 0};
+  int length_bits = width == 64 ? 6 : 5;
+  int lead = 0, trail = 0;
+  uint64_t prev, control, value;
+
+  if (!count) {
+    return 0;
+  }
+  if (get_bits(&br, width, &prev)) {
+    return -1;
+  }
+  words[0] = prev;
+
+  for (size_t i = 1; i < count; i++) {
+    if (get_bits(&br, 1, &control)) {
+      return -1;
+    }
+    if (control) {
+      if (get_bits(&br, 1, &control)) {
+        return -1;
+      }
+      if (control) {
+        uint64_t lead_field, length_field;
+        if (get_bits(&br, LEAD_BITS, &lead_field) ||
+            get_bits(&br, length_bits, &length_field)) {
+          return -1;
+        }
+        int meaningful = length_field ? (int)length_field : width;
+        lead = (int)lead_field;
+        trail = width - lead - meaningful;
+        if (trail < 0) {
+          return -1;
+        }
+      }
+      if (get_bits(&br, width - lead - trail, &value)) {
+        return -1;
+      }
+      prev ^= value << trail;
+    }
+    words[i] = prev;
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Fills in the 16-byte header that starts every XOR stream.
+ *
+ * @param header Receives `XOR_STREAM_HEADER_BYTES` bytes.
+ * @param width Word width in bits (32 or 64).
+ */
+void xor_stream_header(unsigned char *header, int width) {
+  memset(header, 0, XOR_STREAM_HEADER_BYTES);
+  memcpy(header, XOR_STREAM_MAGIC, 8);
+  header[8] = (unsigned char)width;
+  store_u32(header + 12, XOR_BLOCK_VALUES);
+}
+
+/**
+ * @brief Encodes a block together with its count and length header.
+ *
+ * @param words Words to encode.
+ * @param count Number of words (1 to `XOR_BLOCK_VALUES`).
+ * @param width Word width in bits (32 or 64).
+ * @param out Output buffer of at least `XOR_FRAME_BYTES(count)` bytes.
+ * @return size_t Number of bytes written, header included.
+ */
+size_t xor_frame_block(const uint64_t *words, size_t count, int width,
+                       unsigned char *out) {
+  size_t length = xor_encode_block(words, count, width, out + 8);
+
+  store_u32(out, (uint32_t)count);
+  store_u32(out + 4, (uint32_t)length);
+  return length + 8;
+}
+
+/**
+ * @brief Reads and validates an XOR stream header.
+ *
+ * @param reader Reader to initialize: zero-filled, or a reader opened before
+ *               whose payload buffer is reused.
+ * @param in Source stream.
+ * @return int 0 on success, -1 if the header is missing or malformed, or
+ *         with `errno` set to `ENOMEM` if memory ran out.
+ */
+int xor_reader_open(struct xor_reader *reader, FILE *in) {
+  unsigned char header[XOR_STREAM_HEADER_BYTES];
+
+  if (fread(header, 1, sizeof(header), in) != sizeof(header) ||
+      memcmp(header, XOR_STREAM_MAGIC, 8) != 0 ||
+      (header[8] != 32 && header[8] != 64)) {
+    return -1;
+  }
+
+  reader->in = in;
+  reader->width = header[8];
+  reader->block_values = load_u32(header + 12);
+  if (!reader->block_values || reader->block_values > XOR_BLOCK_VALUES) {
+    return -1;
+  }
+
+  // A reader opened before keeps its payload buffer when it is big enough
+  size_t capacity = XOR_BLOCK_BYTES(reader->block_values);
+  if (!reader->payload || reader->capacity < capacity) {
+    free(reader->payload);
+    reader->capacity = 0;
+    reader->payload = (unsigned char *)malloc(capacity);
+    if (!reader->payload) {
+      return -1;
+    }
+    reader->capacity = capacity;
+  }
+  return 0;
+}
+
+/**
+ * @brief Reads the next block of the stream without decoding it.
+ *
+ * @param reader Open reader.
+ * @return long Number of words in the block, 0 at end of stream, -1 on a
+ *         truncated or malformed block, including an empty one or one whose
+ *         payload length cannot hold its count.
+ */
+long xor_reader_load(struct xor_reader *reader) {
+  unsigned char header[8];
+  size_t got = fread(header, 1, sizeof(header), reader->in);
+
+  reader->count = 0;
+  if (got == 0) {
+    return 0;
+  } else if (got != sizeof(header)) {
+    return -1;
+  }
+
+  // Encoders never frame an empty block, so a zero count is corruption
+  // rather than an end marker; the payload holds at least the verbatim first
+  // word and one control bit per further word
+  size_t count = load_u32(header);
+  size_t length = load_u32(header + 4);
+  if (!count || count > reader->block_values ||
+      length < ((size_t)reader->width + count - 1 + 7) / 8 ||
+      length > XOR_BLOCK_BYTES(count) || length > reader->capacity ||
+      fread(reader->payload, 1, length, reader->in) != length) {
+    return -1;
+  }
+  reader->count = count;
+  reader->length = length;
+  return (long)count;
+}
+
+/**
+ * @brief Decodes the block read by the last `xor_reader_load`.
+ *
+ * @param reader Open reader.
+ * @param words Receives `reader->count` words.
+ * @return int 0 on success, -1 if the payload is corrupt.
+ */
+int xor_reader_decode(struct xor_reader *reader, uint64_t *words) {
+  return xor_decode_block(reader->payload, reader->length, reader->count,
+                          reader->width, words);
+}
+
+/**
+ * @brief Releases the reader's buffers.
+ *
+ * @param reader Open or zero-filled reader.
+ */
+void xor_reader_close(struct xor_reader *reader) {
+  free(reader->payload);
+  reader->payload = NULL;
+}
@@ -0,0 +1,152 @@
+/**
+ * @file xor_stream.h
+ * @brief Gorilla-style XOR-delta compressed streams of IEEE 754 words.
+ *
+ * Consecutive values in a slowly changing series share their sign, exponent
+ * and the top of their fraction, so XOR-ing each word with its predecessor
+ * leaves a short run of meaningful bits framed by leading and trailing zeros.
+ * Each value is stored as:
+ *
+ * - `0` if it repeats the previous word,
+ * - `10` + meaningful bits if the XOR fits the previous zero window,
+ * - `11` + 5-bit leading zero count + meaningful length (5 bits for binary32,
+ *   6 bits for binary64, where the full width is stored as 0) + meaningful
+ *   bits otherwise.
+ *
+ * Stream layout (integers are little-endian):
+ *
+ * | Field        | Size | Contents                                  |
+ * |--------------|------|-------------------------------------------|
+ * | magic        | 8    | `BF2DXOR1`                                |
+ * | width        | 1    | 32 or 64                                  |
+ * | reserved     | 3    | zero                                      |
+ * | block values | 4    | maximum number of values per block        |
+ *
+ * followed by blocks of `count` (4 bytes), `payload bytes` (4 bytes) and the
+ * payload. Every block restarts the XOR chain with a verbatim first value, so
+ * blocks can be located from their headers and decoded independently.
+ */
+
+#ifndef XOR_STREAM_H
+#define XOR_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/** @brief Magic bytes at the start of every XOR stream. */
+#define XOR_STREAM_MAGIC "BF2DXOR1"
+
+/** @brief Most values one block holds. */
+#define XOR_BLOCK_VALUES 4096
+
+/**
+ * @brief Upper bound on the encoded size of a block.
+ *
+ * The worst case is a control pair, a leading zero count, a length and a full
+ * word for every value: 2 + 5 + 6 + 64 bits, rounded up to 10 bytes.
+ */
+#define XOR_BLOCK_BYTES(count) ((count) * 10 + 8)
+
+/** @brief Upper bound on a block plus its 8-byte count and length header. */
+#define XOR_FRAME_BYTES(count) (XOR_BLOCK_BYTES(count) + 8)
+
+/** @brief Size of the stream header in bytes. */
+#define XOR_STREAM_HEADER_BYTES 16
+
+/**
+ * @brief Encodes a block of words into a self-contained payload.
+ *
+ * @param words Words to encode.
+ * @param count Number of words (at least 1).
+ * @param width Word width in bits (32 or 64).
+ * @param payload Output buffer of at least `XOR_BLOCK_BYTES(count)` bytes.
+ * @return size_t Number of payload bytes written.
+ */
+size_t xor_encode_block(const uint64_t *words, size_t count, int width,
+                        unsigned char *payload);
+
+/**
+ * @brief Decodes a payload produced by `xor_encode_block`.
+ *
+ * @param payload Encoded block.
+ * @param length Number of payload bytes.
+ * @param count Number of words stored in the block.
+ * @param width Word width in bits (32 or 64).
+ * @param words Receives `count` decoded words.
+ * @return int 0 on success, -1 if the payload is truncated.
+ */
+int xor_decode_block(const unsigned char *payload, size_t length, size_t count,
+                     int width, uint64_t *words);
+
+/**
+ * @brief Fills in the 16-byte header that starts every XOR stream.
+ *
+ * @param header Receives `XOR_STREAM_HEADER_BYTES` bytes.
+ * @param width Word width in bits (32 or 64).
+ */
+void xor_stream_header(unsigned char *header, int width);
+
+/**
+ * @brief Encodes a block together with its count and length header.
+ *
+ * @param words Words to encode.
+ * @param count Number of words (1 to `XOR_BLOCK_VALUES`).
+ * @param width Word width in bits (32 or 64).
+ * @param out Output buffer of at least `XOR_FRAME_BYTES(count)` bytes.
+ * @return size_t Number of bytes written, header included.
+ */
+size_t xor_frame_block(const uint64_t *words, size_t count, int width,
+                       unsigned char *out);
+
+/**
+ * @brief Reader for an XOR stream.
+ */
+struct xor_reader {
+  FILE *in;               /**< Source stream. */
+  int width;              /**< Word width in bits, read from the header. */
+  size_t block_values;    /**< Maximum values per block, from the header. */
+  unsigned char *payload; /**< Payload of the last loaded block. */
+  size_t capacity;        /**< Size of `payload` in bytes. */
+  size_t length;          /**< Bytes of the loaded payload. */
+  size_t count;           /**< Words in the loaded block. */
+};
+
+/**
+ * @brief Reads and validates an XOR stream header.
+ *
+ * @param reader Reader to initialize: zero-filled, or a reader opened before
+ *               whose payload buffer is reused.
+ * @param in Source stream.
+ * @return int 0 on success, -1 if the header is missing or malformed, or
+ *         with `errno` set to `ENOMEM` if memory ran out.
+ */
+int xor_reader_open(struct xor_reader *reader, FILE *in);
+
+/**
+ * @brief Reads the next block of the stream without decoding it.
+ *
+ * @param reader Open reader.
+ * @return long Number of words in the block, 0 at end of stream, -1 on a
+ *         truncated or malformed block, including an empty one or one whose
+ *         payload length cannot hold its count.
+ */
+long xor_reader_load(struct xor_reader *reader);
+
+/**
+ * @brief Decodes the block read by the last `xor_reader_load`.
+ *
+ * @param reader Open reader.
+ * @param words Receives `reader->count` words.
+ * @return int 0 on success, -1 if the payload is corrupt.
+ */
+int xor_reader_decode(struct xor_reader *reader, uint64_t *words);
+
+/**
+ * @brief Releases the reader's buffers.
+ *
+ * @param reader Open or zero-filled reader.
+ */
+void xor_reader_close(struct xor_reader *reader);
+
+#endif
@@ -0,0 +1,373 @@
+/**
+ * @file xxh3.c
+ * @brief Streaming XXH3-64 hash, for checksums of the output as it is written.
+ */
+
+#include "xxh3.h"
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define PRIME32_1 0x9E3779B1u
+#define PRIME32_2 0x85EBCA77u
+#define PRIME32_3 0xC2B2AE3Du
+#define PRIME64_1 0x9E3779B185EBCA87u
+#define PRIME64_2 0xC2B2AE3D27D4EB4Fu
+#define PRIME64_3 0x165667B19E3779F9u
+#define PRIME64_4 0x85EBCA77C2B2AE63u
+#define PRIME64_5 0x27D4EB2F165667C5u
+#define PRIME_MX1 0x165667919E3779F9u
+#define PRIME_MX2 0x9FB21C651E98DF25u
+
+#define STRIPE_BYTES 64      // Input consumed by one accumulation
+#define SECRET_BYTES 192     // Size of the default secret
+#define SECRET_STEP 8        // Secret advance from one stripe to the next
+#define SECRET_LIMIT 128     // Secret offset of the scramble key
+#define BLOCK_STRIPES 16     // Stripes between scrambles
+#define MIDSIZE_MAX 240      // Longest input hashed without accumulators
+#define MIDSIZE_LAST_KEY 119 // Secret offset of the last lane past 128
+#define BUFFER_STRIPES (XXH3_BUFFER_BYTES / STRIPE_BYTES)
+
+static const unsigned char secret[SECRET_BYTES] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c,
+    0xf7, 0x21, 0xad, 0x1c, 0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb,
+    0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f, 0xcb, 0x79, 0xe6, 0x4e,
+    0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6,
+    0x81, 0x3a, 0x26, 0x4c, 0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb,
+    0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3, 0x71, 0x64, 0x48, 0x97,
+    0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7,
+    0xc7, 0x0b, 0x4f, 0x1d, 0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31,
+    0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64, 0xea, 0xc5, 0xac, 0x83,
+    0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26,
+    0x29, 0xd4, 0x68, 0x9e, 0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc,
+    0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce, 0x45, 0xcb, 0x3a, 0x8f,
+    0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+static uint32_t read32(const unsigned char *p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  value = __builtin_bswap32(value);
+#endif
+  return value;
+}
+
+static uint64_t read64(const unsigned char *p) {
+  uint64_t value;
+  memcpy(&value, p, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  value = __builtin_bswap64(value);
+#endif
+  return value;
+}
+
+static uint64_t rotl64(uint64_t x, unsigned r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+/**
+ * @brief Multiplies two words to 128 bits and folds the halves together.
+ */
+static uint64_t mul_fold(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+  unsigned __int128 product = (unsigned __int128)a * b;
+  return (uint64_t)product ^ (uint64_t)(product >> 64);
+#else
+  uint64_t lo_lo = (a & 0xFFFFFFFFu) * (b & 0xFFFFFFFFu);
+  uint64_t hi_lo = (a >> 32) * (b & 0xFFFFFFFFu);
+  uint64_t lo_hi = (a & 0xFFFFFFFFu) * (b >> 32);
+  uint64_t hi_hi = (a >> 32) * (b >> 32);
+  uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFFu) + lo_hi;
+  uint64_t upper = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+  return ((cross << 32) | (lo_lo & 0xFFFFFFFFu)) ^ upper;
+#endif
+}
+
+static uint64_t xxh64_avalanche(uint64_t h) {
+  h ^= h >> 33;
+  h *= PRIME64_2;
+  h ^= h >> 29;
+  h *= PRIME64_3;
+  return h ^ (h >> 32);
+}
+
+static uint64_t avalanche(uint64_t h) {
+  h ^= h >> 37;
+  h *= PRIME_MX1;
+  return h ^ (h >> 32);
+}
+
+static uint64_t rrmxmx(uint64_t h, uint64_t length) {
+  h ^= rotl64(h, 49) ^ rotl64(h, 24);
+  h *= PRIME_MX2;
+  h ^= (h >> 35) + length;
+  h *= PRIME_MX2;
+  return h ^ (h >> 28);
+}
+
+static uint64_t mix16(const unsigned char *p, const unsigned char *key) {
+  return mul_fold(read64(p) ^ read64(key), read64(p + 8) ^ read64(key + 8));
+}
+
+/**
+ * @brief Hashes up to 16 bytes.
+ */
+static uint64_t hash_short(const unsigned char *p, size_t length) {
+  if (length > 8) {
+    uint64_t lo = read64(p) ^ (read64(secret + 24) ^ read64(secret + 32));
+    uint64_t hi =
+        read64(p + length - 8) ^ (read64(secret + 40) ^ read64(secret + 48));
+    return avalanche(length + __builtin_bswap64(lo) + hi + mul_fold(lo, hi));
+  } else if (length >= 4) {
+    uint64_t word = read32(p + length - 4) + ((uint64_t)read32(p) << 32);
+    return rrmxmx(word ^ (read64(secret + 8) ^ read64(secret + 16)), length);
+  } else if (length) {
+    uint32_t packed = ((uint32_t)p[0] << 16) |
+                      ((uint32_t)p[length >> 1] << 24) | p[length - 1] |
+                      ((uint32_t)length << 8);
+    return xxh64_avalanche(packed ^ (read32(secret) ^ read32(secret + 4)));
+  }
+  return xxh64_avalanche(read64(secret + 56) ^ read64(secret + 64));
+}
+
+/**
+ * @brief Hashes 17 to 240 bytes.
+ */
+static uint64_t hash_medium(const unsigned char *p, size_t length) {
+  uint64_t acc = length * PRIME64_1;
+
+  if (length <= 128) {
+    // Pairs of 16-byte lanes from both ends, as many as the length covers
+    if (length > 32) {
+      if (length > 64) {
+        if (length > 96) {
+          acc += mix16(p + 48, secret + 96);
+          acc += mix16(p + length - 64, secret + 112);
+        }
+        acc += mix16(p + 32, secret + 64);
+        acc += mix16(p + length - 48, secret + 80);
+      }
+      acc += mix16(p + 16, secret + 32);
+      acc += mix16(p + length - 32, secret + 48);
+    }
+    acc += mix16(p, secret);
+    acc += mix16(p + length - 16, secret + 16);
+    return avalanche(acc);
+  }
+
+  for (size_t i = 0; i < 8; i++) {
+    acc += mix16(p + 16 * i, secret + 16 * i);
+  }
+  acc = avalanche(acc);
+  for (size_t i = 8; i < length / 16; i++) {
+    acc += mix16(p + 16 * i, secret + 16 * (i - 8) + 3);
+  }
+  acc += mix16(p + length - 16, secret + MIDSIZE_LAST_KEY);
+  return avalanche(acc);
+}
+
+/**
+ * @brief Adds one stripe to the accumulators.
+ */
+static void accumulate(uint64_t *acc, const unsigned char *p,
+                       const unsigned char *key) {
+#if defined(__SSE2__)
+  // Two lanes per register, over twice as fast as the scalar loop
+  for (size_t i = 0; i < 4; i++) {
+    __m128i sum = _mm_loadu_si128((const __m128i *)acc + i);
+    __m128i value = _mm_loadu_si128((const __m128i *)p + i);
+    __m128i keyed =
+        _mm_xor_si128(value, _mm_loadu_si128((const __m128i *)key + i));
+    __m128i product =
+        _mm_mul_epu32(keyed, _mm_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1)));
+    __m128i swapped = _mm_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2));
+    sum = _mm_add_epi64(sum, _mm_add_epi64(product, swapped));
+    _mm_storeu_si128((__m128i *)acc + i, sum);
+  }
+#else
+  for (size_t i = 0; i < 8; i++) {
+    uint64_t value = read64(p + 8 * i);
+    uint64_t keyed = value ^ read64(key + 8 * i);
+    acc[i ^ 1] += value;
+    acc[i] += (keyed & 0xFFFFFFFFu) * (keyed >> 32);
+  }
+#endif
+}
+
+/**
+ * @brief Mixes the accumulators at the end of a block.
+ */
+static void scramble(uint64_t *acc) {
+#if defined(__SSE2__)
+  const __m128i prime = _mm_set1_epi32((int)PRIME32_1);
+  for (size_t i = 0; i < 4; i++) {
+    __m128i value = _mm_loadu_si128((const __m128i *)acc + i);
+    value = _mm_xor_si128(value, _mm_srli_epi64(value, 47));
+    value = _mm_xor_si128(value, _mm_loadu_si128((const __m128i *)(
+                                     secret + SECRET_LIMIT) + i));
+    // The 64-bit product by a 32-bit prime, from two 32-bit halves
+    __m128i low = _mm_mul_epu32(value, prime);
+    __m128i high = _mm_mul_epu32(_mm_srli_epi64(value, 32), prime);
+    value = _mm_add_epi64(low, _mm_slli_epi64(high, 32));
+    _mm_storeu_si128((__m128i *)acc + i, value);
+  }
+#else
+  for (size_t i = 0; i < 8; i++) {
+    uint64_t value = acc[i];
+    value ^= value >> 47;
+    value ^= read64(secret + SECRET_LIMIT + 8 * i);
+    acc[i] = value * PRIME32_1;
+  }
+#endif
+}
+
+/**
+ * @brief Adds whole stripes, scrambling whenever a block fills up.
+ *
+ * @param stripes Stripes of the current block consumed so far, updated.
+ * @return const unsigned char* First byte after the consumed stripes.
+ */
+static const unsigned char *consume(uint64_t *acc, size_t *stripes,
+                                    const unsigned char *p, size_t count) {
+  while (count) {
+    size_t take = BLOCK_STRIPES - *stripes;
+    take = take < count ? take : count;
+    for (size_t i = 0; i < take; i++) {
+      accumulate(acc, p + i * STRIPE_BYTES,
+                 secret + (*stripes + i) * SECRET_STEP);
+    }
+    p += take * STRIPE_BYTES;
+    count -= take;
+    *stripes += take;
+    if (*stripes == BLOCK_STRIPES) {
+      scramble(acc);
+      *stripes = 0;
+    }
+  }
+  return p;
+}
+
+/**
+ * @brief Folds the accumulators into the hash of `length` bytes.
+ */
+static uint64_t merge(const uint64_t *acc, uint64_t length) {
+  uint64_t result = length * PRIME64_1;
+
+  for (size_t i = 0; i < 4; i++) {
+    result += mul_fold(acc[2 * i] ^ read64(secret + 11 + 16 * i),
+                       acc[2 * i + 1] ^ read64(secret + 19 + 16 * i));
+  }
+  return avalanche(result);
+}
+
+/**
+ * @brief Hashes a buffer in one call.
+ *
+ * @param data Bytes to hash.
+ * @param length Number of bytes.
+ * @return uint64_t XXH3-64 of the bytes.
+ */
+uint64_t xxh3_64(const void *data, size_t length) {
+  struct xxh3_state state;
+
+  if (length <= 16) {
+    return hash_short((const unsigned char *)data, length);
+  } else if (length <= MIDSIZE_MAX) {
+    return hash_medium((const unsigned char *)data, length);
+  }
+  xxh3_reset(&state);
+  xxh3_update(&state, data, length);
+  return xxh3_digest(&state);
+}
+
+/**
+ * @brief Starts a new stream.
+ *
+ * @param state State to reset.
+ */
+void xxh3_reset(struct xxh3_state *state) {
+  static const uint64_t initial[8] = {PRIME32_3, PRIME64_1, PRIME64_2,
+                                      PRIME64_3, PRIME64_4, PRIME32_2,
+                                      PRIME64_5, PRIME32_1};
+
+  memcpy(state->acc, initial, sizeof(initial));
+  state->buffered = 0;
+  state->stripes = 0;
+  state->length = 0;
+}
+
+/**
+ * @brief Adds bytes to a stream.
+ *
+ * @param state State started by `xxh3_reset`.
+ * @param data Next bytes of the stream.
+ * @param length Number of bytes.
+ */
+void xxh3_update(struct xxh3_state *state, const void *data, size_t length) {
+  const unsigned char *p = (const unsigned char *)data;
+  const unsigned char *end = p + length;
+
+  state->length += length;
+  // A full buffer is only consumed once more bytes arrive, so the last
+  // stripe is always left for `xxh3_digest`
+  if (state->buffered + length <= XXH3_BUFFER_BYTES) {
+    memcpy(state->buffer + state->buffered, p, length);
+    state->buffered += length;
+    return;
+  }
+  if (state->buffered) {
+    size_t fill = XXH3_BUFFER_BYTES - state->buffered;
+    memcpy(state->buffer + state->buffered, p, fill);
+    p += fill;
+    consume(state->acc, &state->stripes, state->buffer, BUFFER_STRIPES);
+    state->buffered = 0;
+  }
+  if ((size_t)(end - p) > XXH3_BUFFER_BYTES) {
+    p = consume(state->acc, &state->stripes, p,
+                (size_t)(end - p - 1) / STRIPE_BYTES);
+    memcpy(state->buffer + XXH3_BUFFER_BYTES - STRIPE_BYTES, p - STRIPE_BYTES,
+           STRIPE_BYTES);
+  }
+  memcpy(state->buffer, p, (size_t)(end - p));
+  state->buffered = (size_t)(end - p);
+}
+
+/**
+ * @brief Returns the hash of the bytes added so far.
+ *
+ * The stream can be continued afterwards.
+ *
+ * @param state State started by `xxh3_reset`.
+ * @return uint64_t XXH3-64 of the stream so far.
+ */
+uint64_t xxh3_digest(const struct xxh3_state *state) {
+  unsigned char last[STRIPE_BYTES];
+  const unsigned char *tail;
+  uint64_t acc[8];
+  size_t stripes = state->stripes;
+
+  if (state->length <= MIDSIZE_MAX) {
+    return xxh3_64(state->buffer, (size_t)state->length);
+  }
+  memcpy(acc, state->acc, sizeof(acc));
+  if (state->buffered >= STRIPE_BYTES) {
+    consume(acc, &stripes, state->buffer,
+            (state->buffered - 1) / STRIPE_BYTES);
+    tail = state->buffer + state->buffered - STRIPE_BYTES;
+  } else {
+    // The last stripe reaches back into bytes already consumed
+    size_t back = STRIPE_BYTES - state->buffered;
+    memcpy(last, state->buffer + XXH3_BUFFER_BYTES - back, back);
+    memcpy(last + back, state->buffer, state->buffered);
+    tail = last;
+  }
+  accumulate(acc, tail, secret + SECRET_LIMIT - 7);
+  return merge(acc, state->length);
+}
@@ -0,0 +1,208 @@
+/**
+ * @file async_test.c
+ * @brief A batch of jobs on a one-thread pool, with cancellations.
+ *
+ * A long generated conversion holds the only worker while the rest of the
+ * batch queues behind it: a good and a malformed conversion, one that is
+ * cancelled before it starts, and one that reports through a callback. The
+ * long job is then cancelled mid-run, and the finished jobs are collected by
+ * polling the pool's eventfd, as an event loop would.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "async.h"
+#include "check.h"
+
+#define POLL_TIMEOUT_MS 10000
+
+/**
+ * @brief A submitted job and what it should end as.
+ */
+struct expected_job {
+  const char *name;
+  const char *input;        // Bits to convert, NULL for a generated corpus
+  enum async_status status; // Status it must finish with
+  const char *output;       // Decimal output it must produce, or NULL
+  FILE *in;
+  FILE *out;
+  struct async_job *job;
+  int finished;
+};
+
+static atomic_int callback_status = -1;
+
+static void on_finish(struct async_job *job, enum async_status status,
+                      void *user) {
+  struct expected_job *expected = (struct expected_job *)user;
+
+  (void)job;
+  expected->finished = 1;
+  atomic_store(&callback_status, (int)status);
+}
+
+static struct async_job *submit(struct async_pool *pool,
+                                struct expected_job *expected,
+                                async_callback callback) {
+  struct stream_options options = {0};
+
+  options.width = 32;
+  options.output = STREAM_DECIMAL;
+  if (expected->input) {
+    options.input = STREAM_BITS;
+    expected->in = tmpfile();
+    if (expected->in) {
+      fputs(expected->input, expected->in);
+      rewind(expected->in);
+    }
+    expected->out = tmpfile();
+  } else {
+    // Far more values than the test waits for; only a cancel ends it
+    options.input = STREAM_GEN;
+    options.corpus.distribution = CORPUS_NORMAL;
+    options.corpus.seed = 1;
+    options.corpus.count = UINT64_C(1) << 40;
+    expected->out = fopen("/dev/null", "w");
+  }
+  return expected->job =
+             async_submit(pool, &options, expected->in, expected->out,
+                          callback, expected);
+}
+
+/**
+ * @brief Waits for a job to leave the queue.
+ */
+static void wait_running(const struct async_job *job) {
+  struct timespec pause = {0, 1000000};
+
+  for (int i = 0; i < POLL_TIMEOUT_MS &&
+                  async_job_status(job) == ASYNC_QUEUED;
+       i++) {
+    nanosleep(&pause, NULL);
+  }
+}
+
+/**
+ * @brief Waits for the callback job, which runs after every reaped one.
+ */
+static void wait_callback(void) {
+  struct timespec pause = {0, 1000000};
+
+  for (int i = 0; i < POLL_TIMEOUT_MS && atomic_load(&callback_status) < 0;
+       i++) {
+    nanosleep(&pause, NULL);
+  }
+}
+
+/**
+ * @brief Polls the eventfd and reaps until `count` jobs have come back.
+ */
+static void reap_jobs(struct async_pool *pool, size_t count) {
+  struct pollfd watch = {async_pool_eventfd(pool), POLLIN, 0};
+  struct async_job *job;
+  uint64_t signalled;
+  size_t reaped = 0;
+
+  while (reaped < count) {
+    if (poll(&watch, 1, POLL_TIMEOUT_MS) != 1) {
+      check(0, "eventfd becomes readable for every job");
+      return;
+    }
+    check(read(watch.fd, &signalled, sizeof(signalled)) ==
+                  sizeof(signalled) &&
+              signalled >= 1,
+          "eventfd counts finished jobs");
+    while ((job = async_pool_reap(pool))) {
+      struct expected_job *expected =
+          (struct expected_job *)async_job_user(job);
+      char what[128];
+
+      snprintf(what, sizeof(what), "%s job ends as expected", expected->name);
+      check(async_job_status(job) == expected->status, what);
+      snprintf(what, sizeof(what), "%s job has an error only if it failed",
+               expected->name);
+      check((async_job_error(job)[0] != '\0') ==
+                (expected->status == ASYNC_FAILED),
+            what);
+      expected->finished = 1;
+      async_job_free(job);
+      reaped++;
+    }
+  }
+}
+
+/**
+ * @brief Checks the output of a finished job and closes its streams.
+ */
+static void check_output(struct expected_job *expected) {
+  char text[256] = "";
+  char what[128];
+
+  if (expected->output && expected->out) {
+    rewind(expected->out);
+    text[fread(text, 1, sizeof(text) - 1, expected->out)] = '\0';
+    snprintf(what, sizeof(what), "%s job output", expected->name);
+    check(strcmp(text, expected->output) == 0, what);
+  }
+  if (expected->in) {
+    fclose(expected->in);
+  }
+  if (expected->out) {
+    fclose(expected->out);
+  }
+}
+
+int main(void) {
+  struct expected_job jobs[] = {
+      {"long", NULL, ASYNC_CANCELLED, NULL, NULL, NULL, NULL, 0},
+      {"good", "00111111100000000000000000000000\n"
+               "01000000010000000000000000000000\n",
+       ASYNC_DONE, "1\n3\n", NULL, NULL, NULL, 0},
+      {"malformed", "0011111110000000000x000000000000\n", ASYNC_FAILED,
+       "", NULL, NULL, NULL, 0},
+      {"queued", "00111111100000000000000000000000\n", ASYNC_CANCELLED, "",
+       NULL, NULL, NULL, 0},
+      {"callback", "01000000010000000000000000000000\n", ASYNC_DONE, "3\n",
+       NULL, NULL, NULL, 0},
+  };
+  const size_t count = sizeof(jobs) / sizeof(jobs[0]);
+  struct async_pool *pool = async_pool_create(1);
+
+  if (!pool) {
+    return 1;
+  }
+  check(submit(pool, &jobs[0], NULL) != NULL, "long job is submitted");
+  wait_running(jobs[0].job);
+  check(async_job_status(jobs[0].job) == ASYNC_RUNNING,
+        "long job holds the worker");
+
+  for (size_t i = 1; i < count; i++) {
+    check(submit(pool, &jobs[i], i == count - 1 ? on_finish : NULL) != NULL,
+          "job is submitted");
+  }
+  check(async_job_status(jobs[3].job) == ASYNC_QUEUED,
+        "jobs queue behind the long one");
+  async_job_cancel(jobs[3].job);
+  async_job_cancel(jobs[0].job); // Stops before its next block
+
+  reap_jobs(pool, count - 1);
+  wait_callback();
+  check(atomic_load(&callback_status) == ASYNC_DONE,
+        "callback reports the status");
+  for (size_t i = 0; i < count; i++) {
+    check(jobs[i].finished, "every job finishes");
+    check_output(&jobs[i]);
+  }
+  check(async_pool_reap(pool) == NULL, "nothing is left to reap");
+
+  async_pool_destroy(pool);
+  return check_summary();
+}
@@ -0,0 +1,43 @@
+/**
+ * @file check.h
+ * @brief Failure counting shared by the test programs.
+ *
+ * Each test program includes this once, calls `check` for every condition
+ * it expects and returns `check_summary()` from `main`, so a failed check
+ * is printed but the remaining checks still run.
+ */
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+static int failures;
+
+/**
+ * @brief Counts and prints a failed condition.
+ *
+ * @param condition Nonzero if the check passed.
+ * @param what Expectation, printed after "FAIL: " when it did not hold.
+ */
+static void check(int condition, const char *what) {
+  if (!condition) {
+    fprintf(stderr, "FAIL: %s\n", what);
+    failures++;
+  }
+}
+
+/**
+ * @brief Prints how many checks failed, if any.
+ *
+ * @return int Exit status for `main`: 0 if every check passed, 1 if not.
+ */
+static int check_summary(void) {
+  if (failures) {
+    fprintf(stderr, "%d check(s) failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
+
+#endif // CHECK_H
@@ -0,0 +1,428 @@
+/**
+ * @file http_test.c
+ * @brief Requests against a loopback server started in the test process.
+ *
+ * Covers conversions and their errors, priority classes, pipelined requests
+ * on one kept-alive connection, the metrics endpoint, the resident size of
+ * a server that has served thousands of short connections with latency
+ * recording on, and small requests from concurrent clients coalesced into
+ * one conversion.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "http.h"
+#include "latency.h"
+#include "memory_limit.h"
+#include "metrics.h"
+
+#define REPLY_BYTES 65536
+#define CHURN_CONNECTIONS 2000
+#define QUEUE_WAIT_MS 300
+#define BATCH_CLIENTS 8
+#define BATCH_BUDGET_US 300000 // Far longer than sending every request takes
+#define CHURN_GROWTH_LIMIT (8u << 20) // A leak of 40 KB each far exceeds it
+
+/**
+ * @brief Sends `request` on a new connection.
+ *
+ * @return int The connected socket, or -1 if it could not be sent.
+ */
+static int send_request(int port, const char *request) {
+  struct sockaddr_in address;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons((uint16_t)port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (fd < 0 ||
+      connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+      send(fd, request, strlen(request), 0) != (ssize_t)strlen(request)) {
+    perror("test connection");
+    if (fd >= 0) {
+      close(fd);
+    }
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * @brief Reads from `fd` until the server closes it, then closes it too.
+ *
+ * @return size_t Bytes of the reply, NUL-terminated in `reply`.
+ */
+static size_t read_reply(int fd, char *reply) {
+  size_t length = 0;
+  ssize_t got;
+
+  while (length < REPLY_BYTES - 1 &&
+         (got = recv(fd, reply + length, REPLY_BYTES - 1 - length, 0)) > 0) {
+    length += (size_t)got;
+  }
+  reply[length] = '\0';
+  close(fd);
+  return length;
+}
+
+/**
+ * @brief Sends `request` on a new connection and reads until it closes.
+ *
+ * @return size_t Bytes of the reply, NUL-terminated in `reply`.
+ */
+static size_t exchange(int port, const char *request, char *reply) {
+  int fd = send_request(port, request);
+
+  reply[0] = '\0';
+  return fd < 0 ? 0 : read_reply(fd, reply);
+}
+
+/**
+ * @brief Scrapes the metrics and returns the value of an unlabelled series.
+ */
+static unsigned long long scrape(int port, const char *name, char *reply) {
+  char prefix[96];
+  const char *line;
+
+  exchange(port, "GET /metrics HTTP/1.1\r\nConnection: close\r\n\r\n",
+           reply);
+  snprintf(prefix, sizeof(prefix), "\n%s ", name);
+  line = strstr(reply, prefix);
+  return line ? strtoull(line + strlen(prefix), NULL, 10) : 0;
+}
+
+/**
+ * @brief Posts `body` to `/convert?query` on a connection of its own.
+ */
+static size_t convert(int port, const char *query, const char *body,
+                      char *reply) {
+  char request[1024];
+
+  snprintf(request, sizeof(request),
+           "POST /convert?%s HTTP/1.1\r\nHost: test\r\n"
+           "Connection: close\r\nContent-Length: %zu\r\n\r\n%s",
+           query, strlen(body), body);
+  return exchange(port, request, reply);
+}
+
+static void test_convert(int port, char *reply) {
+  convert(port, "width=32&output=decimal",
+          "00111111100000000000000000000000\n"
+          "01000000010000000000000000000000\n",
+          reply);
+  check(strncmp(reply, "HTTP/1.1 200", 12) == 0, "conversion succeeds");
+  check(strstr(reply, "Transfer-Encoding: chunked") != NULL,
+        "conversion is chunked");
+  check(strstr(reply, "\r\n1\n3\n\r\n") != NULL, "conversion output");
+
+  convert(port, "width=32&output=decimal",
+          "0011111110000000000x000000000000\n", reply);
+  check(strncmp(reply, "HTTP/1.1 422", 12) == 0,
+        "malformed input is unprocessable");
+
+  convert(port, "width=32&output=decimal&on_error=skip",
+          "0011111110000000000x000000000000\n"
+          "01000000010000000000000000000000\n",
+          reply);
+  check(strncmp(reply, "HTTP/1.1 200", 12) == 0 &&
+            strstr(reply, "\r\n3\n\r\n") != NULL,
+        "skipped record is left out");
+
+  convert(port, "width=16", "0\n", reply);
+  check(strncmp(reply, "HTTP/1.1 400", 12) == 0, "bad width is rejected");
+}
+
+/**
+ * @brief Posts the head of a request whose body is sent later.
+ */
+static int start_convert(int port, const char *query, size_t length) {
+  char request[256];
+
+  snprintf(request, sizeof(request),
+           "POST /convert?%s HTTP/1.1\r\nHost: test\r\n"
+           "Connection: close\r\nContent-Length: %zu\r\n\r\n",
+           query, length);
+  return send_request(port, request);
+}
+
+static void test_classes(int port, char *reply) {
+  const char *body = "01000000010000000000000000000000\n";
+  struct pollfd queued;
+  int held, waiting;
+
+  // With two workers and one kept free, one bulk conversion fills the share
+  held = start_convert(port, "width=32&output=decimal&class=bulk",
+                       strlen(body));
+  waiting = start_convert(port, "width=32&output=decimal&class=bulk",
+                          strlen(body));
+  queued.fd = waiting;
+  queued.events = POLLIN;
+  check(held >= 0 && waiting >= 0 && send(waiting, body, strlen(body), 0) ==
+                                         (ssize_t)strlen(body),
+        "bulk requests are sent");
+  check(poll(&queued, 1, QUEUE_WAIT_MS) == 0,
+        "second bulk request waits for a worker");
+  exchange(port, "GET /metrics HTTP/1.1\r\nConnection: close\r\n\r\n",
+           reply);
+  check(strstr(reply, "\nbf2d_running_conversions{class=\"bulk\"} 1\n") &&
+            strstr(reply, "\nbf2d_queue_depth{class=\"bulk\"} 1\n"),
+        "metrics show the running and the queued bulk request");
+  convert(port, "width=32&output=decimal", body, reply);
+  check(strncmp(reply, "HTTP/1.1 200", 12) == 0 &&
+            strstr(reply, "\r\n3\n\r\n") != NULL,
+        "interactive request takes the reserved worker");
+  if (held >= 0) {
+    send(held, body, strlen(body), 0);
+    read_reply(held, reply);
+    check(strstr(reply, "\r\n3\n\r\n") != NULL, "held request finishes");
+  }
+  if (waiting >= 0) {
+    read_reply(waiting, reply);
+    check(strstr(reply, "\r\n3\n\r\n") != NULL,
+          "queued request runs once the worker is free");
+  }
+
+  convert(port, "width=32&output=decimal&class=bulk",
+          "00111111100000000000000000000000\n", reply);
+  check(strncmp(reply, "HTTP/1.1 200", 12) == 0 &&
+            strstr(reply, "\r\n1\n\r\n") != NULL,
+        "bulk request is converted");
+
+  convert(port, "width=32&class=urgent", "0\n", reply);
+  check(strncmp(reply, "HTTP/1.1 400", 12) == 0, "bad class is rejected");
+}
+
+static void test_pipelined(int port, char *reply) {
+  const char *body = "01000000010000000000000000000000\n";
+  char request[1024];
+  char *second;
+
+  snprintf(request, sizeof(request),
+           "POST /convert?width=32&output=decimal HTTP/1.1\r\n"
+           "Content-Length: %zu\r\n\r\n%s"
+           "POST /convert?width=32&output=bits HTTP/1.1\r\n"
+           "Connection: close\r\nContent-Length: %zu\r\n\r\n%s",
+           strlen(body), body, strlen(body), body);
+  exchange(port, request, reply);
+  second = strstr(reply + 1, "HTTP/1.1 200");
+  check(strncmp(reply, "HTTP/1.1 200", 12) == 0 && second != NULL,
+        "both pipelined requests are answered");
+  check(second && strstr(reply, "\r\n3\n\r\n") < second &&
+            strstr(second, body) != NULL,
+        "pipelined requests are answered in order");
+}
+
+static void test_format_cache(int port, char *reply) {
+  const char *body = "01000000010000000000000000000000\n";
+  unsigned long long hits, misses;
+  char request[1024];
+
+  hits = scrape(port, "bf2d_format_cache_hits_total", reply);
+  misses = scrape(port, "bf2d_format_cache_misses_total", reply);
+  // A new connection compiles its format, then keeps it for the same options
+  snprintf(request, sizeof(request),
+           "POST /convert?width=32&output=bits HTTP/1.1\r\n"
+           "Content-Length: %zu\r\n\r\n%s"
+           "POST /convert?width=32&output=bits HTTP/1.1\r\n"
+           "Connection: close\r\nContent-Length: %zu\r\n\r\n%s",
+           strlen(body), body, strlen(body), body);
+  exchange(port, request, reply);
+  check(scrape(port, "bf2d_format_cache_hits_total", reply) == hits + 1,
+        "repeated options reuse the compiled format");
+  check(scrape(port, "bf2d_format_cache_misses_total", reply) == misses + 1,
+        "new options compile the format");
+}
+
+static void test_metrics(int port, char *reply, unsigned long long served,
+                         unsigned long long bulk) {
+  char line[96];
+
+  exchange(port, "GET /metrics HTTP/1.1\r\nConnection: close\r\n\r\n",
+           reply);
+  check(strncmp(reply, "HTTP/1.1 200", 12) == 0, "metrics are served");
+  snprintf(line, sizeof(line), "\nbf2d_requests_total %llu\n", served);
+  check(strstr(reply, line) != NULL, "metrics count every request");
+  snprintf(line, sizeof(line),
+           "\nbf2d_requests_by_class_total{class=\"interactive\"} %llu\n",
+           served - bulk);
+  check(strstr(reply, line) != NULL, "metrics count interactive requests");
+  snprintf(line, sizeof(line),
+           "\nbf2d_requests_by_class_total{class=\"bulk\"} %llu\n", bulk);
+  check(strstr(reply, line) != NULL, "metrics count bulk requests");
+  check(strstr(reply, "bf2d_request_latency_seconds_count") != NULL,
+        "metrics include request latency");
+  snprintf(line, sizeof(line),
+           "\nbf2d_request_latency_by_class_seconds_count{class=\"bulk\"} "
+           "%llu\n",
+           bulk);
+  check(strstr(reply, line) != NULL, "metrics include latency by class");
+  for (int c = 0; c < HTTP_CLASSES; c++) {
+    snprintf(line, sizeof(line), "\nbf2d_queue_depth{class=\"%s\"} 0\n",
+             http_class_name((enum http_class)c));
+    check(strstr(reply, line) != NULL, "queues are empty once served");
+    snprintf(line, sizeof(line),
+             "\nbf2d_running_conversions{class=\"%s\"} 0\n",
+             http_class_name((enum http_class)c));
+    check(strstr(reply, line) != NULL, "no conversion runs once served");
+  }
+}
+
+static void test_churn(int port, char *reply) {
+  struct timespec settle = {0, 200000000};
+  uint64_t before, after;
+
+  convert(port, "width=32", "0\n", reply); // Let the first thread settle
+  nanosleep(&settle, NULL);
+  before = memory_resident_bytes();
+  for (int i = 0; i < CHURN_CONNECTIONS; i++) {
+    convert(port, "width=32&output=decimal",
+            "00111111100000000000000000000000\n", reply);
+  }
+  nanosleep(&settle, NULL);
+  after = memory_resident_bytes();
+  if (after > before + CHURN_GROWTH_LIMIT) {
+    fprintf(stderr, "resident size grew by %.1f MB\n",
+            (double)(after - before) / (1 << 20));
+  }
+  check(after <= before + CHURN_GROWTH_LIMIT,
+        "closed connections give their memory back");
+}
+
+/**
+ * @brief Sends a small request from each client at once, then reads every
+ *        reply.
+ *
+ * Client `i` sends `i % 3 + 1` records, the last being `values[i]`; with
+ * `bad` set, client 2 also sends a malformed one.
+ */
+static void exchange_batch(int port, int bad, char *reply) {
+  static const char *const values[BATCH_CLIENTS] = {
+      "00111111100000000000000000000000\n", // 1
+      "01000000000000000000000000000000\n", // 2
+      "01000000010000000000000000000000\n", // 3
+      "01000000100000000000000000000000\n", // 4
+      "01000000101000000000000000000000\n", // 5
+      "01000000110000000000000000000000\n", // 6
+      "01000000111000000000000000000000\n", // 7
+      "01000001000000000000000000000000\n", // 8
+  };
+  int fds[BATCH_CLIENTS];
+  char request[1024], body[256], expected[32], what[96];
+
+  for (int i = 0; i < BATCH_CLIENTS; i++) {
+    body[0] = '\0';
+    for (int r = 0; r < i % 3; r++) {
+      strcat(body, "00111111100000000000000000000000\n");
+    }
+    if (bad && i == 2) {
+      strcat(body, "0011111110000000000x000000000000\n");
+    }
+    strcat(body, values[i]);
+    snprintf(request, sizeof(request),
+             "POST /convert?width=32&output=decimal HTTP/1.1\r\n"
+             "Connection: close\r\nContent-Length: %zu\r\n\r\n%s",
+             strlen(body), body);
+    fds[i] = send_request(port, request);
+  }
+
+  for (int i = 0; i < BATCH_CLIENTS; i++) {
+    if (fds[i] < 0) {
+      check(0, "coalesced request is sent");
+      continue;
+    }
+    read_reply(fds[i], reply);
+    snprintf(what, sizeof(what), "client %d of %s batch gets its answer", i,
+             bad ? "a failed" : "a");
+    if (bad && i == 2) {
+      check(strncmp(reply, "HTTP/1.1 422", 12) == 0, what);
+      continue;
+    }
+    // Exactly its own records: i % 3 ones, then its value
+    strcpy(expected, "\r\n");
+    for (int r = 0; r < i % 3; r++) {
+      strcat(expected, "1\n");
+    }
+    snprintf(expected + strlen(expected), sizeof(expected) - strlen(expected),
+             "%d\n\r\n", i + 1);
+    check(strncmp(reply, "HTTP/1.1 200", 12) == 0 &&
+              strstr(reply, expected) != NULL,
+          what);
+  }
+}
+
+static void test_coalescing(char *reply) {
+  struct http_server server;
+  struct http_options options;
+  unsigned long long requests, batches;
+  struct timespec start, end;
+  int port;
+
+  http_options_default(&options);
+  options.batch_us = BATCH_BUDGET_US;
+  if ((port = http_server_start(&server, 0, &options)) < 0) {
+    check(0, "coalescing server starts");
+    return;
+  }
+
+  exchange_batch(port, 0, reply);
+  exchange_batch(port, 1, reply); // Every client is then converted alone
+
+  // An interactive request is answered at once, not after the budget
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  convert(port, "width=32&output=decimal&class=interactive",
+          "01000000010000000000000000000000\n", reply);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  check(strstr(reply, "\r\n3\n\r\n") != NULL &&
+            (end.tv_sec - start.tv_sec) * 1000000 +
+                    (end.tv_nsec - start.tv_nsec) / 1000 <
+                BATCH_BUDGET_US,
+        "interactive request skips coalescing");
+
+  requests = scrape(port, "bf2d_coalesced_requests_total", reply);
+  batches = scrape(port, "bf2d_coalesced_batches_total", reply);
+  check(requests == BATCH_CLIENTS, "only the good batch is shared");
+  check(batches >= 1 && batches < BATCH_CLIENTS,
+        "concurrent requests share conversions");
+  http_server_stop(&server);
+}
+
+int main(void) {
+  struct http_server server;
+  struct http_options options;
+  char *reply = (char *)malloc(REPLY_BYTES);
+  int port;
+
+  http_options_default(&options);
+  options.workers = 2;
+  options.interactive = 1;
+  metrics_enable();
+  if (!reply || latency_enable(NULL) ||
+      (port = http_server_start(&server, 0, &options)) < 0) {
+    return 1;
+  }
+
+  test_convert(port, reply);
+  test_classes(port, reply);
+  test_pipelined(port, reply);
+  test_format_cache(port, reply);
+  test_churn(port, reply);
+  // Every POST to /convert counts, whether or not it converted
+  test_metrics(port, reply, 4 + 5 + 2 + 2 + 1 + CHURN_CONNECTIONS, 3);
+  test_coalescing(reply);
+
+  http_server_stop(&server);
+  free(reply);
+  return check_summary();
+}
@@ -0,0 +1,193 @@
+/**
+ * @file rejects_test.c
+ * @brief Malformed records under each reject policy, and their report.
+ *
+ * The same input, with a digit error, a short line and good records around
+ * them, is converted under every policy; raw input cut short in a record is
+ * checked too. Outputs and reports are compared byte for byte, and a long
+ * run of mixed errors must be reported in input order.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "stream.h"
+
+#define TEXT_BYTES 8192
+#define MIXED_LINES 300 // More rejections than one report batch
+
+static const char bad_bits[] = "00111111100000000000000000000000\n"
+                               "0100000001000x000000000000000000\n"
+                               "010000000100000000000000000000\n"
+                               "01000000010000000000000000000000\n";
+
+/**
+ * @brief Writes `data` to a rewound temporary file.
+ */
+static FILE *spill(const void *data, size_t length) {
+  FILE *file = tmpfile();
+
+  if (file) {
+    fwrite(data, 1, length, file);
+    rewind(file);
+  }
+  return file;
+}
+
+/**
+ * @brief Reads a temporary file back as a NUL-terminated string.
+ */
+static void read_back(FILE *file, char *text) {
+  size_t length;
+
+  rewind(file);
+  length = fread(text, 1, TEXT_BYTES - 1, file);
+  text[length] = '\0';
+}
+
+/**
+ * @brief Converts `input` to decimal under `policy`.
+ *
+ * @param output Receives the converted records.
+ * @param report Receives the reject report.
+ * @param rejected Receives the number of rejected records.
+ * @return int Result of `bf2d_ctx_convert`.
+ */
+static int convert(enum stream_format format, const void *input,
+                   size_t length, enum stream_rejects policy, char *output,
+                   char *report, uint64_t *rejected) {
+  struct stream_options options = {0};
+  struct bf2d_ctx *ctx;
+  FILE *in = spill(input, length), *out = tmpfile(), *log = tmpfile();
+  int status = -1;
+
+  options.width = 32;
+  options.input = format;
+  options.output = STREAM_DECIMAL;
+  options.rejects = policy;
+  options.reject_report = log;
+  output[0] = report[0] = '\0';
+  *rejected = 0;
+  if (in && out && log && (ctx = bf2d_ctx_create(&options))) {
+    status = bf2d_ctx_convert(ctx, in, out);
+    *rejected = bf2d_ctx_stats(ctx)->rejected;
+    bf2d_ctx_destroy(ctx);
+    read_back(out, output);
+    read_back(log, report);
+  }
+  if (in) {
+    fclose(in);
+  }
+  if (out) {
+    fclose(out);
+  }
+  if (log) {
+    fclose(log);
+  }
+  return status;
+}
+
+static void test_text(char *output, char *report) {
+  uint64_t rejected;
+
+  check(convert(STREAM_BITS, bad_bits, strlen(bad_bits), STREAM_REJECT_FAIL,
+                output, report, &rejected) < 0,
+        "fail policy stops at a malformed record");
+  check(report[0] == '\0', "fail policy reports nothing");
+
+  check(convert(STREAM_BITS, bad_bits, strlen(bad_bits), STREAM_REJECT_SKIP,
+                output, report, &rejected) == 0,
+        "skip policy converts the rest");
+  check(strcmp(output, "1\n3\n") == 0, "skip policy leaves records out");
+  check(rejected == 2, "skip policy counts both records");
+  check(strcmp(report, "33,2,digit\n66,3,length\n") == 0,
+        "skip policy reports offset, record and reason");
+
+  check(convert(STREAM_BITS, bad_bits, strlen(bad_bits), STREAM_REJECT_NAN,
+                output, report, &rejected) == 0,
+        "nan policy converts the rest");
+  check(strcmp(output, "1\nnan\nnan\n3\n") == 0,
+        "nan policy keeps one record per input record");
+  check(rejected == 2, "nan policy counts both records");
+  check(strcmp(report, "33,2,digit\n66,3,length\n") == 0,
+        "nan policy reports like skip");
+}
+
+static void test_raw(char *output, char *report) {
+  const float values[] = {1.0f, 3.0f};
+  unsigned char raw[sizeof(values) + 3];
+  uint64_t rejected;
+
+  memcpy(raw, values, sizeof(values));
+  memset(raw + sizeof(values), 0, 3); // A record cut short
+
+  check(convert(STREAM_RAW, raw, sizeof(raw), STREAM_REJECT_FAIL, output,
+                report, &rejected) < 0,
+        "fail policy stops at a partial raw record");
+
+  check(convert(STREAM_RAW, raw, sizeof(raw), STREAM_REJECT_SKIP, output,
+                report, &rejected) == 0,
+        "skip policy drops a partial raw record");
+  check(strcmp(output, "1\n3\n") == 0, "skip policy keeps whole records");
+  check(strcmp(report, "8,3,partial\n") == 0,
+        "partial raw record is reported");
+
+  check(convert(STREAM_RAW, raw, sizeof(raw), STREAM_REJECT_NAN, output,
+                report, &rejected) == 0 &&
+            strcmp(output, "1\n3\nnan\n") == 0,
+        "nan policy replaces a partial raw record");
+}
+
+static void test_order(char *output, char *report) {
+  static const char digit[] = "0100000001000x000000000000000000\n";
+  char *input = (char *)malloc(MIXED_LINES * sizeof(digit));
+  size_t length = 0, lines = 0;
+  unsigned long long last = 0, offset;
+  uint64_t rejected;
+  int ordered = 1;
+
+  if (!input) {
+    check(0, "mixed input allocated");
+    return;
+  }
+  for (size_t i = 0; i < MIXED_LINES; i++) {
+    const char *line = i % 2 ? "01\n" : digit;
+    memcpy(input + length, line, strlen(line));
+    length += strlen(line);
+  }
+
+  check(convert(STREAM_BITS, input, length, STREAM_REJECT_SKIP, output,
+                report, &rejected) == 0 &&
+            rejected == MIXED_LINES,
+        "skip policy rejects every mixed record");
+  for (const char *line = report; *line; line = strchr(line, '\n') + 1) {
+    if (sscanf(line, "%llu", &offset) != 1 || (lines && offset <= last)) {
+      ordered = 0;
+      break;
+    }
+    last = offset;
+    lines++;
+  }
+  check(ordered && lines == MIXED_LINES,
+        "length and digit errors are reported in input order");
+  free(input);
+}
+
+int main(void) {
+  char *output = (char *)malloc(TEXT_BYTES);
+  char *report = (char *)malloc(TEXT_BYTES);
+
+  if (!output || !report) {
+    return 1;
+  }
+  test_text(output, report);
+  test_raw(output, report);
+  test_order(output, report);
+
+  free(output);
+  free(report);
+  return check_summary();
+}
@@ -0,0 +1,227 @@
+/**
+ * @file xor_stream_test.c
+ * @brief Round trips through XOR streams, and streams that must be rejected.
+ *
+ * Words go from a native array to an XOR stream and back through
+ * `run_stream`, for both widths and for series that exercise every control
+ * code. The corrupt cases start from a valid stream and damage its first
+ * block; each must fail instead of decoding to fewer values.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "stream.h"
+#include "xor_stream.h"
+
+#define TEST_VALUES 10000 // Two full blocks and a partial one
+
+/**
+ * @brief Fills `words` with a slowly drifting series broken by repeats and
+ *        by jumps to unrelated words.
+ */
+static void make_words(uint64_t *words, size_t count, int width) {
+  uint64_t state = 0x243F6A8885A308D3u;
+  uint64_t mask = width == 64 ? UINT64_MAX : UINT32_MAX;
+
+  for (size_t i = 0; i < count; i++) {
+    state = state * 6364136223846793005u + 1442695040888963407u;
+    if (i && state % 7 == 0) {
+      words[i] = words[i - 1];
+    } else if (i && state % 5 != 0) {
+      words[i] = (words[i - 1] ^ (state >> 50)) & mask;
+    } else {
+      words[i] = (state >> 3) & mask;
+    }
+  }
+}
+
+/**
+ * @brief Writes `words` as a native array to a temporary file.
+ */
+static FILE *raw_file(const uint64_t *words, size_t count, int width) {
+  FILE *file = tmpfile();
+
+  for (size_t i = 0; file && i < count; i++) {
+    if (width == 64) {
+      fwrite(&words[i], sizeof(words[i]), 1, file);
+    } else {
+      uint32_t word = (uint32_t)words[i];
+      fwrite(&word, sizeof(word), 1, file);
+    }
+  }
+  if (file) {
+    rewind(file);
+  }
+  return file;
+}
+
+/**
+ * @brief Converts `in` from one format to the other into a rewound
+ *        temporary file.
+ *
+ * @return FILE* Output, or NULL if the conversion fails.
+ */
+static FILE *convert(FILE *in, int width, enum stream_format input,
+                     enum stream_format output) {
+  struct stream_options options = {0};
+  FILE *out = tmpfile();
+
+  options.width = width;
+  options.input = input;
+  options.output = output;
+  if (!out || run_stream(&options, in, out)) {
+    if (out) {
+      fclose(out);
+    }
+    return NULL;
+  }
+  rewind(out);
+  return out;
+}
+
+/**
+ * @brief Reads a whole temporary file into memory.
+ */
+static unsigned char *slurp(FILE *file, size_t *length) {
+  unsigned char *data;
+
+  fseek(file, 0, SEEK_END);
+  *length = (size_t)ftell(file);
+  rewind(file);
+  data = (unsigned char *)malloc(*length + 1);
+  if (data && fread(data, 1, *length, file) != *length) {
+    free(data);
+    data = NULL;
+  }
+  return data;
+}
+
+/**
+ * @brief Writes `data` to a rewound temporary file.
+ */
+static FILE *spill(const unsigned char *data, size_t length) {
+  FILE *file = tmpfile();
+
+  if (file) {
+    fwrite(data, 1, length, file);
+    rewind(file);
+  }
+  return file;
+}
+
+/**
+ * @brief Decodes an XOR stream held in memory.
+ *
+ * @return int 0 if `run_stream` accepts it, -1 if it fails.
+ */
+static int decode(const unsigned char *data, size_t length, int width) {
+  FILE *in = spill(data, length);
+  FILE *out = in ? convert(in, width, STREAM_XOR, STREAM_RAW) : NULL;
+
+  if (in) {
+    fclose(in);
+  }
+  if (!out) {
+    return -1;
+  }
+  fclose(out);
+  return 0;
+}
+
+static void test_round_trip(int width) {
+  size_t bytes = (size_t)width / 8, length;
+  uint64_t *words = (uint64_t *)malloc(TEST_VALUES * sizeof(*words));
+  FILE *raw, *xor, *back;
+  unsigned char *original, *decoded;
+
+  make_words(words, TEST_VALUES, width);
+  raw = raw_file(words, TEST_VALUES, width);
+  xor = convert(raw, width, STREAM_RAW, STREAM_XOR);
+  check(xor != NULL, "raw to XOR conversion");
+  back = xor ? convert(xor, width, STREAM_XOR, STREAM_RAW) : NULL;
+  check(back != NULL, "XOR to raw conversion");
+
+  if (back) {
+    original = slurp(raw, &length);
+    decoded = slurp(back, &length);
+    check(length == TEST_VALUES * bytes, "round trip keeps every value");
+    check(original && decoded &&
+              memcmp(original, decoded, TEST_VALUES * bytes) == 0,
+          "round trip reproduces every word");
+    free(original);
+    free(decoded);
+    fclose(back);
+  }
+  if (xor) {
+    fclose(xor);
+  }
+  fclose(raw);
+  free(words);
+}
+
+static void test_corrupt(int width) {
+  uint64_t *words = (uint64_t *)malloc(TEST_VALUES * sizeof(*words));
+  unsigned char *stream, *damaged;
+  size_t length;
+  FILE *raw, *xor;
+
+  make_words(words, TEST_VALUES, width);
+  raw = raw_file(words, TEST_VALUES, width);
+  xor = convert(raw, width, STREAM_RAW, STREAM_XOR);
+  stream = xor ? slurp(xor, &length) : NULL;
+  check(stream != NULL, "XOR stream to damage");
+  if (!stream) {
+    free(words);
+    return;
+  }
+  damaged = (unsigned char *)malloc(length + 8);
+
+  check(decode(stream, length, width) == 0, "undamaged stream decodes");
+  check(decode(stream, XOR_STREAM_HEADER_BYTES, width) == 0,
+        "stream of no blocks decodes");
+
+  // An empty block header in front of the data used to end the stream early
+  memcpy(damaged, stream, XOR_STREAM_HEADER_BYTES);
+  memset(damaged + XOR_STREAM_HEADER_BYTES, 0, 8);
+  memcpy(damaged + XOR_STREAM_HEADER_BYTES + 8,
+         stream + XOR_STREAM_HEADER_BYTES, length - XOR_STREAM_HEADER_BYTES);
+  check(decode(damaged, length + 8, width) < 0,
+        "empty block followed by data is rejected");
+
+  // A payload too short for the count of the block
+  memcpy(damaged, stream, length);
+  memset(damaged + XOR_STREAM_HEADER_BYTES + 4, 0, 4);
+  damaged[XOR_STREAM_HEADER_BYTES + 4] = 1;
+  check(decode(damaged, length, width) < 0,
+        "payload shorter than its count is rejected");
+
+  // A count beyond the block size from the stream header
+  memcpy(damaged, stream, length);
+  damaged[XOR_STREAM_HEADER_BYTES + 2] = 1;
+  check(decode(damaged, length, width) < 0,
+        "count beyond the block size is rejected");
+
+  check(decode(stream, length - 1, width) < 0,
+        "truncated final block is rejected");
+  check(decode(stream, XOR_STREAM_HEADER_BYTES + 4, width) < 0,
+        "truncated block header is rejected");
+
+  free(damaged);
+  free(stream);
+  fclose(xor);
+  fclose(raw);
+  free(words);
+}
+
+int main(void) {
+  test_round_trip(32);
+  test_round_trip(64);
+  test_corrupt(32);
+  test_corrupt(64);
+
+  return check_summary();
+}